@@ -0,0 +1,21 @@
+// Timing helpers shared by the benches.
+
+#include <algorithm>
+#include <chrono>
+
+// time since `start`, in ms
+inline double Milliseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// best of `runs`, in ms
+template <typename Body>
+double Best(int runs, Body body) {
+    double best = 1e30;
+    for(int run = 0; run < runs; ++run){
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        body();
+        best = std::min(best, Milliseconds(start));
+    }
+    return best;
+}
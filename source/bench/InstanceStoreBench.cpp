@@ -0,0 +1,95 @@
+// Times iteration and frustum culling over InstanceStore against the
+// std::list<ModelInstance> the scene used to be kept in.
+// Build together with helpers/InstanceStore.cpp, BoundingVolumeHierarchy.cpp,
+// Frustum.cpp, CpuFeatures.cpp and Camera.cpp; run with no arguments.
+
+#include "../helpers/InstanceStore.h"
+#include "../helpers/Camera.h"
+#include "BenchTiming.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <vector>
+
+using namespace helpers;
+
+// the old layout: every instance is its own heap node, reached through the previous one
+struct ListedInstance {
+    const BoundingBox* bounds;
+    glm::mat4 transform;
+};
+
+static void Bench(size_t instanceCount) {
+    const int runs = 10;
+    const BoundingBox cube(glm::vec3(-1.0f), glm::vec3(1.0f));
+
+    std::list<ListedInstance> list;
+    InstanceStore store;
+    for(size_t i = 0; i < instanceCount; ++i){
+        glm::vec3 position(rand() % 400 - 200.0f, rand() % 400 - 200.0f, rand() % 400 - 200.0f);
+        float size = 0.5f + (rand() % 16) / 10.0f;
+        ListedInstance inst;
+        inst.bounds = &cube;
+        inst.transform = glm::scale(glm::translate(glm::mat4(), position), glm::vec3(size));
+        list.push_back(inst);
+        store.add(0, 0, cube, inst.transform);
+    }
+    // relinks the nodes in position order, so walking the list jumps around the heap
+    // the way it does after a session of adds and removes
+    list.sort([](const ListedInstance& a, const ListedInstance& b) { return a.transform[3].x < b.transform[3].x; });
+
+    Camera camera;
+    camera.setPosition(glm::vec3(0.0f));
+    camera.setViewportAspectRatio(16.0f / 9.0f);
+    camera.setNearAndFarPlanes(0.5f, 100.0f);
+    Frustum frustum(camera.matrix());
+
+    // iteration: sum of all positions
+    glm::vec3 listSum(0.0f), storeSum(0.0f);
+    double listIteration = Best(runs, [&]() {
+        for(std::list<ListedInstance>::const_iterator it = list.begin(); it != list.end(); ++it)
+            listSum += glm::vec3(it->transform[3]);
+    });
+    double storeIteration = Best(runs, [&]() {
+        const std::vector<glm::mat4>& transforms = store.transforms();
+        for(size_t i = 0; i < transforms.size(); ++i)
+            storeSum += glm::vec3(transforms[i][3]);
+    });
+
+    // culling: the list gathers world bounds every frame for the SIMD kernel, as Render() did;
+    // the store keeps them and culls through its tree, which is only rebuilt after adds and removes
+    BoundingBoxList listBounds;
+    std::vector<unsigned> listVisible, storeVisible;
+    double listCulling = Best(runs, [&]() {
+        listBounds.clear();
+        for(std::list<ListedInstance>::const_iterator it = list.begin(); it != list.end(); ++it)
+            listBounds.push(it->bounds->transformed(it->transform));
+        listVisible.clear();
+        frustum.cull(listBounds, listVisible);
+    });
+    double treeBuild = Best(1, [&]() { store.cull(frustum, storeVisible); });
+    double storeCulling = Best(runs, [&]() {
+        storeVisible.clear();
+        store.cull(frustum, storeVisible);
+    });
+
+    if(listVisible.size() != storeVisible.size())
+        printf("%zu instances: list sees %zu visible, store %zu!\n", instanceCount, listVisible.size(), storeVisible.size());
+    printf("%7zu instances: iteration list %7.3f ms, store %7.3f ms, %4.1fx; "
+           "culling list %7.3f ms, store %7.3f ms, %5.1fx (tree built in %.1f ms, %zu visible)\n",
+           instanceCount, listIteration, storeIteration, listIteration / storeIteration,
+           listCulling, storeCulling, listCulling / storeCulling, treeBuild, storeVisible.size());
+
+    // keeps the iteration loops from being optimized away
+    volatile float sink = listSum.x + storeSum.x;
+    (void)sink;
+}
+
+int main() {
+    srand(1);
+    Bench(1000);
+    Bench(10000);
+    Bench(100000);
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Times InstanceMatrices against the per-instance glm code BuildInstanceBatches
+// used before, filling the same interleaved instance records.
+// Build together with helpers/MatrixKernels.cpp, CpuFeatures.cpp and ThreadPool.cpp;
+// run with no arguments.
+
+#include "../helpers/MatrixKernels.h"
+#include "BenchTiming.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace helpers;
+
+// same layout as InstanceData in main.cpp
+struct Instance {
+    glm::mat4 model;
+    glm::mat4 modelViewProjection;
+    glm::mat3 normalMatrix;
+    int material;
+};
+
+static void Bench(size_t instanceCount) {
+    const int runs = 10;
+    glm::mat4 viewProjection = glm::perspective(1.0f, 16.0f / 9.0f, 0.5f, 100.0f) *
+                               glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, -10.0f));
+
+    std::vector<Instance> glmInstances(instanceCount), kernelInstances(instanceCount);
+    for(size_t i = 0; i < instanceCount; ++i){
+        glm::vec3 position(rand() % 400 - 200.0f, rand() % 400 - 200.0f, rand() % 400 - 200.0f);
+        glm::vec3 size(0.5f + (rand() % 16) / 10.0f, 0.5f + (rand() % 16) / 10.0f, 0.5f + (rand() % 16) / 10.0f);
+        float angle = (rand() % 360) / 57.3f;
+        glm::mat4 model = glm::scale(glm::rotate(glm::translate(glm::mat4(), position), angle, glm::vec3(0, 1, 0)), size);
+        glmInstances[i].model = kernelInstances[i].model = model;
+    }
+
+    double glmTime = Best(runs, [&]() {
+        for(size_t i = 0; i < glmInstances.size(); ++i){
+            Instance& inst = glmInstances[i];
+            inst.modelViewProjection = viewProjection * inst.model;
+            inst.normalMatrix = glm::transpose(glm::inverse(glm::mat3(inst.model)));
+        }
+    });
+    double kernelTime = Best(runs, [&]() {
+        InstanceMatrices(viewProjection,
+                         &kernelInstances[0].model, sizeof(Instance),
+                         &kernelInstances[0].modelViewProjection, sizeof(Instance),
+                         &kernelInstances[0].normalMatrix, sizeof(Instance),
+                         kernelInstances.size());
+    });
+
+    float maxError = 0.0f;
+    for(size_t i = 0; i < instanceCount; ++i){
+        for(int c = 0; c < 4; ++c)
+            for(int r = 0; r < 4; ++r)
+                maxError = std::max(maxError, std::fabs(glmInstances[i].modelViewProjection[c][r] - kernelInstances[i].modelViewProjection[c][r]));
+        for(int c = 0; c < 3; ++c)
+            for(int r = 0; r < 3; ++r)
+                maxError = std::max(maxError, std::fabs(glmInstances[i].normalMatrix[c][r] - kernelInstances[i].normalMatrix[c][r]));
+    }
+
+    printf("%7zu instances: glm %7.3f ms, InstanceMatrices %7.3f ms, %5.1fx (max difference %g)\n",
+           instanceCount, glmTime, kernelTime, glmTime / kernelTime, maxError);
+}
+
+int main() {
+    srand(1);
+    Bench(1000);
+    Bench(10000);
+    Bench(100000);
+    return 0;
+}
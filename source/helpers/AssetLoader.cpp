@@ -0,0 +1,733 @@
+#include "AssetLoader.h"
+#include "AtlasPacker.h"
+#include "GLState.h"
+#include <stdexcept>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+
+using namespace helpers;
+
+// textures aren't trimmed to a top level smaller than this
+static const unsigned MinTrimmedSize = 64;
+
+namespace {
+    // pixels of one texture or array layer: exactly one of the three sources
+    struct LoadedLayer {
+        std::unique_ptr<BakedTexture> baked;
+        std::vector<CompressedImage> compressed;
+        std::vector<Bitmap> mipLevels;
+    };
+}
+
+// what a pool thread hands back for upload, or an error.
+// `texture`/`array` and `uploads` are made on the GL thread when streaming starts
+struct AssetLoader::LoadedTexture {
+    TextureAsset* asset;
+    std::vector<LoadedLayer> layers;
+    std::vector<TextureAsset::Region> regions;
+    std::string error;
+    std::string imageError; // array images that failed and show the placeholder instead
+    double compressionPSNR;
+    std::unique_ptr<Texture> texture;
+    std::unique_ptr<TextureArray> array;
+    std::vector<std::unique_ptr<TextureStreamer::Upload> > uploads;
+    GLuint object;
+    unsigned residentLevel; // GL_TEXTURE_BASE_LEVEL, every layer has this level and the smaller ones
+    bool shown;             // already in place of the asset's texture
+    bool reload;            // evicted or trimmed before, not counted in the load stats again
+    unsigned droppedLevels; // top levels to leave out of the upload
+    size_t bytes;
+    unsigned topLevelSize;
+    unsigned fullSize;
+};
+
+// flat mid grey, lit like any other surface until the real texture arrives
+static Bitmap PlaceholderBitmap() {
+    const unsigned char grey[3] = { 128, 128, 128 };
+    return Bitmap(1, 1, Bitmap::Format_RGB, grey);
+}
+
+// reads one byte per page, so the upload doesn't stall on the disk
+static void TouchPages(const unsigned char* data, size_t size) {
+    volatile unsigned char sink = 0;
+    for(size_t offset = 0; offset < size; offset += 4096)
+        sink ^= data[offset];
+    (void)sink;
+}
+
+// compresses every level of every layer with one format, BC3 if any layer has alpha
+static double CompressLayers(std::vector<LoadedLayer>& layers) {
+    BlockFormat format = BlockFormat_BC1;
+    for(size_t i = 0; i < layers.size(); ++i){
+        if(ChooseBlockFormat(layers[i].mipLevels[0]) == BlockFormat_BC3)
+            format = BlockFormat_BC3;
+    }
+
+    // the worst layer is the one worth reporting
+    double psnr = 0.0;
+    for(size_t i = 0; i < layers.size(); ++i){
+        LoadedLayer& layer = layers[i];
+        for(size_t level = 0; level < layer.mipLevels.size(); ++level)
+            layer.compressed.push_back(CompressBitmap(layer.mipLevels[level], format, BlockQuality_Normal));
+        double layerPSNR = CompressionPSNR(layer.mipLevels[0], layer.compressed[0]);
+        if(i == 0 || layerPSNR < psnr)
+            psnr = layerPSNR;
+        layer.mipLevels.clear();
+    }
+    return psnr;
+}
+
+// the levels of a layer as the streamer wants them, pointing into the layer's data
+static std::vector<TextureStreamer::Level> StreamedLevels(const LoadedLayer& layer) {
+    std::vector<TextureStreamer::Level> levels;
+    if(layer.baked){
+        for(unsigned i = 0; i < layer.baked->levelCount(); ++i){
+            BakedTexture::Level level = layer.baked->level(i);
+            TextureStreamer::Level streamed = { level.width, level.height, level.data, level.size };
+            levels.push_back(streamed);
+        }
+    } else if(!layer.compressed.empty()){
+        for(size_t i = 0; i < layer.compressed.size(); ++i){
+            const CompressedImage& image = layer.compressed[i];
+            TextureStreamer::Level streamed = { image.width, image.height, &image.data[0], image.data.size() };
+            levels.push_back(streamed);
+        }
+    } else {
+        for(size_t i = 0; i < layer.mipLevels.size(); ++i){
+            const Bitmap& bitmap = layer.mipLevels[i];
+            size_t size = (size_t)bitmap.width() * bitmap.height() * bitmap.format();
+            TextureStreamer::Level streamed = { bitmap.width(), bitmap.height(), bitmap.pixelBuffer(), size };
+            levels.push_back(streamed);
+        }
+    }
+    return levels;
+}
+
+// largest size across a layer the asset is drawn at, from the sizes wanted for its images
+static unsigned WantedLayerSize(const std::vector<unsigned>& wantedSizes, const std::vector<TextureAsset::Region>& regions) {
+    double size = 0.0;
+    for(size_t i = 0; i < wantedSizes.size(); ++i){
+        double scale = i < regions.size() ? std::max(regions[i].scaleU, regions[i].scaleV) : 1.0;
+        size = std::max(size, wantedSizes[i] / std::max(scale, 1e-6));
+    }
+    return size >= (double)~0u ? ~0u : (unsigned)std::ceil(size);
+}
+
+// top levels of a chain starting at `fullSize` that aren't needed to draw it `wantedSize` across
+static unsigned UnneededLevels(unsigned fullSize, unsigned wantedSize) {
+    const unsigned keep = std::max(wantedSize, MinTrimmedSize);
+    unsigned dropped = 0;
+    while((fullSize >> (dropped + 1)) >= keep)
+        ++dropped;
+    return dropped;
+}
+
+// binds the texture, so `state` forgets its texture bindings
+static void SetBaseLevel(GLenum target, GLuint texture, unsigned level, GLState& state) {
+    glBindTexture(target, texture);
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, (GLint)level);
+    glBindTexture(target, 0);
+    state.forgetTextures();
+}
+
+static TextureAsset::Region WholeLayer(unsigned layer) {
+    TextureAsset::Region region = { layer, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+    return region;
+}
+
+TextureAsset::TextureAsset(const std::vector<std::string>& filePaths, GLenum target, GLuint placeholder) :
+    _filePaths(filePaths),
+    _target(target),
+    _state(State_Loading),
+    _texture(NULL),
+    _array(NULL),
+    _placeholder(placeholder),
+    _fromBakedFile(false),
+    _compressionPSNR(0.0),
+    _bytes(0),
+    _droppedLevels(0),
+    _topLevelSize(0),
+    _fullSize(0),
+    _frameUsed(0),
+    _wantedSizes(filePaths.size(), ~0u),
+    _queued(false)
+{
+}
+
+TextureAsset::~TextureAsset() {
+    delete _texture;
+    delete _array;
+}
+
+TextureAsset::State TextureAsset::state() const {
+    return _state;
+}
+
+GLenum TextureAsset::target() const {
+    return _target;
+}
+
+GLuint TextureAsset::object() const {
+    if(_texture)
+        return _texture->object();
+    if(_array)
+        return _array->object();
+    return _placeholder;
+}
+
+const std::string& TextureAsset::filePath() const {
+    return _filePaths[0];
+}
+
+size_t TextureAsset::imageCount() const {
+    return _filePaths.size();
+}
+
+TextureAsset::Region TextureAsset::region(size_t index) const {
+    if(index >= _filePaths.size())
+        throw std::runtime_error("Texture image index out of range");
+    bool loaded = _texture || _array;
+    return loaded && index < _regions.size() ? _regions[index] : WholeLayer(0);
+}
+
+size_t TextureAsset::bytes() const {
+    return _bytes;
+}
+
+unsigned TextureAsset::droppedLevels() const {
+    return _droppedLevels;
+}
+
+const std::string& TextureAsset::error() const {
+    return _error;
+}
+
+bool TextureAsset::fromBakedFile() const {
+    return _fromBakedFile;
+}
+
+double TextureAsset::compressionPSNR() const {
+    return _compressionPSNR;
+}
+
+AssetLoader::AssetLoader(bool compressTextures, GLState& state, ThreadPool& pool) :
+    _pool(pool),
+    _state(state),
+    _compressTextures(compressTextures),
+    _placeholder(NULL),
+    _arrayPlaceholder(NULL),
+    _streaming(NULL),
+    _loading(0),
+    _memoryBudget(0),
+    _frame(1),
+    _jobsInFlight(0),
+    _cancelled(false)
+{
+    std::memset(&_stats, 0, sizeof(_stats));
+
+    Bitmap placeholder = PlaceholderBitmap();
+    _placeholder = new Texture(placeholder, GL_NEAREST);
+    _arrayPlaceholder = new TextureArray(Bitmap::Format_RGB, 1, 1, 1, 1);
+    _arrayPlaceholder->setLayer(0, 0, placeholder);
+    _state.forgetTextures();
+}
+
+AssetLoader::~AssetLoader() {
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cancelled = true;
+        while(_jobsInFlight > 0)
+            _jobFinished.wait(lock);
+    }
+
+    delete _streaming;
+    for(size_t i = 0; i < _loaded.size(); ++i)
+        delete _loaded[i];
+    for(size_t i = 0; i < _textures.size(); ++i)
+        delete _textures[i];
+    delete _placeholder;
+    delete _arrayPlaceholder;
+}
+
+TextureAsset* AssetLoader::texture(const std::string& filePath) {
+    return _queue(filePath, std::vector<std::string>(1, filePath), GL_TEXTURE_2D);
+}
+
+TextureAsset* AssetLoader::textureArray(const std::vector<std::string>& filePaths) {
+    if(filePaths.empty())
+        throw std::runtime_error("No images were provided for the texture array");
+
+    // a leading newline can't collide with a single texture's path
+    std::string key;
+    for(size_t i = 0; i < filePaths.size(); ++i)
+        key += "\n" + filePaths[i];
+    return _queue(key, filePaths, GL_TEXTURE_2D_ARRAY);
+}
+
+size_t AssetLoader::processUploads(size_t byteBudget) {
+    ++_frame;
+    _updateResidency();
+
+    size_t sent = 0;
+    while(sent == 0 || sent < byteBudget){
+        if(!_streaming){
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if(_loaded.empty())
+                    break;
+                _streaming = _loaded.front();
+                _loaded.pop_front();
+            }
+            _startUpload(_streaming);
+            if(_streaming->uploads.empty()){
+                _finishUpload(_streaming);
+                _streaming = NULL;
+                continue;
+            }
+        }
+
+        // the layers of an array go down the chain together, one level each in turn,
+        // so the base level can follow as soon as every layer has the next level
+        LoadedTexture* loaded = _streaming;
+        TextureStreamer::Upload* upload = NULL;
+        for(size_t i = 0; i < loaded->uploads.size(); ++i){
+            if(loaded->uploads[i]->residentLevel() == loaded->residentLevel){
+                upload = loaded->uploads[i].get();
+                break;
+            }
+        }
+        if(!upload){
+            --loaded->residentLevel;
+            SetBaseLevel(loaded->asset->_target, loaded->object, loaded->residentLevel, _state);
+
+            // shown once it has more detail than what is drawn now, an evicted or new texture right away
+            TextureAsset* asset = loaded->asset;
+            if(!loaded->shown && std::max(loaded->topLevelSize >> loaded->residentLevel, 1u) >= asset->_topLevelSize)
+                _showTexture(loaded);
+            if(loaded->residentLevel == 0){
+                _finishUpload(loaded);
+                _streaming = NULL;
+            }
+            continue;
+        }
+
+        upload->setFinestLevel(loaded->residentLevel - 1);
+        size_t bytes = _streamer.stream(*upload, sent < byteBudget ? byteBudget - sent : 0, _state);
+        sent += bytes;
+        if(bytes == 0)
+            break; // ring full of tiles GL hasn't copied yet, carry on next frame
+    }
+    return sent;
+}
+
+void AssetLoader::setMemoryBudget(size_t bytes) {
+    _memoryBudget = bytes;
+}
+
+void AssetLoader::markUsed(TextureAsset* asset, unsigned wantedSize, size_t image) {
+    if(image >= asset->_wantedSizes.size())
+        throw std::runtime_error("Texture image index out of range");
+
+    if(asset->_frameUsed != _frame){
+        asset->_frameUsed = _frame;
+        std::fill(asset->_wantedSizes.begin(), asset->_wantedSizes.end(), 0u);
+    }
+    asset->_wantedSizes[image] = std::max(asset->_wantedSizes[image], wantedSize);
+
+    if(asset->_state == TextureAsset::State_Evicted && !asset->_queued){
+        asset->_state = TextureAsset::State_Loading;
+        _submit(asset, true, 0);
+    }
+}
+
+bool AssetLoader::idle() const {
+    return _loading == 0;
+}
+
+const std::vector<TextureAsset*>& AssetLoader::textures() const {
+    return _textures;
+}
+
+const AssetLoader::Stats& AssetLoader::stats() const {
+    return _stats;
+}
+
+const TextureStreamer::Stats& AssetLoader::streamingStats() const {
+    return _streamer.stats();
+}
+
+TextureAsset* AssetLoader::_queue(const std::string& key, const std::vector<std::string>& filePaths, GLenum target) {
+    std::unordered_map<std::string, TextureAsset*>::const_iterator it = _texturesByPath.find(key);
+    if(it != _texturesByPath.end())
+        return it->second;
+
+    GLuint placeholder = target == GL_TEXTURE_2D_ARRAY ? _arrayPlaceholder->object() : _placeholder->object();
+    TextureAsset* asset = new TextureAsset(filePaths, target, placeholder);
+    _textures.push_back(asset);
+    _texturesByPath[key] = asset;
+    ++_stats.requested;
+    _submit(asset, false, 0);
+    return asset;
+}
+
+void AssetLoader::_submit(TextureAsset* asset, bool reload, unsigned droppedLevels) {
+    asset->_queued = true;
+    ++_loading;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_jobsInFlight;
+    }
+    _pool.submit([this, asset, reload, droppedLevels]() { _load(asset, reload, droppedLevels); });
+}
+
+// runs on a pool thread; only touches the asset's paths and target, and the shared queue
+void AssetLoader::_load(TextureAsset* asset, bool reload, unsigned droppedLevels) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(_cancelled){
+            _finishJob(NULL);
+            return;
+        }
+    }
+
+    LoadedTexture* loaded = new LoadedTexture();
+    loaded->asset = asset;
+    loaded->compressionPSNR = 0.0;
+    loaded->object = 0;
+    loaded->residentLevel = 0;
+    loaded->shown = false;
+    loaded->reload = reload;
+    loaded->droppedLevels = droppedLevels;
+    loaded->bytes = 0;
+    loaded->topLevelSize = 0;
+    loaded->fullSize = 0;
+    try {
+        if(asset->_target == GL_TEXTURE_2D_ARRAY)
+            _loadTextureArray(loaded);
+        else
+            _loadTexture(loaded);
+    } catch(const std::exception& e) {
+        loaded->layers.clear();
+        loaded->error = e.what();
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _finishJob(loaded);
+}
+
+// pool thread: one image, from its .btex file if fresh, otherwise decoded and baked
+void AssetLoader::_loadTexture(LoadedTexture* loaded) {
+    const std::string& sourcePath = loaded->asset->_filePaths[0];
+    const std::string bakedPath = sourcePath + ".btex";
+    loaded->layers.resize(1);
+    LoadedLayer& layer = loaded->layers[0];
+    loaded->regions.push_back(WholeLayer(0));
+
+    if(BakedTexture::isFresh(bakedPath, sourcePath)){
+        try {
+            layer.baked.reset(new BakedTexture(bakedPath));
+            if(layer.baked->isCompressed() && !_compressTextures)
+                layer.baked.reset();
+        } catch(const std::runtime_error&) {
+            // unreadable bake, decode the source and bake it again
+            layer.baked.reset();
+        }
+    }
+
+    if(layer.baked){
+        for(unsigned level = 0; level < layer.baked->levelCount(); ++level){
+            BakedTexture::Level data = layer.baked->level(level);
+            TouchPages(data.data, data.size);
+        }
+        return;
+    }
+
+    layer.mipLevels = Bitmap::mipChain(Bitmap::bitmapFromFile(sourcePath, true));
+    // a failed write only costs another decode next time
+    if(_compressTextures){
+        loaded->compressionPSNR = CompressLayers(loaded->layers);
+        BakedTexture::write(bakedPath, sourcePath, layer.compressed);
+    } else {
+        BakedTexture::write(bakedPath, sourcePath, layer.mipLevels);
+    }
+}
+
+// pool thread: decodes all images in parallel and packs them into layers.
+// An image that fails to decode is packed as the placeholder, the array only fails if they all do
+void AssetLoader::_loadTextureArray(LoadedTexture* loaded) {
+    const std::vector<std::string>& filePaths = loaded->asset->_filePaths;
+
+    std::vector<std::unique_ptr<Bitmap> > images(filePaths.size());
+    std::vector<std::string> errors(filePaths.size());
+    std::function<void(size_t)> decode = [&](size_t i) {
+        try {
+            images[i].reset(new Bitmap(Bitmap::bitmapFromFile(filePaths[i], true)));
+        } catch(const std::exception& e) {
+            images[i].reset(new Bitmap(PlaceholderBitmap()));
+            errors[i] = filePaths[i] + ": " + e.what();
+        }
+    };
+    _pool.parallelFor(filePaths.size(), decode);
+
+    size_t failedImages = 0;
+    for(size_t i = 0; i < errors.size(); ++i){
+        if(errors[i].empty())
+            continue;
+        ++failedImages;
+        if(!loaded->imageError.empty())
+            loaded->imageError += "; ";
+        loaded->imageError += errors[i];
+    }
+    if(failedImages == filePaths.size())
+        throw std::runtime_error(loaded->imageError);
+
+    std::vector<const Bitmap*> imagePointers;
+    for(size_t i = 0; i < images.size(); ++i)
+        imagePointers.push_back(images[i].get());
+    AtlasPacker packer(imagePointers);
+
+    const float layerWidth = (float)packer.layerWidth(), layerHeight = (float)packer.layerHeight();
+    for(size_t i = 0; i < packer.placements().size(); ++i){
+        const AtlasPlacement& placement = packer.placements()[i];
+        TextureAsset::Region region = {
+            placement.layer,
+            placement.x / layerWidth,
+            placement.y / layerHeight,
+            placement.width / layerWidth,
+            placement.height / layerHeight,
+            placement.gutterX / layerWidth,
+            placement.gutterY / layerHeight
+        };
+        loaded->regions.push_back(region);
+    }
+
+    std::vector<Bitmap> layers = packer.buildLayers();
+    images.clear();
+    loaded->layers.resize(layers.size());
+    for(size_t i = 0; i < layers.size(); ++i)
+        loaded->layers[i].mipLevels = Bitmap::mipChain(std::move(layers[i]));
+    if(_compressTextures)
+        loaded->compressionPSNR = CompressLayers(loaded->layers);
+}
+
+// called with _mutex held
+void AssetLoader::_finishJob(LoadedTexture* loaded) {
+    if(loaded)
+        _loaded.push_back(loaded);
+    --_jobsInFlight;
+    _jobFinished.notify_all();
+}
+
+// allocates the texture and describes its layers for the streamer; leaves `uploads` empty on failure.
+// Creating the storage binds the texture, and a failure deletes it again, behind _state's back
+void AssetLoader::_startUpload(LoadedTexture* loaded) {
+    if(!loaded->error.empty())
+        return;
+
+    try {
+        const LoadedLayer& first = loaded->layers[0];
+        std::vector<TextureStreamer::Level> firstLevels = StreamedLevels(first);
+        const unsigned fullSize = std::max(firstLevels[0].width, firstLevels[0].height);
+
+        // levels larger than the texture is drawn at wait until it comes closer,
+        // trimmed textures keep at least their smallest level
+        const unsigned wantedSize = WantedLayerSize(loaded->asset->_wantedSizes, loaded->regions);
+        unsigned dropped = std::max(loaded->droppedLevels, UnneededLevels(fullSize, wantedSize));
+        dropped = std::min(dropped, (unsigned)firstLevels.size() - 1);
+        firstLevels.erase(firstLevels.begin(), firstLevels.begin() + dropped);
+        const unsigned width = firstLevels[0].width, height = firstLevels[0].height;
+        const unsigned levelCount = (unsigned)firstLevels.size();
+        const unsigned layerCount = (unsigned)loaded->layers.size();
+        const bool isArray = loaded->asset->_target == GL_TEXTURE_2D_ARRAY;
+
+        const bool compressed = first.baked ? first.baked->isCompressed() : !first.compressed.empty();
+        BlockFormat blockFormat = BlockFormat_BC1;
+        Bitmap::Format pixelFormat = Bitmap::Format_RGBA;
+        if(compressed)
+            blockFormat = first.baked ? first.baked->blockFormat() : first.compressed[0].format;
+        else
+            pixelFormat = first.baked ? first.baked->pixelFormat() : first.mipLevels[0].format();
+
+        if(isArray && compressed)
+            loaded->array.reset(new TextureArray(blockFormat, width, height, layerCount, levelCount));
+        else if(isArray)
+            loaded->array.reset(new TextureArray(pixelFormat, width, height, layerCount, levelCount));
+        else if(compressed)
+            loaded->texture.reset(new Texture(blockFormat, width, height, levelCount));
+        else
+            loaded->texture.reset(new Texture(pixelFormat, width, height, levelCount));
+        loaded->object = loaded->texture ? loaded->texture->object() : loaded->array->object();
+
+        for(unsigned i = 0; i < layerCount; ++i){
+            std::vector<TextureStreamer::Level> levels = firstLevels;
+            if(i > 0){
+                levels = StreamedLevels(loaded->layers[i]);
+                levels.erase(levels.begin(), levels.begin() + dropped);
+            }
+            for(size_t level = 0; level < levels.size(); ++level)
+                loaded->bytes += levels[level].size;
+
+            TextureStreamer::Upload* upload;
+            if(isArray && compressed)
+                upload = new TextureStreamer::Upload(*loaded->array, i, blockFormat, levels);
+            else if(isArray)
+                upload = new TextureStreamer::Upload(*loaded->array, i, pixelFormat, levels);
+            else if(compressed)
+                upload = new TextureStreamer::Upload(*loaded->texture, blockFormat, levels);
+            else
+                upload = new TextureStreamer::Upload(*loaded->texture, pixelFormat, levels);
+            loaded->uploads.push_back(std::unique_ptr<TextureStreamer::Upload>(upload));
+        }
+        loaded->droppedLevels = dropped;
+        loaded->topLevelSize = std::max(width, height);
+        loaded->fullSize = fullSize;
+        loaded->residentLevel = levelCount;
+    } catch(const std::exception& e) {
+        loaded->uploads.clear();
+        loaded->texture.reset();
+        loaded->array.reset();
+        loaded->error = e.what();
+    }
+    _state.forgetTextures();
+}
+
+// puts the texture being streamed in place of the asset's current one, or the placeholder
+void AssetLoader::_showTexture(LoadedTexture* loaded) {
+    TextureAsset* asset = loaded->asset;
+    _release(asset);
+    asset->_texture = loaded->texture.release();
+    asset->_array = loaded->array.release();
+    asset->_regions = loaded->regions;
+    asset->_state = TextureAsset::State_Ready;
+    asset->_bytes = loaded->bytes;
+    asset->_droppedLevels = loaded->droppedLevels;
+    asset->_topLevelSize = loaded->topLevelSize;
+    asset->_fullSize = loaded->fullSize;
+    loaded->shown = true;
+
+    _stats.residentBytes += loaded->bytes;
+    _stats.peakBytes = std::max(_stats.peakBytes, _stats.residentBytes);
+}
+
+// once every level is streamed, or the load failed: marks the asset failed if needed, counts it and deletes `loaded`
+void AssetLoader::_finishUpload(LoadedTexture* loaded) {
+    TextureAsset* asset = loaded->asset;
+    if(!loaded->uploads.empty() && loaded->residentLevel == 0){
+        if(!loaded->shown)
+            _showTexture(loaded);
+        asset->_fromBakedFile = loaded->layers[0].baked.get() != NULL;
+        asset->_compressionPSNR = loaded->compressionPSNR;
+        asset->_error = loaded->imageError;
+        if(loaded->reload)
+            ++_stats.reloaded;
+        else if(asset->_fromBakedFile)
+            ++_stats.fromBakedFile;
+        else
+            ++_stats.decoded;
+        if(!loaded->reload)
+            ++_stats.uploaded;
+    } else {
+        // a failed trim keeps the texture it had
+        if(!asset->_texture && !asset->_array)
+            asset->_state = TextureAsset::State_Failed;
+        asset->_error = loaded->error;
+        if(!loaded->reload)
+            ++_stats.failed;
+    }
+    asset->_queued = false;
+    --_loading;
+    delete loaded;
+}
+
+// with a budget, evicts textures not drawn last frame, oldest first, then trims the ones in view.
+// Textures in view that left out levels they now need load them, within 3/4 of the budget.
+// Trims and growth reload the texture at the new size, which is shown once streamed
+void AssetLoader::_updateResidency() {
+    std::vector<TextureAsset*> resident;
+    bool resizing = false;
+    for(size_t i = 0; i < _textures.size(); ++i){
+        if(_textures[i]->_bytes > 0 && !_textures[i]->_queued)
+            resident.push_back(_textures[i]);
+        else if(_textures[i]->_bytes > 0)
+            resizing = true;
+    }
+    std::stable_sort(resident.begin(), resident.end(), [](const TextureAsset* a, const TextureAsset* b) {
+        return a->_frameUsed < b->_frameUsed;
+    });
+
+    size_t bytes = _stats.residentBytes;
+    for(size_t i = 0; i < resident.size() && _memoryBudget > 0 && bytes > _memoryBudget; ++i){
+        TextureAsset* asset = resident[i];
+        if(asset->_frameUsed + 1 >= _frame)
+            break;
+        bytes -= asset->_bytes;
+        _release(asset);
+        asset->_state = TextureAsset::State_Evicted;
+        ++_stats.evicted;
+    }
+
+    // trims and growth wait until the sizes from the last ones are known
+    if(resizing)
+        return;
+
+    // counts trims as done, the smaller textures take a while to load
+    const unsigned trimmedBefore = _stats.trimmed;
+    for(size_t i = 0; i < resident.size() && _memoryBudget > 0 && bytes > _memoryBudget; ++i){
+        TextureAsset* asset = resident[i];
+        if(asset->_bytes == 0 || asset->_topLevelSize < 2 * MinTrimmedSize)
+            continue;
+        // the top level is about 3/4 of a mip chain
+        bytes -= asset->_bytes / 4 * 3;
+        _submit(asset, true, asset->_droppedLevels + 1);
+        ++_stats.trimmed;
+    }
+
+    if((_memoryBudget > 0 && bytes > _memoryBudget) || _stats.trimmed != trimmedBefore)
+        return;
+
+    // textures out of view don't hold back the ones in it, they are evicted once growing needs the room
+    size_t inViewBytes = 0;
+    for(size_t i = 0; i < resident.size(); ++i){
+        if(resident[i]->_frameUsed + 1 >= _frame)
+            inViewBytes += resident[i]->_bytes;
+    }
+    for(size_t i = resident.size(); i-- > 0;){
+        TextureAsset* asset = resident[i];
+        if(asset->_frameUsed + 1 < _frame)
+            break;
+        unsigned wanted = UnneededLevels(asset->_fullSize, WantedLayerSize(asset->_wantedSizes, asset->_regions));
+        if(asset->_droppedLevels <= wanted)
+            continue;
+
+        // each level is about 3 times the size of the chain below it; only into the lower 3/4
+        // of the budget, so growing never triggers the next trim
+        size_t growth = 0;
+        while(wanted < asset->_droppedLevels){
+            growth = asset->_bytes * (((size_t)1 << (2 * (asset->_droppedLevels - wanted))) - 1);
+            if(_memoryBudget == 0 || inViewBytes + growth <= _memoryBudget / 4 * 3)
+                break;
+            ++wanted;
+        }
+        if(wanted == asset->_droppedLevels)
+            break;
+        inViewBytes += growth;
+        _submit(asset, true, wanted);
+    }
+}
+
+// frees the asset's texture, the placeholder is bound until another one arrives.
+// GL unbinds a deleted texture from every unit, so _state forgets its bindings too
+void AssetLoader::_release(TextureAsset* asset) {
+    _stats.residentBytes -= asset->_bytes;
+    if(asset->_texture || asset->_array)
+        _state.forgetTextures();
+    delete asset->_texture;
+    delete asset->_array;
+    asset->_texture = NULL;
+    asset->_array = NULL;
+    asset->_bytes = 0;
+    asset->_droppedLevels = 0;
+    asset->_topLevelSize = 0;
+}
@@ -0,0 +1,238 @@
+#include "TextureStreamer.h"
+#include "ThreadPool.h"
+#include <unordered_map>
+
+namespace helpers {
+
+    class AssetLoader;
+
+    /**
+     A texture, or a texture array packed from several images, that may
+     still be loading.
+
+     Until it is ready, `object` is the loader's placeholder texture for the
+     same target, so it can be bound and drawn from the first frame on.
+     Owned by the loader.
+     */
+    class TextureAsset {
+    public:
+        enum State {
+            State_Loading,
+            State_Ready,
+            State_Failed,   // stays on the placeholder, see error()
+            State_Evicted   // freed to stay in the memory budget, reloads on AssetLoader::markUsed
+        };
+
+        /** Where one source image is in the texture, in texture coordinates */
+        struct Region {
+            unsigned layer;
+            float offsetU;
+            float offsetV;
+            float scaleU;
+            float scaleV;
+            // width of the repeated edge around the image (AtlasPlacement's gutters), 1 where
+            // it has no neighbours; a texel footprint past it mixes in other images
+            float gutterU;
+            float gutterV;
+        };
+
+        State state() const;
+        // GL_TEXTURE_2D, or GL_TEXTURE_2D_ARRAY for AssetLoader::textureArray
+        GLenum target() const;
+        // texture to bind right now: the real one once ready, the placeholder before that
+        GLuint object() const;
+        // the image, or the first image of an array
+        const std::string& filePath() const;
+        size_t imageCount() const;
+        // where image `index` is, all of layer 0 while the placeholder is bound
+        Region region(size_t index) const;
+        // GPU memory of the texture, 0 while the placeholder is bound
+        size_t bytes() const;
+        // top mip levels left out, for the memory budget or because the texture is drawn small
+        unsigned droppedLevels() const;
+        // why loading failed, or which images of a loaded array show the placeholder; empty otherwise
+        const std::string& error() const;
+        // true if the levels came straight from a fresh .btex file
+        bool fromBakedFile() const;
+        // PSNR of level 0 if it was block-compressed while loading, 0 otherwise
+        double compressionPSNR() const;
+
+    private:
+        friend class AssetLoader;
+
+        std::vector<std::string> _filePaths;
+        GLenum _target;
+        State _state;
+        Texture* _texture;
+        TextureArray* _array;
+        GLuint _placeholder;
+        std::vector<Region> _regions;
+        std::string _error;
+        bool _fromBakedFile;
+        double _compressionPSNR;
+        // residency, only touched on the GL thread
+        size_t _bytes;
+        unsigned _droppedLevels;
+        unsigned _topLevelSize;     // larger side of the top allocated level
+        unsigned _fullSize;         // larger side of level 0 of the source
+        unsigned _frameUsed;
+        std::vector<unsigned> _wantedSizes; // per image, from markUsed in the last frame it was drawn
+        bool _queued;               // a load is in flight, the asset is left alone until it lands
+
+        TextureAsset(const std::vector<std::string>& filePaths, GLenum target, GLuint placeholder);
+        ~TextureAsset();
+        TextureAsset(const TextureAsset&);
+        const TextureAsset& operator=(const TextureAsset&);
+    };
+
+    /**
+     Loads textures in the background.
+
+     Reading, decoding, mip generation and block compression run as tasks
+     on a ThreadPool. Only the GL upload is left for the render thread,
+     which streams finished textures with `processUploads` under a byte
+     budget per frame (see TextureStreamer), so startup doesn't wait for
+     the images and even a 4K texture is spread over several frames.
+
+     Levels are streamed smallest first and the texture is shown as soon as
+     its mip tail is in, GL_TEXTURE_BASE_LEVEL follows the larger levels as
+     they arrive. Textures that `markUsed` reports as drawn small leave out
+     the levels they don't need, and load them when they come closer.
+
+     An image `foo.jpg` is loaded from `foo.jpg.btex` when that is fresh
+     (see BakedTexture), otherwise it is decoded and the result baked to
+     `foo.jpg.btex` for next time.
+
+     With a memory budget set, loaded textures are kept under it by
+     least-recently-used order: textures not drawn in the last frame are
+     evicted back to the placeholder, and if that is not enough the top
+     mip levels of the ones in view are dropped. Both reload in the
+     background, at the size they are drawn at once they fit.
+
+     Create and use the loader on the thread that owns the GL context.
+     */
+    class AssetLoader {
+    public:
+        struct Stats {
+            unsigned requested;     // distinct textures asked for
+            unsigned fromBakedFile; // uploaded from a .btex file
+            unsigned decoded;       // uploaded after decoding the image
+            unsigned failed;
+            unsigned uploaded;
+            size_t residentBytes;   // GPU memory of all loaded textures
+            size_t peakBytes;
+            unsigned evicted;       // textures freed to stay in the budget
+            unsigned trimmed;       // top levels dropped to stay in the budget
+            unsigned reloaded;      // evicted or trimmed textures loaded again
+        };
+
+        /**
+         `compressTextures` block-compresses decoded textures before upload,
+         pass it only if the driver supports S3TC. Compressed bakes are
+         ignored without it.
+
+         `state` is the render path's binding cache, the loader keeps it in
+         step with the textures it binds behind its back.
+         */
+        AssetLoader(bool compressTextures, GLState& state, ThreadPool& pool = ThreadPool::shared());
+        // skips the work that hasn't started and waits for the rest
+        ~AssetLoader();
+
+        /**
+         Queues the image for loading and returns at once.
+
+         Asking for the same path again returns the same asset.
+         */
+        TextureAsset* texture(const std::string& filePath);
+
+        /**
+         Queues the images to be packed into one GL_TEXTURE_2D_ARRAY (see
+         AtlasPacker) and returns at once.
+
+         Draws using any of the images then need no texture bind in between,
+         the shader picks the layer and rectangle from `region`. Arrays are
+         built from the source images every time, they are not baked.
+         */
+        TextureAsset* textureArray(const std::vector<std::string>& filePaths);
+
+        /**
+         Streams textures that finished loading to GL, about `byteBudget`
+         bytes per call, one texture after the other. A texture becomes
+         ready once all its levels are there. Returns the bytes sent.
+
+         Call it once per frame, it also starts a new frame for `markUsed`
+         and evicts or trims textures that are over the memory budget.
+
+         Uploads, base level changes and evictions bind or delete textures
+         behind GLState's back, even when nothing is sent. Each of them
+         has the GLState given to the constructor forget its texture
+         bindings, so the caller doesn't need to invalidate it.
+         */
+        size_t processUploads(size_t byteBudget);
+
+        /**
+         Limits the GPU memory of loaded textures to about `bytes`, 0 (the
+         default) for no limit. Textures drawn in the last frame are never
+         evicted, so a budget too small for one frame's textures is exceeded
+         rather than thrashed.
+         */
+        void setMemoryBudget(size_t bytes);
+
+        /**
+         Records that image `image` of the asset is drawn this frame, about
+         `wantedSize` texels across on screen (the default asks for all
+         levels). Top levels larger than the largest size wanted in the last
+         frame aren't loaded.
+
+         An evicted asset starts loading again and draws as the placeholder
+         until it is back.
+         */
+        void markUsed(TextureAsset* asset, unsigned wantedSize = ~0u, size_t image = 0);
+
+        // true when every requested texture is ready or failed
+        bool idle() const;
+
+        const std::vector<TextureAsset*>& textures() const;
+        const Stats& stats() const;
+        const TextureStreamer::Stats& streamingStats() const;
+
+    private:
+        struct LoadedTexture;
+
+        ThreadPool& _pool;
+        GLState& _state;
+        bool _compressTextures;
+        Texture* _placeholder;
+        TextureArray* _arrayPlaceholder;
+        TextureStreamer _streamer;
+        LoadedTexture* _streaming;      // texture being streamed, NULL between textures
+        std::vector<TextureAsset*> _textures;
+        std::unordered_map<std::string, TextureAsset*> _texturesByPath;
+        unsigned _loading;
+        Stats _stats;
+        size_t _memoryBudget;
+        unsigned _frame;
+
+        // shared with the pool's threads
+        std::mutex _mutex;
+        std::condition_variable _jobFinished;
+        std::deque<LoadedTexture*> _loaded;
+        unsigned _jobsInFlight;
+        bool _cancelled;
+
+        TextureAsset* _queue(const std::string& key, const std::vector<std::string>& filePaths, GLenum target);
+        void _submit(TextureAsset* asset, bool reload, unsigned droppedLevels);
+        void _load(TextureAsset* asset, bool reload, unsigned droppedLevels);
+        void _loadTexture(LoadedTexture* loaded);
+        void _loadTextureArray(LoadedTexture* loaded);
+        void _finishJob(LoadedTexture* loaded);
+        void _startUpload(LoadedTexture* loaded);
+        void _finishUpload(LoadedTexture* loaded);
+        void _showTexture(LoadedTexture* loaded);
+        void _updateResidency();
+        void _release(TextureAsset* asset);
+        AssetLoader(const AssetLoader&);
+        const AssetLoader& operator=(const AssetLoader&);
+    };
+
+}
@@ -0,0 +1,195 @@
+#include "Bitmap.h"
+#include "AtlasPacker.h"
+#include <stdexcept>
+#include <algorithm>
+
+using namespace helpers;
+
+namespace {
+    // a row of images inside a shared layer
+    struct Shelf {
+        unsigned layer;
+        unsigned y;
+        unsigned height;
+        unsigned usedWidth;
+    };
+}
+
+static unsigned RoundUp(unsigned value, unsigned multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// padding before an image with `spare` texels around it along one axis: the full padding,
+// or when that doesn't fit the largest power of two that fits on both sides, 0 if none does.
+// Slots start on multiples of the padding, so the image starts on a multiple of the result
+static unsigned LeadingGutter(unsigned spare, unsigned padding) {
+    if(spare >= 2 * padding)
+        return padding;
+    unsigned gutter = 0;
+    while(2 * (gutter ? 2 * gutter : 1) <= spare)
+        gutter = gutter ? 2 * gutter : 1;
+    return gutter;
+}
+
+// surrounds `image`, already copied to (x, y), with copies of its outermost pixels up to
+// `padding` past its aligned end on the right and bottom, `padding` on the left and top
+static void PadEdges(Bitmap& layer, const Bitmap& image, unsigned x, unsigned y, unsigned padding) {
+    const unsigned width = image.width(), height = image.height();
+    const unsigned left = std::min(x, padding);
+    const unsigned top = std::min(y, padding);
+    const unsigned right = std::min(layer.width() - (x + width), RoundUp(width, padding) - width + padding);
+    const unsigned bottom = std::min(layer.height() - (y + height), RoundUp(height, padding) - height + padding);
+    const unsigned cornerColumns = std::max(left, right);
+    const unsigned cornerRows = std::max(top, bottom);
+
+    for(unsigned i = 1; i <= left; ++i)
+        layer.copyRectFromBitmap(image, 0, 0, x - i, y, 1, height);
+    for(unsigned i = 1; i <= right; ++i)
+        layer.copyRectFromBitmap(image, width - 1, 0, x + width - 1 + i, y, 1, height);
+    for(unsigned i = 1; i <= top; ++i)
+        layer.copyRectFromBitmap(image, 0, 0, x, y - i, width, 1);
+    for(unsigned i = 1; i <= bottom; ++i)
+        layer.copyRectFromBitmap(image, 0, height - 1, x, y + height - 1 + i, width, 1);
+
+    // corners take the corner pixel
+    for(unsigned row = 1; row <= cornerRows; ++row){
+        for(unsigned col = 1; col <= cornerColumns; ++col){
+            if(row <= top && col <= left)
+                layer.copyRectFromBitmap(image, 0, 0, x - col, y - row, 1, 1);
+            if(row <= top && col <= right)
+                layer.copyRectFromBitmap(image, width - 1, 0, x + width - 1 + col, y - row, 1, 1);
+            if(row <= bottom && col <= left)
+                layer.copyRectFromBitmap(image, 0, height - 1, x - col, y + height - 1 + row, 1, 1);
+            if(row <= bottom && col <= right)
+                layer.copyRectFromBitmap(image, width - 1, height - 1, x + width - 1 + col, y + height - 1 + row, 1, 1);
+        }
+    }
+}
+
+AtlasPacker::AtlasPacker(const std::vector<const Bitmap*>& images, unsigned padding) :
+    _images(images),
+    _padding(4),
+    _layerWidth(0),
+    _layerHeight(0),
+    _layerCount(0)
+{
+    if(images.empty())
+        throw std::runtime_error("No images were provided to pack");
+    while(_padding < padding)
+        _padding *= 2;
+
+    for(size_t i = 0; i < images.size(); ++i){
+        _layerWidth = std::max(_layerWidth, images[i]->width());
+        _layerHeight = std::max(_layerHeight, images[i]->height());
+    }
+    _pack();
+}
+
+unsigned AtlasPacker::layerWidth() const {
+    return _layerWidth;
+}
+
+unsigned AtlasPacker::layerHeight() const {
+    return _layerHeight;
+}
+
+unsigned AtlasPacker::layerCount() const {
+    return _layerCount;
+}
+
+const std::vector<AtlasPlacement>& AtlasPacker::placements() const {
+    return _placements;
+}
+
+std::vector<Bitmap> AtlasPacker::buildLayers() const {
+    Bitmap::Format format = Bitmap::Format_RGB;
+    for(size_t i = 0; i < _images.size(); ++i){
+        Bitmap::Format imageFormat = _images[i]->format();
+        if(imageFormat == Bitmap::Format_RGBA || imageFormat == Bitmap::Format_GrayscaleAlpha)
+            format = Bitmap::Format_RGBA;
+    }
+
+    std::vector<Bitmap> layers;
+    layers.reserve(_layerCount);
+    for(unsigned i = 0; i < _layerCount; ++i)
+        layers.push_back(Bitmap(_layerWidth, _layerHeight, format));
+
+    for(size_t i = 0; i < _images.size(); ++i){
+        const AtlasPlacement& placement = _placements[i];
+        Bitmap& layer = layers[placement.layer];
+        layer.copyRectFromBitmap(*_images[i], 0, 0, placement.x, placement.y, placement.width, placement.height);
+        if(placement.width != _layerWidth || placement.height != _layerHeight)
+            PadEdges(layer, *_images[i], placement.x, placement.y, _padding);
+    }
+    return layers;
+}
+
+void AtlasPacker::_pack() {
+    _placements.resize(_images.size());
+
+    // full-size images first, one layer each
+    std::vector<size_t> shared;
+    for(size_t i = 0; i < _images.size(); ++i){
+        AtlasPlacement& placement = _placements[i];
+        placement.width = _images[i]->width();
+        placement.height = _images[i]->height();
+        if(placement.width == _layerWidth && placement.height == _layerHeight){
+            placement.layer = _layerCount++;
+            placement.x = 0;
+            placement.y = 0;
+            placement.gutterX = _layerWidth;
+            placement.gutterY = _layerHeight;
+        } else {
+            shared.push_back(i);
+        }
+    }
+
+    // tallest first keeps the shelves tight
+    struct TallerFirst {
+        const std::vector<AtlasPlacement>* placements;
+        bool operator()(size_t a, size_t b) const { return (*placements)[a].height > (*placements)[b].height; }
+    };
+    TallerFirst tallerFirst = { &_placements };
+    std::stable_sort(shared.begin(), shared.end(), tallerFirst);
+
+    std::vector<Shelf> shelves;
+    for(size_t s = 0; s < shared.size(); ++s){
+        AtlasPlacement& placement = _placements[shared[s]];
+        // padding on both sides of the image rounded up to whole paddings, as far as the layer allows;
+        // shelves and their slots then start on multiples of the padding
+        const unsigned paddedWidth = std::min(_layerWidth, RoundUp(placement.width, _padding) + 2 * _padding);
+        const unsigned paddedHeight = std::min(_layerHeight, RoundUp(placement.height, _padding) + 2 * _padding);
+
+        Shelf* shelf = NULL;
+        for(size_t i = 0; i < shelves.size() && !shelf; ++i){
+            if(shelves[i].height >= paddedHeight && shelves[i].usedWidth + paddedWidth <= _layerWidth)
+                shelf = &shelves[i];
+        }
+        if(!shelf){
+            // open a shelf under the last one of the newest shared layer, or start a layer
+            Shelf next;
+            next.height = paddedHeight;
+            next.usedWidth = 0;
+            if(!shelves.empty() && shelves.back().y + shelves.back().height + paddedHeight <= _layerHeight){
+                next.layer = shelves.back().layer;
+                next.y = shelves.back().y + shelves.back().height;
+            } else {
+                next.layer = _layerCount++;
+                next.y = 0;
+            }
+            shelves.push_back(next);
+            shelf = &shelves.back();
+        }
+
+        const unsigned left = LeadingGutter(paddedWidth - placement.width, _padding);
+        const unsigned top = LeadingGutter(paddedHeight - placement.height, _padding);
+
+        placement.layer = shelf->layer;
+        placement.x = shelf->usedWidth + left;
+        placement.y = shelf->y + top;
+        shelf->usedWidth += paddedWidth;
+        // without any gutter at least level 0 is sampled
+        placement.gutterX = placement.width == _layerWidth ? _layerWidth : std::max(left, 1u);
+        placement.gutterY = placement.height == _layerHeight ? _layerHeight : std::max(top, 1u);
+    }
+}
@@ -0,0 +1,63 @@
+#include <vector>
+
+namespace helpers {
+
+    class Bitmap;
+
+    /** Where one image ended up in the layers of a texture array. */
+    struct AtlasPlacement {
+        unsigned layer;
+        unsigned x;         // first column in the layer
+        unsigned y;         // first row in the layer
+        unsigned width;
+        unsigned height;
+        // texels of repeated edge on each side, a power of two; the layer size
+        // along an axis the image spans, where it has no neighbours
+        unsigned gutterX;
+        unsigned gutterY;
+    };
+
+    /**
+     Packs images of any size into as few layers as possible.
+
+     The layer size is the largest width and height among the images.
+     Images of exactly that size get a layer of their own and keep working
+     with GL_REPEAT. Smaller ones share layers, placed on shelves tallest
+     first, with at least `padding` pixels of repeated edge around each.
+     `padding` is rounded up to a power of two of at least 4, and images
+     start on multiples of it. Mip level log2(padding) is then the last
+     whose texels don't mix an image with its neighbours or the black
+     unused space, which also keeps 4x4 compression blocks apart. Sampling
+     must not go past that level, see the gutters in AtlasPlacement.
+     Shared layers only support texture coordinates in [0, 1].
+     */
+    class AtlasPacker {
+    public:
+        explicit AtlasPacker(const std::vector<const Bitmap*>& images, unsigned padding = 8);
+
+        unsigned layerWidth() const;
+        unsigned layerHeight() const;
+        unsigned layerCount() const;
+        // placement of each image, in the order they were given
+        const std::vector<AtlasPlacement>& placements() const;
+
+        /**
+         Copies the images into their layers with Bitmap::copyRectFromBitmap.
+
+         Layers are RGBA if any image has alpha, RGB otherwise. Unused space
+         is black.
+         */
+        std::vector<Bitmap> buildLayers() const;
+
+    private:
+        std::vector<const Bitmap*> _images;
+        unsigned _padding;
+        unsigned _layerWidth;
+        unsigned _layerHeight;
+        unsigned _layerCount;
+        std::vector<AtlasPlacement> _placements;
+
+        void _pack();
+    };
+
+}
@@ -0,0 +1,224 @@
+#include "BakedTexture.h"
+#include <stdexcept>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+
+using namespace helpers;
+
+namespace {
+    const char BakedMagic[4] = { 'B', 'T', 'E', 'X' };
+    const uint32_t BakedVersion = 1;
+    // level payloads start on this boundary
+    const uint64_t LevelAlignment = 16;
+
+    // start of a .btex file, followed by `levelCount` LevelEntry and then the level payloads
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t blockFormat;   // 0 for raw pixels, otherwise a BlockFormat
+        uint32_t pixelFormat;   // Bitmap::Format of raw pixels
+        uint32_t levelCount;
+        uint32_t reserved;
+        uint64_t sourceSize;
+        int64_t sourceModified;
+    };
+
+    struct LevelEntry {
+        uint32_t width;
+        uint32_t height;
+        uint64_t offset;        // from the start of the file
+        uint64_t size;
+    };
+}
+
+// size and modification time of a file, false if it doesn't exist
+static bool SourceStamp(const std::string& path, uint64_t& size, int64_t& modified) {
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0)
+        return false;
+    size = (uint64_t)info.st_size;
+    modified = (int64_t)info.st_mtime;
+    return true;
+}
+
+// bytes a level of these dimensions takes, in whole 4x4 blocks when compressed
+static uint64_t ExpectedLevelSize(uint32_t blockFormat, uint32_t pixelFormat, uint32_t width, uint32_t height) {
+    if(blockFormat != 0)
+        return (uint64_t)((width + 3) / 4) * ((height + 3) / 4) * blockFormat;
+    return (uint64_t)width * height * pixelFormat;
+}
+
+// writes a temporary file next to `filePath` and renames it over, so a bake that
+// dies half way never leaves a truncated file behind for the next run to map
+static bool WriteBakedFile(const std::string& filePath,
+                           const std::string& sourcePath,
+                           uint32_t blockFormat,
+                           uint32_t pixelFormat,
+                           const std::vector<LevelEntry>& levels,
+                           const std::vector<const unsigned char*>& payloads)
+{
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BakedMagic, sizeof(BakedMagic));
+    header.version = BakedVersion;
+    header.blockFormat = blockFormat;
+    header.pixelFormat = pixelFormat;
+    header.levelCount = (uint32_t)levels.size();
+    if(!SourceStamp(sourcePath, header.sourceSize, header.sourceModified))
+        throw std::runtime_error("Failed to stat texture source: " + sourcePath);
+
+    std::vector<LevelEntry> entries(levels);
+    uint64_t offset = sizeof(FileHeader) + entries.size() * sizeof(LevelEntry);
+    for(size_t i = 0; i < entries.size(); ++i){
+        offset = (offset + LevelAlignment - 1) / LevelAlignment * LevelAlignment;
+        entries[i].offset = offset;
+        offset += entries[i].size;
+    }
+
+    const std::string tempPath = filePath + ".tmp";
+    std::ofstream f(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!f.is_open())
+        return false;
+    f.write((const char*)&header, sizeof(header));
+    f.write((const char*)&entries[0], entries.size() * sizeof(LevelEntry));
+    uint64_t written = sizeof(FileHeader) + entries.size() * sizeof(LevelEntry);
+    static const char padding[LevelAlignment] = { 0 };
+    for(size_t i = 0; i < entries.size(); ++i){
+        f.write(padding, (std::streamsize)(entries[i].offset - written));
+        f.write((const char*)payloads[i], (std::streamsize)entries[i].size);
+        written = entries[i].offset + entries[i].size;
+    }
+    f.close();
+    if(!f.good()){
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    // rename doesn't replace an existing file on every platform
+    if(std::rename(tempPath.c_str(), filePath.c_str()) != 0){
+        std::remove(filePath.c_str());
+        if(std::rename(tempPath.c_str(), filePath.c_str()) != 0){
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+BakedTexture::BakedTexture(const std::string& filePath) :
+    _file(filePath),
+    _blockFormat(0),
+    _pixelFormat(0)
+{
+    const unsigned char* data = _file.data();
+    const size_t size = _file.size();
+
+    FileHeader header;
+    if(size < sizeof(header))
+        throw std::runtime_error("Baked texture is truncated: " + filePath);
+    std::memcpy(&header, data, sizeof(header));
+    if(std::memcmp(header.magic, BakedMagic, sizeof(BakedMagic)) != 0 || header.version != BakedVersion)
+        throw std::runtime_error("Not a baked texture of this version: " + filePath);
+    if(header.levelCount == 0 || size < sizeof(header) + (uint64_t)header.levelCount * sizeof(LevelEntry))
+        throw std::runtime_error("Baked texture is truncated: " + filePath);
+    if(header.blockFormat != 0 && header.blockFormat != BlockFormat_BC1 && header.blockFormat != BlockFormat_BC3)
+        throw std::runtime_error("Unrecognised block format in baked texture: " + filePath);
+    if(header.blockFormat == 0 && (header.pixelFormat < Bitmap::Format_Grayscale || header.pixelFormat > Bitmap::Format_RGBA))
+        throw std::runtime_error("Unrecognised pixel format in baked texture: " + filePath);
+
+    _blockFormat = header.blockFormat;
+    _pixelFormat = header.pixelFormat;
+    _levels.resize(header.levelCount);
+    for(uint32_t i = 0; i < header.levelCount; ++i){
+        LevelEntry entry;
+        std::memcpy(&entry, data + sizeof(header) + i * sizeof(LevelEntry), sizeof(entry));
+        if(entry.offset > size || entry.size > size - entry.offset)
+            throw std::runtime_error("Baked texture is truncated: " + filePath);
+        // the level is handed to GL as is, which reads as many bytes as its dimensions need
+        if(entry.width == 0 || entry.height == 0 ||
+           entry.size != ExpectedLevelSize(header.blockFormat, header.pixelFormat, entry.width, entry.height))
+            throw std::runtime_error("Baked texture level size doesn't match its dimensions: " + filePath);
+        _levels[i].width = entry.width;
+        _levels[i].height = entry.height;
+        _levels[i].data = data + entry.offset;
+        _levels[i].size = (size_t)entry.size;
+    }
+}
+
+bool BakedTexture::isFresh(const std::string& bakedPath, const std::string& sourcePath) {
+    std::ifstream f(bakedPath.c_str(), std::ios::in | std::ios::binary);
+    if(!f.is_open())
+        return false;
+
+    FileHeader header;
+    if(!f.read((char*)&header, sizeof(header)))
+        return false;
+    if(std::memcmp(header.magic, BakedMagic, sizeof(BakedMagic)) != 0 || header.version != BakedVersion)
+        return false;
+
+    uint64_t sourceSize = 0;
+    int64_t sourceModified = 0;
+    if(!SourceStamp(sourcePath, sourceSize, sourceModified))
+        return true; // baked file shipped without its source
+    return header.sourceSize == sourceSize && header.sourceModified == sourceModified;
+}
+
+bool BakedTexture::write(const std::string& filePath, const std::string& sourcePath, const std::vector<Bitmap>& mipLevels) {
+    if(mipLevels.empty())
+        throw std::runtime_error("No mip levels were provided to bake");
+
+    std::vector<LevelEntry> levels(mipLevels.size());
+    std::vector<const unsigned char*> payloads(mipLevels.size());
+    for(size_t i = 0; i < mipLevels.size(); ++i){
+        const Bitmap& bitmap = mipLevels[i];
+        if(bitmap.format() != mipLevels[0].format())
+            throw std::runtime_error("Mip levels to bake must all have the same format");
+        levels[i].width = bitmap.width();
+        levels[i].height = bitmap.height();
+        levels[i].size = (uint64_t)bitmap.width() * bitmap.height() * bitmap.format();
+        payloads[i] = bitmap.pixelBuffer();
+    }
+    return WriteBakedFile(filePath, sourcePath, 0, mipLevels[0].format(), levels, payloads);
+}
+
+bool BakedTexture::write(const std::string& filePath, const std::string& sourcePath, const std::vector<CompressedImage>& mipLevels) {
+    if(mipLevels.empty())
+        throw std::runtime_error("No mip levels were provided to bake");
+
+    std::vector<LevelEntry> levels(mipLevels.size());
+    std::vector<const unsigned char*> payloads(mipLevels.size());
+    for(size_t i = 0; i < mipLevels.size(); ++i){
+        const CompressedImage& image = mipLevels[i];
+        if(image.format != mipLevels[0].format)
+            throw std::runtime_error("Mip levels to bake must all have the same format");
+        levels[i].width = image.width;
+        levels[i].height = image.height;
+        levels[i].size = image.data.size();
+        payloads[i] = &image.data[0];
+    }
+    return WriteBakedFile(filePath, sourcePath, mipLevels[0].format, Bitmap::Format_RGBA, levels, payloads);
+}
+
+bool BakedTexture::isCompressed() const {
+    return _blockFormat != 0;
+}
+
+BlockFormat BakedTexture::blockFormat() const {
+    return (BlockFormat)_blockFormat;
+}
+
+Bitmap::Format BakedTexture::pixelFormat() const {
+    return (Bitmap::Format)_pixelFormat;
+}
+
+unsigned BakedTexture::levelCount() const {
+    return (unsigned)_levels.size();
+}
+
+BakedTexture::Level BakedTexture::level(unsigned index) const {
+    if(index >= _levels.size())
+        throw std::runtime_error("Baked texture level out of range");
+    return _levels[index];
+}
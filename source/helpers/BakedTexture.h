@@ -0,0 +1,71 @@
+#include "BlockCompression.h"
+#include "MappedFile.h"
+#include <stdint.h>
+
+namespace helpers {
+
+    /**
+     A texture baked ahead of time into a `.btex` file: all mip levels,
+     either raw pixels or BC1/BC3 blocks, laid out ready for upload.
+
+     The file is memory mapped and `level` points straight into the mapping,
+     so the pixels go from the page cache to glTexImage2D or
+     glCompressedTexImage2D without being decoded or copied. Rows are stored
+     bottom-up like Bitmap::bitmapFromFile(path, true) produces them.
+
+     The header remembers the size and modification time of the image the
+     file was baked from, see `isFresh`.
+     */
+    class BakedTexture {
+    public:
+        struct Level {
+            unsigned width;
+            unsigned height;
+            const unsigned char* data;
+            size_t size;
+        };
+
+        /**
+         Maps a baked file. Throws if it is missing, truncated or from another
+         version, or if a level's size doesn't match its dimensions and format.
+         */
+        explicit BakedTexture(const std::string& filePath);
+
+        /**
+         True if `bakedPath` exists, is of this version and was baked from
+         `sourcePath` as it is now. Only the header is read.
+         */
+        static bool isFresh(const std::string& bakedPath, const std::string& sourcePath);
+
+        /**
+         Writes a baked file from uncompressed mip levels, level 0 first.
+
+         `sourcePath` is the image the levels came from, it is stamped into the
+         header for `isFresh`. The file is written under a temporary name and
+         renamed into place, so it is either complete or not there. Returns
+         false if it could not be written.
+         */
+        static bool write(const std::string& filePath, const std::string& sourcePath, const std::vector<Bitmap>& mipLevels);
+
+        /** Writes a baked file from block-compressed mip levels, level 0 first */
+        static bool write(const std::string& filePath, const std::string& sourcePath, const std::vector<CompressedImage>& mipLevels);
+
+        bool isCompressed() const;
+        // only meaningful if isCompressed()
+        BlockFormat blockFormat() const;
+        // only meaningful if !isCompressed()
+        Bitmap::Format pixelFormat() const;
+        unsigned levelCount() const;
+        Level level(unsigned index) const;
+
+    private:
+        MappedFile _file;
+        uint32_t _blockFormat;
+        uint32_t _pixelFormat;
+        std::vector<Level> _levels;
+
+        BakedTexture(const BakedTexture&);
+        const BakedTexture& operator=(const BakedTexture&);
+    };
+
+}
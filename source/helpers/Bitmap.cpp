@@ -1,152 +1,335 @@
 #include "Bitmap.h"
+#include "PixelConversion.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <vector>
 
 #define STBI_FAILURE_USERMSG
+// decoded buffers are adopted by Bitmap, which releases them with free()
+#define STBI_MALLOC(size) malloc(size)
+#define STBI_REALLOC(p, newSize) realloc(p, newSize)
+#define STBI_FREE(p) free(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#if HELPERS_X86_SIMD
+#include <immintrin.h>
+#endif
+
 using namespace helpers;
 
 
-inline unsigned char AverageRGB(unsigned char rgb[3]) {
-    return (unsigned char)(((double)rgb[0] + (double)rgb[1] + (double)rgb[2]) / 3.0);
-}
+// sRGB <-> linear lookup tables for the mip filter
+namespace {
+    struct SrgbTables {
+        float toLinear[256];
+        unsigned char fromLinear[4096]; // indexed by linear * 4095
 
-static void Grayscale2GrayscaleAlpha(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = 255;
+        SrgbTables() {
+            for(int i = 0; i < 256; ++i){
+                float c = i / 255.0f;
+                toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+            }
+            for(int i = 0; i < 4096; ++i){
+                float l = i / 4095.0f;
+                float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+                fromLinear[i] = (unsigned char)(c * 255.0f + 0.5f);
+            }
+        }
+    };
 }
 
-static void Grayscale2RGB(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[0];
-    dest[2] = src[0];
+static const SrgbTables& GetSrgbTables() {
+    static const SrgbTables tables;
+    return tables;
 }
 
-static void Grayscale2RGBA(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[0];
-    dest[2] = src[0];
-    dest[3] = 255;
-}
+// output rows per mip filter task
+static const unsigned MipRowsPerTask = 16;
+
 
-static void GrayscaleAlpha2Grayscale(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
+inline unsigned GetPixelOffset(unsigned col, unsigned row, unsigned width, unsigned height, Bitmap::Format format) {
+    return (row*width + col)*format;
 }
 
-static void GrayscaleAlpha2RGB(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[0];
-    dest[2] = src[0];
+inline bool RectsOverlap(unsigned srcCol, unsigned srcRow, unsigned destCol, unsigned destRow, unsigned width, unsigned height){
+    // same-size rects overlap only if they overlap on both axes
+    unsigned colDiff = srcCol > destCol ? srcCol - destCol : destCol - srcCol;
+    unsigned rowDiff = srcRow > destRow ? srcRow - destRow : destRow - srcRow;
+    return colDiff < width && rowDiff < height;
 }
 
-static void GrayscaleAlpha2RGBA(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[0];
-    dest[2] = src[0];
-    dest[3] = src[1];
+namespace {
+    // dest(col, row) = src[base + col*stepCol + row*stepRow], all in pixels;
+    // covers transposes, 90 degree rotations and 180 degree rotation
+    struct PixelRemap {
+        ptrdiff_t base;
+        ptrdiff_t stepCol;
+        ptrdiff_t stepRow;
+    };
 }
 
-static void RGB2Grayscale(unsigned char* src, unsigned char* dest){
-    dest[0] = AverageRGB(src);
+// a tile of each image stays in L1 while it is copied
+static const unsigned RemapTileSize = 32;
+// below this many pixels waking the workers costs more than it saves, for any image pass
+static const size_t ParallelImagePixels = 256 * 256;
+
+template<unsigned PixelSize>
+static void RemapTile(const unsigned char* src, unsigned char* dest, unsigned destWidth, const PixelRemap& map,
+                      unsigned col0, unsigned row0, unsigned cols, unsigned rows)
+{
+    for(unsigned row = row0; row < row0 + rows; ++row){
+        unsigned char* out = dest + ((size_t)row * destWidth + col0) * PixelSize;
+        ptrdiff_t in = map.base + (ptrdiff_t)col0 * map.stepCol + (ptrdiff_t)row * map.stepRow;
+        for(unsigned col = 0; col < cols; ++col, out += PixelSize, in += map.stepCol)
+            memcpy(out, src + in * PixelSize, PixelSize);
+    }
 }
 
-static void RGB2GrayscaleAlpha(unsigned char* src, unsigned char* dest){
-    dest[0] = AverageRGB(src);
-    dest[1] = 255;
+#if HELPERS_X86_SIMD
+// 4-byte pixels when source rows run along destination columns (stepRow is +-1):
+// four 16-byte loads, an in-register 4x4 transpose, four 16-byte stores
+HELPERS_TARGET("sse2")
+static void RemapTile4x4_SSE2(const unsigned char* src, unsigned char* dest, unsigned destWidth, const PixelRemap& map,
+                              unsigned col0, unsigned row0, unsigned cols, unsigned rows)
+{
+    unsigned fullCols = cols & ~3u;
+    unsigned fullRows = rows & ~3u;
+    for(unsigned row = row0; row < row0 + fullRows; row += 4){
+        for(unsigned col = col0; col < col0 + fullCols; col += 4){
+            // v[i] = destination column col+i, rows row..row+3
+            __m128i v[4];
+            for(unsigned i = 0; i < 4; ++i){
+                ptrdiff_t first = map.base + (ptrdiff_t)(col + i) * map.stepCol + (ptrdiff_t)row * map.stepRow;
+                if(map.stepRow > 0){
+                    v[i] = _mm_loadu_si128((const __m128i*)(src + first * 4));
+                } else {
+                    __m128i reversed = _mm_loadu_si128((const __m128i*)(src + (first - 3) * 4));
+                    v[i] = _mm_shuffle_epi32(reversed, _MM_SHUFFLE(0, 1, 2, 3));
+                }
+            }
+
+            __m128i t0 = _mm_unpacklo_epi32(v[0], v[1]);
+            __m128i t1 = _mm_unpacklo_epi32(v[2], v[3]);
+            __m128i t2 = _mm_unpackhi_epi32(v[0], v[1]);
+            __m128i t3 = _mm_unpackhi_epi32(v[2], v[3]);
+
+            unsigned char* out = dest + ((size_t)row * destWidth + col) * 4;
+            size_t rowBytes = (size_t)destWidth * 4;
+            _mm_storeu_si128((__m128i*)(out), _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128((__m128i*)(out + rowBytes), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128((__m128i*)(out + rowBytes * 2), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128((__m128i*)(out + rowBytes * 3), _mm_unpackhi_epi64(t2, t3));
+        }
+    }
+
+    if(fullCols < cols)
+        RemapTile<4>(src, dest, destWidth, map, col0 + fullCols, row0, cols - fullCols, rows);
+    if(fullRows < rows)
+        RemapTile<4>(src, dest, destWidth, map, col0, row0 + fullRows, fullCols, rows - fullRows);
 }
+#endif
+
+// returns a new malloc'd destWidth x destHeight image, tiles are spread over the shared thread pool
+static unsigned char* RemapPixels(const unsigned char* src, unsigned destWidth, unsigned destHeight, unsigned pixelSize, const PixelRemap& map) {
+    unsigned char* dest = (unsigned char*)malloc((size_t)destWidth * destHeight * pixelSize);
+    if(!dest) throw std::runtime_error("Out of memory transforming bitmap");
+
+    bool transpose4x4 = false;
+#if HELPERS_X86_SIMD
+    transpose4x4 = pixelSize == 4 && (map.stepRow == 1 || map.stepRow == -1) && CpuFeatures::current().sse2;
+#endif
+
+    const unsigned tileCols = (destWidth + RemapTileSize - 1) / RemapTileSize;
+    const unsigned tileRows = (destHeight + RemapTileSize - 1) / RemapTileSize;
+
+    // one task per row of tiles
+    std::function<void(size_t)> remapTileRow = [&](size_t tileRow) {
+        unsigned row0 = (unsigned)tileRow * RemapTileSize;
+        unsigned rows = destHeight - row0 < RemapTileSize ? destHeight - row0 : RemapTileSize;
+        for(unsigned tileCol = 0; tileCol < tileCols; ++tileCol){
+            unsigned col0 = tileCol * RemapTileSize;
+            unsigned cols = destWidth - col0 < RemapTileSize ? destWidth - col0 : RemapTileSize;
+            switch(pixelSize){
+                case 1: RemapTile<1>(src, dest, destWidth, map, col0, row0, cols, rows); break;
+                case 2: RemapTile<2>(src, dest, destWidth, map, col0, row0, cols, rows); break;
+                case 3: RemapTile<3>(src, dest, destWidth, map, col0, row0, cols, rows); break;
+                case 4:
+#if HELPERS_X86_SIMD
+                    if(transpose4x4){
+                        RemapTile4x4_SSE2(src, dest, destWidth, map, col0, row0, cols, rows);
+                        break;
+                    }
+#endif
+                    RemapTile<4>(src, dest, destWidth, map, col0, row0, cols, rows);
+                    break;
+            }
+        }
+    };
 
-static void RGB2RGBA(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[1];
-    dest[2] = src[2];
-    dest[3] = 255;
+    if((size_t)destWidth * destHeight < ParallelImagePixels){
+        for(unsigned tileRow = 0; tileRow < tileRows; ++tileRow)
+            remapTileRow(tileRow);
+    } else {
+        ThreadPool::shared().parallelFor(tileRows, remapTileRow);
+    }
+    return dest;
 }
 
-static void RGBA2Grayscale(unsigned char* src, unsigned char* dest){
-    dest[0] = AverageRGB(src);
+// whether value i of a row goes through the sRGB curve; colorChannels is 0, 3 of 3 or 3 of 4,
+// so the pattern repeats every 4 values and the SIMD kernels can use one lane mask for the whole row
+static bool IsColorValue(unsigned i, unsigned channels, unsigned colorChannels) {
+    return i % channels < colorChannels;
 }
 
-static void RGBA2GrayscaleAlpha(unsigned char* src, unsigned char* dest){
-    dest[0] = AverageRGB(src);
-    dest[1] = src[3];
+static void DecodeValues(const unsigned char* src, float* out, unsigned first, unsigned end, unsigned channels, unsigned colorChannels) {
+    const float* toLinear = GetSrgbTables().toLinear;
+    for(unsigned i = first; i < end; ++i)
+        out[i] = IsColorValue(i, channels, colorChannels) ? toLinear[src[i]] : src[i] * (1.0f / 255.0f);
 }
 
-static void RGBA2RGB(unsigned char* src, unsigned char* dest){
-    dest[0] = src[0];
-    dest[1] = src[1];
-    dest[2] = src[2];
+static void EncodeValues(const float* src, unsigned char* out, unsigned first, unsigned end, unsigned channels, unsigned colorChannels) {
+    const unsigned char* fromLinear = GetSrgbTables().fromLinear;
+    for(unsigned i = first; i < end; ++i){
+        if(IsColorValue(i, channels, colorChannels))
+            out[i] = fromLinear[(int)(src[i] * 4095.0f + 0.5f)];
+        else
+            out[i] = (unsigned char)(src[i] * 255.0f + 0.5f);
+    }
 }
 
-typedef void(*FormatConverterFunc)(unsigned char*, unsigned char*);
+#if HELPERS_X86_SIMD
+// 8 values at a time, the sRGB table read with a gather
+HELPERS_TARGET("avx2")
+static void DecodeRow_AVX2(const unsigned char* src, float* out, unsigned count, unsigned channels, unsigned colorChannels) {
+    const float* toLinear = GetSrgbTables().toLinear;
+    int colorLanes[8];
+    for(unsigned lane = 0; lane < 8; ++lane)
+        colorLanes[lane] = IsColorValue(lane, channels, colorChannels) ? -1 : 0;
+    const __m256 colorMask = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(colorLanes)));
+    const __m256 scale = _mm256_set1_ps(1.0f / 255.0f);
+
+    unsigned i = 0;
+    for(; i + 8 <= count; i += 8){
+        __m256i bytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+        __m256 linear = _mm256_mul_ps(_mm256_cvtepi32_ps(bytes), scale);
+        __m256 curve = _mm256_i32gather_ps(toLinear, bytes, 4);
+        _mm256_storeu_ps(out + i, _mm256_blendv_ps(linear, curve, colorMask));
+    }
+    DecodeValues(src, out, i, count, channels, colorChannels);
+}
 
-static FormatConverterFunc ConverterFuncForFormats(Bitmap::Format srcFormat, Bitmap::Format destFormat){
-    if(srcFormat == destFormat)
-        throw std::runtime_error("Just use memcpy if pixel formats are the same");
-    
-    switch(srcFormat){
-            
-        case Bitmap::Format_Grayscale:
-            switch(destFormat){
-                case Bitmap::Format_GrayscaleAlpha: return Grayscale2GrayscaleAlpha;
-                case Bitmap::Format_RGB:            return Grayscale2RGB;
-                case Bitmap::Format_RGBA:           return Grayscale2RGBA;
-                default:
-                    throw std::runtime_error("Unhandled bitmap format");
-            }
-            break;
-            
-        case Bitmap::Format_GrayscaleAlpha:
-            switch(destFormat){
-                case Bitmap::Format_Grayscale: return GrayscaleAlpha2Grayscale;
-                case Bitmap::Format_RGB:       return GrayscaleAlpha2RGB;
-                case Bitmap::Format_RGBA:      return GrayscaleAlpha2RGBA;
-                default:
-                    throw std::runtime_error("Unhandled bitmap format");
-            }
-            break;
-            
-        case Bitmap::Format_RGB:
-            switch(destFormat){
-                case Bitmap::Format_Grayscale:      return RGB2Grayscale;
-                case Bitmap::Format_GrayscaleAlpha: return RGB2GrayscaleAlpha;
-                case Bitmap::Format_RGBA:           return RGB2RGBA;
-                default:
-                    throw std::runtime_error("Unhandled bitmap format");
-            }
-            break;
-            
-        case Bitmap::Format_RGBA:
-            switch(destFormat){
-                case Bitmap::Format_Grayscale:      return RGBA2Grayscale;
-                case Bitmap::Format_GrayscaleAlpha: return RGBA2GrayscaleAlpha;
-                case Bitmap::Format_RGB:            return RGBA2RGB;
-                default:
-                    throw std::runtime_error("Unhandled bitmap format");
-            }
-            break;
-            
-        default:
-            throw std::runtime_error("Unhandled bitmap format");
+// 8 values at a time; the linear values are packed to bytes in registers, the sRGB ones read from the table
+HELPERS_TARGET("sse2")
+static void EncodeRow_SSE2(const float* src, unsigned char* out, unsigned count, unsigned channels, unsigned colorChannels) {
+    const unsigned char* fromLinear = GetSrgbTables().fromLinear;
+    bool colorLanes[8];
+    float scales[4];
+    for(unsigned lane = 0; lane < 8; ++lane)
+        colorLanes[lane] = IsColorValue(lane, channels, colorChannels);
+    for(unsigned lane = 0; lane < 4; ++lane)
+        scales[lane] = colorLanes[lane] ? 4095.0f : 255.0f;
+    const __m128 scale = _mm_loadu_ps(scales);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const bool anyColor = colorChannels != 0;
+
+    unsigned i = 0;
+    for(; i + 8 <= count; i += 8){
+        // truncating like the scalar casts, the values are never negative
+        __m128i index0 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), half));
+        __m128i index1 = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), half));
+        __m128i words = _mm_packs_epi32(index0, index1);
+        unsigned char bytes[16];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), _mm_packus_epi16(words, words));
+        if(!anyColor){
+            std::memcpy(out + i, bytes, 8);
+            continue;
+        }
+        short indices[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), words);
+        for(unsigned lane = 0; lane < 8; ++lane)
+            out[i + lane] = colorLanes[lane] ? fromLinear[indices[lane]] : bytes[lane];
+    }
+    EncodeValues(src, out, i, count, channels, colorChannels);
+}
+#endif
+
+// bytes to floats in [0, 1], the first colorChannels of each pixel through the sRGB curve
+static void DecodeRow(const unsigned char* src, float* out, unsigned width, unsigned channels, unsigned colorChannels) {
+#if HELPERS_X86_SIMD
+    if(CpuFeatures::current().avx2){
+        DecodeRow_AVX2(src, out, width * channels, channels, colorChannels);
+        return;
     }
+#endif
+    DecodeValues(src, out, 0, width * channels, channels, colorChannels);
 }
 
+static void EncodeRow(const float* src, unsigned char* out, unsigned width, unsigned channels, unsigned colorChannels) {
+#if HELPERS_X86_SIMD
+    if(CpuFeatures::current().sse2){
+        EncodeRow_SSE2(src, out, width * channels, channels, colorChannels);
+        return;
+    }
+#endif
+    EncodeValues(src, out, 0, width * channels, channels, colorChannels);
+}
 
-inline unsigned GetPixelOffset(unsigned col, unsigned row, unsigned width, unsigned height, Bitmap::Format format) {
-    return (row*width + col)*format;
+#if HELPERS_X86_SIMD
+// a 4-channel pixel is exactly one SSE register
+HELPERS_TARGET("sse2")
+static void FilterRow4_SSE2(const float* row0, const float* row1, float* out, unsigned srcWidth, unsigned destWidth) {
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    for(unsigned x = 0; x < destWidth; ++x){
+        unsigned x0 = 2 * x;
+        unsigned x1 = x0 + 1 < srcWidth ? x0 + 1 : x0;
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0 * 4), _mm_loadu_ps(row0 + x1 * 4)),
+                                _mm_add_ps(_mm_loadu_ps(row1 + x0 * 4), _mm_loadu_ps(row1 + x1 * 4)));
+        _mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, quarter));
+    }
 }
 
-inline bool RectsOverlap(unsigned srcCol, unsigned srcRow, unsigned destCol, unsigned destRow, unsigned width, unsigned height){
-    unsigned colDiff = srcCol > destCol ? srcCol - destCol : destCol - srcCol;
-    if(colDiff < width)
-        return true;
-    
-    unsigned rowDiff = srcRow > destRow ? srcRow - destRow : destRow - srcRow;
-    if(rowDiff < height)
-        return true;
-    
-    return false;
+// a 3-channel pixel is loaded and stored as 4 floats; the fourth lane is the next pixel's red,
+// which the next store overwrites, and the rows have one float of slack for the last pixel
+HELPERS_TARGET("sse2")
+static void FilterRow3_SSE2(const float* row0, const float* row1, float* out, unsigned srcWidth, unsigned destWidth) {
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    for(unsigned x = 0; x < destWidth; ++x){
+        unsigned x0 = 2 * x;
+        unsigned x1 = x0 + 1 < srcWidth ? x0 + 1 : x0;
+        // summed in the scalar loop's order so RGB mips don't depend on the CPU
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0 * 3), _mm_loadu_ps(row0 + x1 * 3)), _mm_loadu_ps(row1 + x0 * 3));
+        sum = _mm_add_ps(sum, _mm_loadu_ps(row1 + x1 * 3));
+        _mm_storeu_ps(out + x * 3, _mm_mul_ps(sum, quarter));
+    }
+}
+#endif
+
+// one output row of the 2x2 box filter; odd sizes round down, so an odd last column or row
+// is dropped, and only a size of 1 is averaged with itself
+static void FilterRow(const float* row0, const float* row1, float* out, unsigned srcWidth, unsigned destWidth, unsigned channels) {
+#if HELPERS_X86_SIMD
+    if(channels == 4 && CpuFeatures::current().sse2){
+        FilterRow4_SSE2(row0, row1, out, srcWidth, destWidth);
+        return;
+    }
+    if(channels == 3 && CpuFeatures::current().sse2){
+        FilterRow3_SSE2(row0, row1, out, srcWidth, destWidth);
+        return;
+    }
+#endif
+    for(unsigned x = 0; x < destWidth; ++x){
+        unsigned x0 = 2 * x;
+        unsigned x1 = x0 + 1 < srcWidth ? x0 + 1 : x0;
+        for(unsigned c = 0; c < channels; ++c)
+            out[x * channels + c] = 0.25f * (row0[x0 * channels + c] + row0[x1 * channels + c] +
+                                             row1[x0 * channels + c] + row1[x1 * channels + c]);
+    }
 }
 
 Bitmap::Bitmap(unsigned width, 
@@ -158,18 +341,37 @@ Bitmap::Bitmap(unsigned width,
     _set(width, height, format, pixels);
 }
 
+Bitmap::Bitmap() :
+    _format(Format_RGBA),
+    _width(0),
+    _height(0),
+    _pixels(NULL)
+{
+}
+
 Bitmap::~Bitmap() {
     if (_pixels) 
 		free(_pixels);
 }
 
-Bitmap Bitmap::bitmapFromFile(std::string filePath) {    
+Bitmap Bitmap::bitmapFromFile(std::string filePath, bool flipVertically) {    
     int width, height, channels;
+    // stb_image's flip setting is process-wide and files are decoded on several
+    // threads at once, so it stays off and the rows are flipped here instead
     unsigned char* pixels = stbi_load(filePath.c_str(), &width, &height, &channels, 0);
     if(!pixels) throw std::runtime_error(stbi_failure_reason());
     
-    Bitmap bmp(width, height, (Format)channels, pixels);
-    stbi_image_free(pixels);
+    Bitmap bmp = bitmapAdoptingPixels(width, height, (Format)channels, pixels);
+    if(flipVertically)
+        bmp.flipVertically();
+    return bmp;
+}
+
+Bitmap Bitmap::bitmapAdoptingPixels(unsigned width, unsigned height, Format format, unsigned char* pixels) {
+    if(!pixels) throw std::runtime_error("No pixels to adopt");
+
+    Bitmap bmp;
+    bmp._adopt(width, height, format, pixels);
     return bmp;
 }
 
@@ -180,7 +382,35 @@ Bitmap::Bitmap(const Bitmap& other) :
 }
 
 Bitmap& Bitmap::operator = (const Bitmap& other) {
-    _set(other._width, other._height, other._format, other._pixels);
+    if(this != &other)
+        _set(other._width, other._height, other._format, other._pixels);
+    return *this;
+}
+
+Bitmap::Bitmap(Bitmap&& other) noexcept :
+    _format(other._format),
+    _width(other._width),
+    _height(other._height),
+    _pixels(other._pixels)
+{
+    other._width = 0;
+    other._height = 0;
+    other._pixels = NULL;
+}
+
+Bitmap& Bitmap::operator = (Bitmap&& other) noexcept {
+    if(this != &other){
+        if(_pixels)
+            free(_pixels);
+        _format = other._format;
+        _width = other._width;
+        _height = other._height;
+        _pixels = other._pixels;
+
+        other._width = 0;
+        other._height = 0;
+        other._pixels = NULL;
+    }
     return *this;
 }
 
@@ -226,26 +456,76 @@ void Bitmap::flipVertically() {
         memcpy(oppositeRow, rowBuffer, rowSize);
     }
     
-    delete rowBuffer;
+    delete[] rowBuffer;
 }
 
 void Bitmap::rotate90CounterClockwise() {
-    unsigned char* newPixels = (unsigned char*) malloc(_format*_width*_height);
-    
-    for(unsigned row = 0; row < _height; ++row){
-        for(unsigned col = 0; col < _width; ++col){
-            unsigned srcOffset = GetPixelOffset(col, row, _width, _height, _format);
-            unsigned destOffset = GetPixelOffset(row, _width - col - 1, _height, _width, _format);
-            memcpy(newPixels + destOffset, _pixels + srcOffset, _format); //copy one pixel
+    // dest(c, r) = src(col = width-1-r, row = c)
+    _remap(_height, _width, (ptrdiff_t)_width - 1, (ptrdiff_t)_width, -1);
+}
+
+void Bitmap::rotate90Clockwise() {
+    // dest(c, r) = src(col = r, row = height-1-c)
+    _remap(_height, _width, ((ptrdiff_t)_height - 1) * _width, -(ptrdiff_t)_width, 1);
+}
+
+void Bitmap::rotate180() {
+    // dest(c, r) = src(col = width-1-c, row = height-1-r)
+    _remap(_width, _height, (ptrdiff_t)_width * _height - 1, -1, -(ptrdiff_t)_width);
+}
+
+void Bitmap::transpose() {
+    // dest(c, r) = src(col = r, row = c)
+    _remap(_height, _width, 0, (ptrdiff_t)_width, 1);
+}
+
+Bitmap Bitmap::downsampled(bool srgb) const {
+    const unsigned channels = _format;
+    // grayscale is uploaded as linear data, only RGB(A) colour is sRGB
+    const unsigned colorChannels = (srgb && channels >= 3) ? 3 : 0;
+    const unsigned destWidth = _width > 1 ? _width / 2 : 1;
+    const unsigned destHeight = _height > 1 ? _height / 2 : 1;
+
+    Bitmap dest(destWidth, destHeight, _format);
+    const unsigned tasks = (destHeight + MipRowsPerTask - 1) / MipRowsPerTask;
+
+    std::function<void(size_t)> filterRows = [&](size_t task) {
+        // one float of slack for FilterRow3_SSE2
+        std::vector<float> row0(_width * channels + 1), row1(_width * channels + 1), out(destWidth * channels + 1);
+        unsigned firstRow = (unsigned)task * MipRowsPerTask;
+        unsigned endRow = firstRow + MipRowsPerTask < destHeight ? firstRow + MipRowsPerTask : destHeight;
+        for(unsigned y = firstRow; y < endRow; ++y){
+            unsigned y0 = 2 * y;
+            unsigned y1 = y0 + 1 < _height ? y0 + 1 : y0;
+            DecodeRow(_pixels + (size_t)y0 * _width * channels, &row0[0], _width, channels, colorChannels);
+            DecodeRow(_pixels + (size_t)y1 * _width * channels, &row1[0], _width, channels, colorChannels);
+            FilterRow(&row0[0], &row1[0], &out[0], _width, destWidth, channels);
+            EncodeRow(&out[0], dest._pixels + (size_t)y * destWidth * channels, destWidth, channels, colorChannels);
         }
+    };
+
+    if((size_t)_width * _height < ParallelImagePixels){
+        for(unsigned task = 0; task < tasks; ++task)
+            filterRows(task);
+    } else {
+        ThreadPool::shared().parallelFor(tasks, filterRows);
     }
-    
-    free(_pixels);
-    _pixels = newPixels;
-    
-    unsigned swapTmp = _height;
-    _height = _width;
-    _width = swapTmp;
+    return dest;
+}
+
+std::vector<Bitmap> Bitmap::mipChain(Bitmap&& base, bool srgb) {
+    unsigned levelCount = 1;
+    for(unsigned size = base._width > base._height ? base._width : base._height; size > 1; size /= 2)
+        ++levelCount;
+
+    std::vector<Bitmap> levels;
+    levels.reserve(levelCount);
+    levels.push_back(std::move(base));
+    while(levels.back()._width > 1 || levels.back()._height > 1){
+        Bitmap next = levels.back().downsampled(srgb);
+        levels.push_back(std::move(next));
+    }
+    return levels;
 }
 
 void Bitmap::copyRectFromBitmap(const Bitmap& src, 
@@ -264,33 +544,48 @@ void Bitmap::copyRectFromBitmap(const Bitmap& src,
     if(width == 0 || height == 0)
         throw std::runtime_error("Can't copy zero height/width rectangle");
     
-    if(srcCol + width >= src.width() || srcRow + height >= src.height())
+    if(srcCol + width > src.width() || srcRow + height > src.height())
         throw std::runtime_error("Rectangle doesn't fit within source bitmap");
 
-    if(destCol + width >= _width || destRow + height >= _height)
+    if(destCol + width > _width || destRow + height > _height)
         throw std::runtime_error("Rectangle doesn't fit within destination bitmap");
     
     if(_pixels == src._pixels && RectsOverlap(srcCol, srcRow, destCol, destRow, width, height))
         throw std::runtime_error("Source and destination are the same bitmap, and rects overlap. Not allowed!");
     
-    FormatConverterFunc converter = NULL;
+    RowConverterFunc converter = NULL;
     if(_format != src._format)
-        converter = ConverterFuncForFormats(_format, src._format);
+        converter = RowConverterForChannels(src._format, _format);
     
     for(unsigned row = 0; row < height; ++row){
-        for(unsigned col = 0; col < width; ++col){
-            unsigned char* srcPixel = src._pixels + GetPixelOffset(srcCol + col, srcRow + row, src._width, src._height, src._format);
-            unsigned char* destPixel = _pixels + GetPixelOffset(destCol + col, destRow + row, _width, _height, _format);
-            
-            if(converter){
-                converter(srcPixel, destPixel);
-            } else {
-                memcpy(destPixel, srcPixel, _format);
-            }
+        const unsigned char* srcRowPixels = src._pixels + GetPixelOffset(srcCol, srcRow + row, src._width, src._height, src._format);
+        unsigned char* destRowPixels = _pixels + GetPixelOffset(destCol, destRow + row, _width, _height, _format);
+        
+        if(converter){
+            converter(srcRowPixels, destRowPixels, width);
+        } else {
+            memcpy(destRowPixels, srcRowPixels, width * _format);
         }
     }
 }
 
+void Bitmap::convertTo(Format format) {
+    if(format <= 0 || format > 4) throw std::runtime_error("Invalid bitmap format");
+    if(format == _format)
+        return;
+
+    // rows are contiguous, so the whole image converts as one span
+    size_t pixelCount = (size_t)_width * _height;
+    unsigned char* newPixels = (unsigned char*)malloc(pixelCount * format);
+    if(!newPixels) throw std::runtime_error("Out of memory converting bitmap");
+
+    RowConverterForChannels(_format, format)(_pixels, newPixels, (unsigned)pixelCount);
+
+    free(_pixels);
+    _pixels = newPixels;
+    _format = format;
+}
+
 void Bitmap::_set(unsigned width, 
                   unsigned height, 
                   Format format, 
@@ -315,13 +610,32 @@ void Bitmap::_set(unsigned width,
         memcpy(_pixels, pixels, newSize);
 }
 
+void Bitmap::_adopt(unsigned width,
+                    unsigned height,
+                    Format format,
+                    unsigned char* pixels)
+{
+    if(width == 0 || height == 0 || format <= 0 || format > 4){
+        // ownership was already handed over, don't leak on failure
+        free(pixels);
+        throw std::runtime_error("Invalid bitmap dimensions or format");
+    }
 
+    if(_pixels)
+        free(_pixels);
 
+    _width = width;
+    _height = height;
+    _format = format;
+    _pixels = pixels;
+}
 
+void Bitmap::_remap(unsigned newWidth, unsigned newHeight, ptrdiff_t base, ptrdiff_t stepCol, ptrdiff_t stepRow) {
+    PixelRemap map = { base, stepCol, stepRow };
+    unsigned char* newPixels = RemapPixels(_pixels, newWidth, newHeight, _format, map);
 
-
-
-
-
-
-
+    free(_pixels);
+    _pixels = newPixels;
+    _width = newWidth;
+    _height = newHeight;
+}
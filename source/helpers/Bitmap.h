@@ -1,4 +1,6 @@
 #include <string>
+#include <vector>
+#include <cstddef>
 
 namespace helpers {
     class Bitmap {
@@ -16,7 +18,22 @@ namespace helpers {
                const unsigned char* pixels = NULL);
         ~Bitmap();
         
-        static Bitmap bitmapFromFile(std::string filePath);
+        /**
+         Decodes an image file.
+
+         With `flipVertically` the rows are put bottom-up, which is what
+         glTexImage2D expects. The decoder's buffer becomes the bitmap's
+         pixels, nothing is copied. Safe to call from several threads at once.
+         */
+        static Bitmap bitmapFromFile(std::string filePath, bool flipVertically = false);
+
+        /**
+         Makes a bitmap that takes ownership of `pixels` instead of copying them.
+
+         `pixels` must hold width*height*format bytes and come from `malloc`,
+         the bitmap will `free` it.
+         */
+        static Bitmap bitmapAdoptingPixels(unsigned width, unsigned height, Format format, unsigned char* pixels);
                 
         unsigned width() const;
         unsigned height() const;
@@ -53,8 +70,27 @@ namespace helpers {
         
         /**
          Rotates the image 90 degrees counter clockwise.
+
+         Like the other whole-image transforms below, this copies the image
+         in cache-sized tiles, spread over ThreadPool::shared() for large
+         images.
          */
         void rotate90CounterClockwise();
+
+        /**
+         Rotates the image 90 degrees clockwise.
+         */
+        void rotate90Clockwise();
+
+        /**
+         Rotates the image 180 degrees.
+         */
+        void rotate180();
+
+        /**
+         Swaps rows and columns, so the pixel at (column, row) moves to (row, column).
+         */
+        void transpose();
         
         /**
          Copies a rectangular area from the given source bitmap into this bitmap.
@@ -77,11 +113,43 @@ namespace helpers {
                                 unsigned width,
                                 unsigned height);
         
+        /**
+         Half-size copy made with a 2x2 box filter, for the next mip level.
+
+         With `srgb` the colour channels of RGB and RGBA bitmaps are averaged
+         in linear light, which keeps dark/bright detail from going grey in
+         the smaller levels. Alpha and grayscale are averaged as they are.
+         Odd sizes round down, never below 1.
+         */
+        Bitmap downsampled(bool srgb = true) const;
+
+        /**
+         Full mip chain from `base` down to 1x1, `base` itself is level 0.
+
+         `base` is moved into the chain, not copied. Each level is filtered
+         from the previous one with `downsampled`, rows in parallel on
+         ThreadPool::shared().
+         */
+        static std::vector<Bitmap> mipChain(Bitmap&& base, bool srgb = true);
+
+        /**
+         Converts every pixel to `format`, in the same way as copyRectFromBitmap.
+
+         Uses SIMD kernels where the CPU has them, e.g. for RGB to RGBA.
+         */
+        void convertTo(Format format);
+        
         /** Copy constructor */
         Bitmap(const Bitmap& other);
         
         /** Assignment operator */
         Bitmap& operator = (const Bitmap& other);
+
+        /** Move constructor, `other` is left empty and may only be destroyed or assigned to */
+        Bitmap(Bitmap&& other) noexcept;
+
+        /** Move assignment operator, `other` is left empty */
+        Bitmap& operator = (Bitmap&& other) noexcept;
         
     private:
         Format _format;
@@ -89,7 +157,10 @@ namespace helpers {
         unsigned _height;
         unsigned char* _pixels;
         
+        Bitmap();
         void _set(unsigned width, unsigned height, Format format, const unsigned char* pixels);
+        void _adopt(unsigned width, unsigned height, Format format, unsigned char* pixels);
+        void _remap(unsigned newWidth, unsigned newHeight, ptrdiff_t base, ptrdiff_t stepCol, ptrdiff_t stepRow);
         static void _getPixelOffset(unsigned col, unsigned row, unsigned width, unsigned height, Format format);
     };
     
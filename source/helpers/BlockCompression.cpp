@@ -0,0 +1,632 @@
+#include "BlockCompression.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+
+#if HELPERS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace helpers;
+
+namespace {
+    // 4x4 pixels as RGBA, row by row
+    struct PixelBlock {
+        unsigned char rgba[16][4];
+    };
+
+    // integer statistics of a block that both endpoint searches start from
+    struct ColorSums {
+        int lo[4];          // per channel minimum, RGBA
+        int hi[4];          // per channel maximum
+        int sum[3];         // RGB
+        int products[6];    // sums of rr rg rb gg gb bb
+    };
+
+    typedef void (*ColorSumsFunc)(const PixelBlock& block, ColorSums& sums);
+    // nearest of the 4 palette colours for every pixel, returns the total squared error
+    typedef int (*ColorIndicesFunc)(const PixelBlock& block, const int palette[4][3], unsigned char indices[16]);
+    // nearest of the 8 palette alphas for every pixel
+    typedef void (*AlphaIndicesFunc)(const PixelBlock& block, const int palette[8], unsigned char indices[16]);
+
+    // the encoder's inner loops for the CPU at hand
+    struct BlockKernels {
+        ColorSumsFunc colorSums;
+        ColorIndicesFunc colorIndices;
+        AlphaIndicesFunc alphaIndices;
+    };
+}
+
+// copies a block out of the bitmap; blocks past the right/bottom edge repeat the last pixel
+static void FetchBlock(const Bitmap& bitmap, unsigned blockX, unsigned blockY, PixelBlock& block) {
+    const unsigned channels = bitmap.format();
+    const unsigned width = bitmap.width();
+    const unsigned height = bitmap.height();
+    const unsigned char* pixels = bitmap.pixelBuffer();
+
+    for(unsigned y = 0; y < 4; ++y){
+        unsigned row = blockY * 4 + y < height ? blockY * 4 + y : height - 1;
+        for(unsigned x = 0; x < 4; ++x){
+            unsigned col = blockX * 4 + x < width ? blockX * 4 + x : width - 1;
+            const unsigned char* src = pixels + ((size_t)row * width + col) * channels;
+            unsigned char* dest = block.rgba[y * 4 + x];
+            switch(channels){
+                case 1: dest[0] = dest[1] = dest[2] = src[0]; dest[3] = 255; break;
+                case 2: dest[0] = dest[1] = dest[2] = src[0]; dest[3] = src[1]; break;
+                case 3: dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; dest[3] = 255; break;
+                default: dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; dest[3] = src[3]; break;
+            }
+        }
+    }
+}
+
+static inline int ClampByte(float v) {
+    return v < 0.0f ? 0 : (v > 255.0f ? 255 : (int)(v + 0.5f));
+}
+
+static inline unsigned short PackRGB565(int r, int g, int b) {
+    return (unsigned short)((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+}
+
+static inline void UnpackRGB565(unsigned short c, int rgb[3]) {
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+// the four colours of a 4-colour BC1 block
+static void ColorPalette(unsigned short c0, unsigned short c1, int palette[4][3]) {
+    UnpackRGB565(c0, palette[0]);
+    UnpackRGB565(c1, palette[1]);
+    for(int c = 0; c < 3; ++c){
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+}
+
+static void ColorSums_Scalar(const PixelBlock& block, ColorSums& sums) {
+    for(int c = 0; c < 4; ++c){
+        sums.lo[c] = 255;
+        sums.hi[c] = 0;
+    }
+    std::memset(sums.sum, 0, sizeof(sums.sum));
+    std::memset(sums.products, 0, sizeof(sums.products));
+    for(int i = 0; i < 16; ++i){
+        const unsigned char* p = block.rgba[i];
+        for(int c = 0; c < 4; ++c){
+            if(p[c] < sums.lo[c]) sums.lo[c] = p[c];
+            if(p[c] > sums.hi[c]) sums.hi[c] = p[c];
+        }
+        for(int c = 0; c < 3; ++c)
+            sums.sum[c] += p[c];
+        sums.products[0] += p[0] * p[0]; sums.products[1] += p[0] * p[1]; sums.products[2] += p[0] * p[2];
+        sums.products[3] += p[1] * p[1]; sums.products[4] += p[1] * p[2]; sums.products[5] += p[2] * p[2];
+    }
+}
+
+static int ColorIndices_Scalar(const PixelBlock& block, const int palette[4][3], unsigned char indices[16]) {
+    int totalError = 0;
+    for(int i = 0; i < 16; ++i){
+        int bestError = 0x7FFFFFFF;
+        for(int p = 0; p < 4; ++p){
+            int dr = block.rgba[i][0] - palette[p][0];
+            int dg = block.rgba[i][1] - palette[p][1];
+            int db = block.rgba[i][2] - palette[p][2];
+            int error = dr * dr + dg * dg + db * db;
+            if(error < bestError){
+                bestError = error;
+                indices[i] = (unsigned char)p;
+            }
+        }
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+static void AlphaIndices_Scalar(const PixelBlock& block, const int palette[8], unsigned char indices[16]) {
+    for(int i = 0; i < 16; ++i){
+        int bestIndex = 0, bestError = 256;
+        for(int p = 0; p < 8; ++p){
+            int error = std::abs(block.rgba[i][3] - palette[p]);
+            if(error < bestError){
+                bestError = error;
+                bestIndex = p;
+            }
+        }
+        indices[i] = (unsigned char)bestIndex;
+    }
+}
+
+#if HELPERS_X86_SIMD
+
+// sum of the four 32-bit lanes
+HELPERS_TARGET("sse2")
+static int HorizontalSum_SSE2(__m128i v) {
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
+
+// per-channel minimum and maximum of the four pixels of `lo` and `hi`
+HELPERS_TARGET("sse2")
+static void ChannelRange_SSE2(__m128i lo, __m128i hi, ColorSums& sums) {
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 8));
+    lo = _mm_min_epu8(lo, _mm_srli_si128(lo, 4));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 8));
+    hi = _mm_max_epu8(hi, _mm_srli_si128(hi, 4));
+    unsigned loBits = (unsigned)_mm_cvtsi128_si32(lo), hiBits = (unsigned)_mm_cvtsi128_si32(hi);
+    for(int c = 0; c < 4; ++c){
+        sums.lo[c] = (loBits >> (8 * c)) & 0xFF;
+        sums.hi[c] = (hiBits >> (8 * c)) & 0xFF;
+    }
+}
+
+HELPERS_TARGET("sse2")
+static void ColorSums_SSE2(const PixelBlock& block, ColorSums& sums) {
+    const __m128i byteMask = _mm_set1_epi32(0xFF);
+    const __m128i ones = _mm_set1_epi16(1);
+
+    __m128i pixels[4];
+    for(int k = 0; k < 4; ++k)
+        pixels[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block.rgba[4 * k]));
+    __m128i lo = _mm_min_epu8(_mm_min_epu8(pixels[0], pixels[1]), _mm_min_epu8(pixels[2], pixels[3]));
+    __m128i hi = _mm_max_epu8(_mm_max_epu8(pixels[0], pixels[1]), _mm_max_epu8(pixels[2], pixels[3]));
+    ChannelRange_SSE2(lo, hi, sums);
+
+    // each channel as 16 words in two registers, the products then come from pmaddwd
+    __m128i channels[3][2];
+    for(int c = 0; c < 3; ++c){
+        __m128i words[4];
+        for(int k = 0; k < 4; ++k)
+            words[k] = _mm_and_si128(_mm_srli_epi32(pixels[k], 8 * c), byteMask);
+        channels[c][0] = _mm_packs_epi32(words[0], words[1]);
+        channels[c][1] = _mm_packs_epi32(words[2], words[3]);
+        sums.sum[c] = HorizontalSum_SSE2(_mm_add_epi32(_mm_madd_epi16(channels[c][0], ones), _mm_madd_epi16(channels[c][1], ones)));
+    }
+    static const int pairs[6][2] = { { 0, 0 }, { 0, 1 }, { 0, 2 }, { 1, 1 }, { 1, 2 }, { 2, 2 } };
+    for(int i = 0; i < 6; ++i){
+        const __m128i* a = channels[pairs[i][0]];
+        const __m128i* b = channels[pairs[i][1]];
+        sums.products[i] = HorizontalSum_SSE2(_mm_add_epi32(_mm_madd_epi16(a[0], b[0]), _mm_madd_epi16(a[1], b[1])));
+    }
+}
+
+// squared RGB distances of 4 pixels, from pmaddwd of their (r-r', g-g') and (b-b', 0) word pairs
+HELPERS_TARGET("sse2")
+static __m128i PairSums_SSE2(__m128i pixels01, __m128i pixels23) {
+    __m128 evens = _mm_shuffle_ps(_mm_castsi128_ps(pixels01), _mm_castsi128_ps(pixels23), _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 odds = _mm_shuffle_ps(_mm_castsi128_ps(pixels01), _mm_castsi128_ps(pixels23), _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_epi32(_mm_castps_si128(evens), _mm_castps_si128(odds));
+}
+
+HELPERS_TARGET("sse2")
+static int ColorIndices_SSE2(const PixelBlock& block, const int palette[4][3], unsigned char indices[16]) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgbMask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+    __m128i colors[4];
+    for(int p = 0; p < 4; ++p)
+        colors[p] = _mm_setr_epi16((short)palette[p][0], (short)palette[p][1], (short)palette[p][2], 0,
+                                   (short)palette[p][0], (short)palette[p][1], (short)palette[p][2], 0);
+
+    int totalError = 0;
+    for(int k = 0; k < 4; ++k){
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block.rgba[4 * k]));
+        __m128i pixels01 = _mm_unpacklo_epi8(pixels, zero);
+        __m128i pixels23 = _mm_unpackhi_epi8(pixels, zero);
+
+        __m128i bestError = _mm_set1_epi32(0x7FFFFFFF);
+        __m128i bestIndex = zero;
+        for(int p = 0; p < 4; ++p){
+            __m128i d01 = _mm_and_si128(_mm_sub_epi16(pixels01, colors[p]), rgbMask);
+            __m128i d23 = _mm_and_si128(_mm_sub_epi16(pixels23, colors[p]), rgbMask);
+            __m128i error = PairSums_SSE2(_mm_madd_epi16(d01, d01), _mm_madd_epi16(d23, d23));
+            // strictly smaller, so ties keep the lower index like the scalar loop
+            __m128i better = _mm_cmplt_epi32(error, bestError);
+            bestError = _mm_or_si128(_mm_and_si128(better, error), _mm_andnot_si128(better, bestError));
+            bestIndex = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi32(p)), _mm_andnot_si128(better, bestIndex));
+        }
+        totalError += HorizontalSum_SSE2(bestError);
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(bestIndex, zero), zero);
+        int bytes = _mm_cvtsi128_si32(packed);
+        std::memcpy(indices + 4 * k, &bytes, 4);
+    }
+    return totalError;
+}
+
+HELPERS_TARGET("sse2")
+static void AlphaIndices_SSE2(const PixelBlock& block, const int palette[8], unsigned char indices[16]) {
+    // the 16 alphas in one register
+    __m128i words[4];
+    for(int k = 0; k < 4; ++k)
+        words[k] = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block.rgba[4 * k])), 24);
+    __m128i alphas = _mm_packus_epi16(_mm_packs_epi32(words[0], words[1]), _mm_packs_epi32(words[2], words[3]));
+
+    __m128i bestError = _mm_set1_epi8((char)0xFF);
+    __m128i bestIndex = _mm_setzero_si128();
+    for(int p = 0; p < 8; ++p){
+        __m128i value = _mm_set1_epi8((char)palette[p]);
+        __m128i error = _mm_or_si128(_mm_subs_epu8(alphas, value), _mm_subs_epu8(value, alphas));
+        __m128i smaller = _mm_min_epu8(error, bestError);
+        // strictly smaller: the minimum is the new error and differs from the old best
+        __m128i better = _mm_andnot_si128(_mm_cmpeq_epi8(error, bestError), _mm_cmpeq_epi8(smaller, error));
+        bestError = smaller;
+        bestIndex = _mm_or_si128(_mm_and_si128(better, _mm_set1_epi8((char)p)), _mm_andnot_si128(better, bestIndex));
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), bestIndex);
+}
+
+HELPERS_TARGET("avx2")
+static void ColorSums_AVX2(const PixelBlock& block, ColorSums& sums) {
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    const __m256i ones = _mm256_set1_epi16(1);
+
+    __m256i pixels[2];
+    for(int k = 0; k < 2; ++k)
+        pixels[k] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block.rgba[8 * k]));
+    __m256i lo = _mm256_min_epu8(pixels[0], pixels[1]);
+    __m256i hi = _mm256_max_epu8(pixels[0], pixels[1]);
+    ChannelRange_SSE2(_mm_min_epu8(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1)),
+                      _mm_max_epu8(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1)), sums);
+
+    // each channel as 16 words in one register, in a shuffled order that sums don't mind
+    __m256i channels[3];
+    for(int c = 0; c < 3; ++c){
+        channels[c] = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(pixels[0], 8 * c), byteMask),
+                                         _mm256_and_si256(_mm256_srli_epi32(pixels[1], 8 * c), byteMask));
+        __m256i s = _mm256_madd_epi16(channels[c], ones);
+        sums.sum[c] = HorizontalSum_SSE2(_mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1)));
+    }
+    static const int pairs[6][2] = { { 0, 0 }, { 0, 1 }, { 0, 2 }, { 1, 1 }, { 1, 2 }, { 2, 2 } };
+    for(int i = 0; i < 6; ++i){
+        __m256i s = _mm256_madd_epi16(channels[pairs[i][0]], channels[pairs[i][1]]);
+        sums.products[i] = HorizontalSum_SSE2(_mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1)));
+    }
+}
+
+HELPERS_TARGET("avx2")
+static int ColorIndices_AVX2(const PixelBlock& block, const int palette[4][3], unsigned char indices[16]) {
+    const __m256i rgbMask = _mm256_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0);
+    __m256i colors[4];
+    for(int p = 0; p < 4; ++p){
+        const short r = (short)palette[p][0], g = (short)palette[p][1], b = (short)palette[p][2];
+        colors[p] = _mm256_setr_epi16(r, g, b, 0, r, g, b, 0, r, g, b, 0, r, g, b, 0);
+    }
+
+    int totalError = 0;
+    for(int k = 0; k < 2; ++k){
+        // pixels 0-3 and 4-7 of this half as words
+        __m256i pixels0 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block.rgba[8 * k])));
+        __m256i pixels1 = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block.rgba[8 * k + 4])));
+
+        __m256i bestError = _mm256_set1_epi32(0x7FFFFFFF);
+        __m256i bestIndex = _mm256_setzero_si256();
+        for(int p = 0; p < 4; ++p){
+            __m256i d0 = _mm256_and_si256(_mm256_sub_epi16(pixels0, colors[p]), rgbMask);
+            __m256i d1 = _mm256_and_si256(_mm256_sub_epi16(pixels1, colors[p]), rgbMask);
+            // lanes come out as pixels 0 1 4 5 2 3 6 7
+            __m256i error = _mm256_hadd_epi32(_mm256_madd_epi16(d0, d0), _mm256_madd_epi16(d1, d1));
+            __m256i better = _mm256_cmpgt_epi32(bestError, error);
+            bestError = _mm256_blendv_epi8(bestError, error, better);
+            bestIndex = _mm256_blendv_epi8(bestIndex, _mm256_set1_epi32(p), better);
+        }
+        __m128i errors = _mm_add_epi32(_mm256_castsi256_si128(bestError), _mm256_extracti128_si256(bestError, 1));
+        totalError += HorizontalSum_SSE2(errors);
+
+        bestIndex = _mm256_permute4x64_epi64(bestIndex, _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(bestIndex), _mm256_extracti128_si256(bestIndex, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(indices + 8 * k), _mm_packus_epi16(words, words));
+    }
+    return totalError;
+}
+
+#endif
+
+static BlockKernels ChooseKernels() {
+    BlockKernels kernels = { ColorSums_Scalar, ColorIndices_Scalar, AlphaIndices_Scalar };
+#if HELPERS_X86_SIMD
+    const CpuFeatures& cpu = CpuFeatures::current();
+    if(cpu.sse2){
+        kernels.colorSums = ColorSums_SSE2;
+        kernels.colorIndices = ColorIndices_SSE2;
+        kernels.alphaIndices = AlphaIndices_SSE2;
+    }
+    // the 16 alphas already fill one SSE register, AVX2 has nothing to add there
+    if(cpu.avx2){
+        kernels.colorSums = ColorSums_AVX2;
+        kernels.colorIndices = ColorIndices_AVX2;
+    }
+#endif
+    return kernels;
+}
+
+static int ColorIndices(const BlockKernels& kernels, const PixelBlock& block, unsigned short c0, unsigned short c1, unsigned char indices[16]) {
+    int palette[4][3];
+    ColorPalette(c0, c1, palette);
+    return kernels.colorIndices(block, palette, indices);
+}
+
+// endpoints from the colour bounding box, inset by 1/16 so the extremes land between palette entries
+static void BoundingBoxEndpoints(const ColorSums& sums, float endpoint0[3], float endpoint1[3]) {
+    for(int c = 0; c < 3; ++c){
+        float inset = (sums.hi[c] - sums.lo[c]) / 16.0f;
+        endpoint0[c] = sums.hi[c] - inset;
+        endpoint1[c] = sums.lo[c] + inset;
+    }
+}
+
+// endpoints at the extremes of the block's colours along their principal axis
+static void PrincipalAxisEndpoints(const PixelBlock& block, const ColorSums& sums, float endpoint0[3], float endpoint1[3]) {
+    // covariance rr rg rb gg gb bb from the integer sums, exact up to the final division
+    static const int pairs[6][2] = { { 0, 0 }, { 0, 1 }, { 0, 2 }, { 1, 1 }, { 1, 2 }, { 2, 2 } };
+    float cov[6];
+    for(int i = 0; i < 6; ++i)
+        cov[i] = (16 * sums.products[i] - sums.sum[pairs[i][0]] * sums.sum[pairs[i][1]]) / 16.0f;
+
+    // power iteration converges fast enough for a 3x3 matrix
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for(int iteration = 0; iteration < 4; ++iteration){
+        float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+        float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+        float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+        float length = std::sqrt(x * x + y * y + z * z);
+        if(length < 1e-6f){
+            // flat block, any axis works
+            BoundingBoxEndpoints(sums, endpoint0, endpoint1);
+            return;
+        }
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+
+    int minIndex = 0, maxIndex = 0;
+    float minDot = 1e30f, maxDot = -1e30f;
+    for(int i = 0; i < 16; ++i){
+        float dot = block.rgba[i][0] * axis[0] + block.rgba[i][1] * axis[1] + block.rgba[i][2] * axis[2];
+        if(dot < minDot){ minDot = dot; minIndex = i; }
+        if(dot > maxDot){ maxDot = dot; maxIndex = i; }
+    }
+    for(int c = 0; c < 3; ++c){
+        endpoint0[c] = block.rgba[maxIndex][c];
+        endpoint1[c] = block.rgba[minIndex][c];
+    }
+}
+
+// least-squares endpoints for fixed indices; false if the indices don't pin both endpoints down
+static bool RefineEndpoints(const PixelBlock& block, const unsigned char indices[16], float endpoint0[3], float endpoint1[3]) {
+    static const float weight0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+    float a = 0, b = 0, c = 0;
+    float x[3] = { 0, 0, 0 }, y[3] = { 0, 0, 0 };
+    for(int i = 0; i < 16; ++i){
+        float w0 = weight0[indices[i]];
+        float w1 = 1.0f - w0;
+        a += w0 * w0; b += w0 * w1; c += w1 * w1;
+        for(int ch = 0; ch < 3; ++ch){
+            x[ch] += w0 * block.rgba[i][ch];
+            y[ch] += w1 * block.rgba[i][ch];
+        }
+    }
+
+    float det = a * c - b * b;
+    if(std::fabs(det) < 1e-6f)
+        return false;
+    for(int ch = 0; ch < 3; ++ch){
+        endpoint0[ch] = (x[ch] * c - y[ch] * b) / det;
+        endpoint1[ch] = (y[ch] * a - x[ch] * b) / det;
+    }
+    return true;
+}
+
+static void WriteColorBlock(unsigned short c0, unsigned short c1, const unsigned char indices[16], unsigned char* out) {
+    unsigned bits = 0;
+    for(int i = 0; i < 16; ++i)
+        bits |= (unsigned)indices[i] << (2 * i);
+
+    out[0] = (unsigned char)(c0 & 0xFF); out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xFF); out[3] = (unsigned char)(c1 >> 8);
+    out[4] = (unsigned char)(bits & 0xFF); out[5] = (unsigned char)((bits >> 8) & 0xFF);
+    out[6] = (unsigned char)((bits >> 16) & 0xFF); out[7] = (unsigned char)(bits >> 24);
+}
+
+static void EncodeColorBlock(const BlockKernels& kernels, const PixelBlock& block, const ColorSums& sums,
+                             BlockQuality quality, unsigned char* out) {
+    float endpoint0[3], endpoint1[3];
+    if(quality == BlockQuality_Fast)
+        BoundingBoxEndpoints(sums, endpoint0, endpoint1);
+    else
+        PrincipalAxisEndpoints(block, sums, endpoint0, endpoint1);
+
+    unsigned short c0 = PackRGB565(ClampByte(endpoint0[0]), ClampByte(endpoint0[1]), ClampByte(endpoint0[2]));
+    unsigned short c1 = PackRGB565(ClampByte(endpoint1[0]), ClampByte(endpoint1[1]), ClampByte(endpoint1[2]));
+    unsigned char indices[16];
+    int error = ColorIndices(kernels, block, c0, c1, indices);
+
+    if(quality == BlockQuality_High){
+        for(int iteration = 0; iteration < 2 && error > 0; ++iteration){
+            if(!RefineEndpoints(block, indices, endpoint0, endpoint1))
+                break;
+            unsigned short refined0 = PackRGB565(ClampByte(endpoint0[0]), ClampByte(endpoint0[1]), ClampByte(endpoint0[2]));
+            unsigned short refined1 = PackRGB565(ClampByte(endpoint1[0]), ClampByte(endpoint1[1]), ClampByte(endpoint1[2]));
+            unsigned char refinedIndices[16];
+            int refinedError = ColorIndices(kernels, block, refined0, refined1, refinedIndices);
+            if(refinedError >= error)
+                break;
+            c0 = refined0; c1 = refined1; error = refinedError;
+            std::memcpy(indices, refinedIndices, sizeof(indices));
+        }
+    }
+
+    // 4-colour mode needs c0 > c1; swapping the endpoints swaps indices 0<->1 and 2<->3
+    if(c0 < c1){
+        unsigned short swap = c0; c0 = c1; c1 = swap;
+        for(int i = 0; i < 16; ++i)
+            indices[i] ^= 1;
+    } else if(c0 == c1){
+        std::memset(indices, 0, sizeof(indices));
+    }
+    WriteColorBlock(c0, c1, indices, out);
+}
+
+// BC3 alpha in the 8-value mode: a0 > a1, six interpolated values in between
+static void EncodeAlphaBlock(const BlockKernels& kernels, const PixelBlock& block, const ColorSums& sums, unsigned char* out) {
+    const int lo = sums.lo[3], hi = sums.hi[3];
+
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)lo;
+    unsigned long long bits = 0;
+    if(hi != lo){
+        int palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for(int i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * hi + i * lo) / 7;
+
+        unsigned char indices[16];
+        kernels.alphaIndices(block, palette, indices);
+        for(int i = 0; i < 16; ++i)
+            bits |= (unsigned long long)indices[i] << (3 * i);
+    }
+    for(int i = 0; i < 6; ++i)
+        out[2 + i] = (unsigned char)((bits >> (8 * i)) & 0xFF);
+}
+
+BlockFormat helpers::ChooseBlockFormat(const Bitmap& bitmap) {
+    const unsigned channels = bitmap.format();
+    if(channels != Bitmap::Format_GrayscaleAlpha && channels != Bitmap::Format_RGBA)
+        return BlockFormat_BC1;
+
+    const unsigned char* pixels = bitmap.pixelBuffer();
+    size_t pixelCount = (size_t)bitmap.width() * bitmap.height();
+    for(size_t i = 0; i < pixelCount; ++i){
+        if(pixels[i * channels + channels - 1] != 255)
+            return BlockFormat_BC3;
+    }
+    return BlockFormat_BC1;
+}
+
+CompressedImage helpers::CompressBitmap(const Bitmap& bitmap, BlockFormat format, BlockQuality quality) {
+    const unsigned blocksWide = (bitmap.width() + 3) / 4;
+    const unsigned blocksHigh = (bitmap.height() + 3) / 4;
+    const size_t blockBytes = format;
+
+    CompressedImage image;
+    image.format = format;
+    image.width = bitmap.width();
+    image.height = bitmap.height();
+    image.data.resize((size_t)blocksWide * blocksHigh * blockBytes);
+
+    static const BlockKernels kernels = ChooseKernels();
+    std::function<void(size_t)> encodeBlockRow = [&](size_t blockY) {
+        PixelBlock block;
+        ColorSums sums;
+        unsigned char* out = &image.data[blockY * blocksWide * blockBytes];
+        for(unsigned blockX = 0; blockX < blocksWide; ++blockX, out += blockBytes){
+            FetchBlock(bitmap, blockX, (unsigned)blockY, block);
+            kernels.colorSums(block, sums);
+            if(format == BlockFormat_BC3){
+                EncodeAlphaBlock(kernels, block, sums, out);
+                EncodeColorBlock(kernels, block, sums, quality, out + 8);
+            } else {
+                EncodeColorBlock(kernels, block, sums, quality, out);
+            }
+        }
+    };
+    ThreadPool::shared().parallelFor(blocksHigh, encodeBlockRow);
+    return image;
+}
+
+Bitmap helpers::DecompressImage(const CompressedImage& image) {
+    const unsigned blocksWide = (image.width + 3) / 4;
+    const unsigned blocksHigh = (image.height + 3) / 4;
+    const size_t blockBytes = image.format;
+    if(image.data.size() < (size_t)blocksWide * blocksHigh * blockBytes)
+        throw std::runtime_error("Compressed image data is truncated");
+
+    Bitmap bitmap(image.width, image.height, Bitmap::Format_RGBA);
+    for(unsigned blockY = 0; blockY < blocksHigh; ++blockY){
+        for(unsigned blockX = 0; blockX < blocksWide; ++blockX){
+            const unsigned char* in = &image.data[((size_t)blockY * blocksWide + blockX) * blockBytes];
+
+            int alphas[16];
+            for(int i = 0; i < 16; ++i)
+                alphas[i] = 255;
+            if(image.format == BlockFormat_BC3){
+                int a0 = in[0], a1 = in[1];
+                int palette[8] = { a0, a1, 0, 0, 0, 0, 0, 0 };
+                if(a0 > a1){
+                    for(int i = 1; i < 7; ++i)
+                        palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+                } else {
+                    for(int i = 1; i < 5; ++i)
+                        palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+                    palette[6] = 0;
+                    palette[7] = 255;
+                }
+                unsigned long long bits = 0;
+                for(int i = 0; i < 6; ++i)
+                    bits |= (unsigned long long)in[2 + i] << (8 * i);
+                for(int i = 0; i < 16; ++i)
+                    alphas[i] = palette[(bits >> (3 * i)) & 7];
+                in += 8;
+            }
+
+            unsigned short c0 = (unsigned short)(in[0] | (in[1] << 8));
+            unsigned short c1 = (unsigned short)(in[2] | (in[3] << 8));
+            unsigned bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((unsigned)in[7] << 24);
+            int palette[4][3];
+            ColorPalette(c0, c1, palette);
+            bool transparentBlack = false;
+            if(c0 <= c1 && image.format == BlockFormat_BC1){
+                // 3-colour mode, only ever seen in BC1 data from other encoders
+                for(int c = 0; c < 3; ++c){
+                    palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                    palette[3][c] = 0;
+                }
+                transparentBlack = true;
+            }
+
+            for(unsigned i = 0; i < 16; ++i){
+                unsigned col = blockX * 4 + i % 4, row = blockY * 4 + i / 4;
+                if(col >= image.width || row >= image.height)
+                    continue;
+                unsigned index = (bits >> (2 * i)) & 3;
+                unsigned char pixel[4] = {
+                    (unsigned char)palette[index][0],
+                    (unsigned char)palette[index][1],
+                    (unsigned char)palette[index][2],
+                    (unsigned char)((transparentBlack && index == 3) ? 0 : alphas[i])
+                };
+                bitmap.setPixel(col, row, pixel);
+            }
+        }
+    }
+    return bitmap;
+}
+
+double helpers::CompressionPSNR(const Bitmap& original, const CompressedImage& compressed) {
+    Bitmap decoded = DecompressImage(compressed);
+    if(decoded.width() != original.width() || decoded.height() != original.height())
+        throw std::runtime_error("Compressed image does not match the original's size");
+
+    Bitmap reference = original;
+    reference.convertTo(Bitmap::Format_RGBA);
+
+    const unsigned channels = compressed.format == BlockFormat_BC3 ? 4 : 3;
+    const unsigned char* a = reference.pixelBuffer();
+    const unsigned char* b = decoded.pixelBuffer();
+    size_t pixelCount = (size_t)original.width() * original.height();
+    double squaredError = 0.0;
+    for(size_t i = 0; i < pixelCount; ++i){
+        for(unsigned c = 0; c < channels; ++c){
+            double d = (double)a[i * 4 + c] - (double)b[i * 4 + c];
+            squaredError += d * d;
+        }
+    }
+
+    double mse = squaredError / (double)(pixelCount * channels);
+    if(mse <= 0.0)
+        return 99.0; // lossless, report a finite ceiling
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
@@ -0,0 +1,59 @@
+#include "Bitmap.h"
+#include <vector>
+
+namespace helpers {
+
+    /**
+     GPU block compression formats, each encoding 4x4 pixel blocks.
+
+     BC1 (DXT1) stores RGB in 8 bytes per block, BC3 (DXT5) adds an 8-byte
+     alpha block. Values are the block sizes in bytes.
+     */
+    enum BlockFormat {
+        BlockFormat_BC1 = 8,
+        BlockFormat_BC3 = 16
+    };
+
+    /**
+     Encoder effort, trading speed against error.
+
+     Fast uses the colour bounding box, Normal the principal axis of the
+     block's colours, High adds least-squares refinement of the endpoints.
+     */
+    enum BlockQuality {
+        BlockQuality_Fast,
+        BlockQuality_Normal,
+        BlockQuality_High
+    };
+
+    /**
+     One image (one mip level) in GL's S3TC layout: rows of blocks, left
+     to right, top to bottom, sized for whole blocks.
+     */
+    struct CompressedImage {
+        BlockFormat format;
+        unsigned width;
+        unsigned height;
+        std::vector<unsigned char> data;
+    };
+
+    // BC3 if any pixel is not fully opaque, BC1 otherwise
+    BlockFormat ChooseBlockFormat(const Bitmap& bitmap);
+
+    /**
+     Encodes a bitmap of any format, block rows in parallel on ThreadPool::shared().
+
+     Colour is matched in the stored (sRGB) values, which is where the
+     hardware interpolates for the sRGB S3TC formats. The per-block
+     statistics and palette index searches run on AVX2 or SSE2 when the
+     CPU has them and give the same blocks as the scalar code.
+     */
+    CompressedImage CompressBitmap(const Bitmap& bitmap, BlockFormat format, BlockQuality quality);
+
+    // decodes back to an RGBA bitmap, e.g. to measure the error
+    Bitmap DecompressImage(const CompressedImage& image);
+
+    // peak signal-to-noise ratio in dB over the RGB channels, plus alpha for BC3
+    double CompressionPSNR(const Bitmap& original, const CompressedImage& compressed);
+
+}
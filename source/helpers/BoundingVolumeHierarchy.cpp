@@ -0,0 +1,432 @@
+#include "BoundingVolumeHierarchy.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <cmath>
+
+using namespace helpers;
+
+const float BoundingVolumeHierarchy::RebuildGrowth = 2.0f;
+
+// centers are sorted into this many bins along the widest axis to pick a split
+static const unsigned SplitBins = 16;
+// partly visible subtrees up to this size are tested item by item with the SIMD kernel
+static const unsigned CullBatchSize = 16;
+
+static BoundingBox Union(const BoundingBox& a, const BoundingBox& b) {
+    return BoundingBox(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+static float SurfaceArea(const BoundingBox& box) {
+    glm::vec3 d = box.max - box.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static bool Overlaps(const BoundingBox& a, const BoundingBox& b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+           a.min.y <= b.max.y && a.max.y >= b.min.y &&
+           a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+static bool Contains(const BoundingBox& outer, const BoundingBox& inner) {
+    return outer.min.x <= inner.min.x && outer.max.x >= inner.max.x &&
+           outer.min.y <= inner.min.y && outer.max.y >= inner.max.y &&
+           outer.min.z <= inner.min.z && outer.max.z >= inner.max.z;
+}
+
+// entry distance of the ray into the box, false if it misses within [0, maxDistance]
+static bool RayEntry(const BoundingBox& box, const glm::vec3& origin, const glm::vec3& inverseDirection,
+                     float maxDistance, float& entry) {
+    float tNear = 0.0f;
+    float tFar = maxDistance;
+    for(int axis = 0; axis < 3; ++axis){
+        float t1 = (box.min[axis] - origin[axis]) * inverseDirection[axis];
+        float t2 = (box.max[axis] - origin[axis]) * inverseDirection[axis];
+        tNear = std::max(tNear, std::min(t1, t2));
+        tFar = std::min(tFar, std::max(t1, t2));
+    }
+    entry = tNear;
+    return tNear <= tFar;
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy() :
+    _refitNeeded(false)
+{
+}
+
+void BoundingVolumeHierarchy::build(const std::vector<BoundingBox>& boxes) {
+    const size_t count = boxes.size();
+    _boxes = boxes;
+    _centers.resize(count);
+    for(size_t i = 0; i < count; ++i)
+        _centers[i] = boxes[i].center();
+    _order.resize(count);
+    for(size_t i = 0; i < count; ++i)
+        _order[i] = (unsigned)i;
+    _leaves.assign(count, 0);
+    _nodes.resize(count > 0 ? 2 * count - 1 : 0);
+    _refitNeeded = false;
+
+    if(count > 0){
+        _nodes[0].first = 0;
+        _nodes[0].count = (unsigned)count;
+        _nodes[0].parent = 0;
+        _buildSubtree(0);
+    }
+
+    _orderedBoxes.clear();
+    for(size_t i = 0; i < count; ++i)
+        _orderedBoxes.push(_boxes[_order[i]]);
+}
+
+size_t BoundingVolumeHierarchy::size() const {
+    return _boxes.size();
+}
+
+const BoundingBox& BoundingVolumeHierarchy::bounds(unsigned item) const {
+    if(item >= _boxes.size())
+        throw std::runtime_error("Bounding volume hierarchy item out of range");
+    return _boxes[item];
+}
+
+void BoundingVolumeHierarchy::update(unsigned item, const BoundingBox& box) {
+    if(item >= _boxes.size())
+        throw std::runtime_error("Bounding volume hierarchy item out of range");
+    if(_boxes[item].min == box.min && _boxes[item].max == box.max)
+        return;
+
+    _boxes[item] = box;
+    _centers[item] = box.center();
+    unsigned leaf = _leaves[item];
+    _nodes[leaf].box = box;
+    _orderedBoxes.set(_nodes[leaf].first, box);
+
+    // stops at the first ancestor that an earlier update already marked
+    for(unsigned node = leaf; node != 0;){
+        node = _nodes[node].parent;
+        if(_nodes[node].dirty)
+            break;
+        _nodes[node].dirty = true;
+    }
+    _refitNeeded = true;
+}
+
+size_t BoundingVolumeHierarchy::refit() {
+    if(!_refitNeeded)
+        return 0;
+    _refitNeeded = false;
+
+    // children always come after their parent, so back to front is bottom up
+    bool degraded = false;
+    for(size_t i = _nodes.size(); i-- > 0;){
+        Node& node = _nodes[i];
+        if(!node.dirty)
+            continue;
+        node.box = Union(_nodes[i + 1].box, _nodes[node.right].box);
+        node.dirty = false;
+        if(SurfaceArea(node.box) > RebuildGrowth * node.builtArea)
+            degraded = true;
+    }
+    if(!degraded)
+        return 0;
+
+    // a rebuilt subtree keeps its item set and so its box, the nodes above stay valid
+    size_t rebuilt = 0;
+    for(size_t i = 0; i < _nodes.size();){
+        Node& node = _nodes[i];
+        if(node.count > 1 && SurfaceArea(node.box) > RebuildGrowth * node.builtArea){
+            _buildSubtree((unsigned)i);
+            for(unsigned k = node.first; k < node.first + node.count; ++k)
+                _orderedBoxes.set(k, _boxes[_order[k]]);
+            rebuilt += node.count;
+            i += 2 * node.count - 1;
+        } else {
+            ++i;
+        }
+    }
+    return rebuilt;
+}
+
+size_t BoundingVolumeHierarchy::cull(const Frustum& frustum, std::vector<unsigned>& visible) const {
+    if(_refitNeeded)
+        throw std::runtime_error("Bounding volume hierarchy queried before refit");
+    size_t before = visible.size();
+    if(_nodes.empty())
+        return 0;
+
+    glm::vec4 planes[6];
+    glm::vec3 absNormals[6];
+    for(unsigned p = 0; p < 6; ++p){
+        planes[p] = frustum.plane(p);
+        absNormals[p] = glm::abs(glm::vec3(planes[p]));
+    }
+
+    // node and the planes its box still crosses, the ones it is fully inside of are not tested below it
+    std::vector<std::pair<unsigned, unsigned> > stack;
+    stack.reserve(64);
+    stack.push_back(std::make_pair(0u, 0x3Fu));
+    while(!stack.empty()){
+        unsigned index = stack.back().first;
+        unsigned planeMask = stack.back().second;
+        const Node& node = _nodes[index];
+        stack.pop_back();
+
+        glm::vec3 center = node.box.center();
+        glm::vec3 extent = node.box.extent();
+        bool outside = false;
+        for(unsigned p = 0; p < 6 && !outside; ++p){
+            if(!(planeMask & (1u << p)))
+                continue;
+            float distance = glm::dot(glm::vec3(planes[p]), center) + planes[p].w;
+            float reach = glm::dot(absNormals[p], extent);
+            if(distance + reach < 0.0f)
+                outside = true;
+            else if(distance - reach >= 0.0f)
+                planeMask &= ~(1u << p);
+        }
+        if(outside)
+            continue;
+
+        if(planeMask == 0){
+            visible.insert(visible.end(), _order.begin() + node.first, _order.begin() + node.first + node.count);
+        } else if(node.count <= CullBatchSize){
+            // the kernel gives positions in _order
+            size_t firstFound = visible.size();
+            frustum.cull(_orderedBoxes, node.first, node.count, visible);
+            for(size_t k = firstFound; k < visible.size(); ++k)
+                visible[k] = _order[visible[k]];
+        } else {
+            stack.push_back(std::make_pair(node.right, planeMask));
+            stack.push_back(std::make_pair(index + 1, planeMask));
+        }
+    }
+    return visible.size() - before;
+}
+
+bool BoundingVolumeHierarchy::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                                      unsigned& item, float& distance,
+                                      const std::function<bool(unsigned)>& accept) const {
+    if(_refitNeeded)
+        throw std::runtime_error("Bounding volume hierarchy queried before refit");
+    if(_nodes.empty())
+        return false;
+
+    glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+    float nearest = maxDistance;
+    bool hit = false;
+
+    std::vector<std::pair<unsigned, float> > stack;
+    stack.reserve(64);
+    float entry;
+    if(!RayEntry(_nodes[0].box, origin, inverseDirection, nearest, entry))
+        return false;
+    stack.push_back(std::make_pair(0u, entry));
+    while(!stack.empty()){
+        unsigned index = stack.back().first;
+        float nodeEntry = stack.back().second;
+        stack.pop_back();
+        if(nodeEntry > nearest)
+            continue;
+
+        const Node& node = _nodes[index];
+        if(node.right == 0){
+            if(accept && !accept(_order[node.first]))
+                continue;
+            // a leaf's box is its item's box, the entry is the hit
+            nearest = nodeEntry;
+            item = _order[node.first];
+            hit = true;
+            continue;
+        }
+
+        float leftEntry, rightEntry;
+        bool leftHit = RayEntry(_nodes[index + 1].box, origin, inverseDirection, nearest, leftEntry);
+        bool rightHit = RayEntry(_nodes[node.right].box, origin, inverseDirection, nearest, rightEntry);
+        // the nearer child goes on top so it is searched first
+        if(leftHit && rightHit && leftEntry > rightEntry){
+            stack.push_back(std::make_pair(index + 1, leftEntry));
+            stack.push_back(std::make_pair(node.right, rightEntry));
+        } else {
+            if(rightHit)
+                stack.push_back(std::make_pair(node.right, rightEntry));
+            if(leftHit)
+                stack.push_back(std::make_pair(index + 1, leftEntry));
+        }
+    }
+
+    if(hit)
+        distance = nearest;
+    return hit;
+}
+
+size_t BoundingVolumeHierarchy::overlapping(const BoundingBox& box, std::vector<unsigned>& items) const {
+    if(_refitNeeded)
+        throw std::runtime_error("Bounding volume hierarchy queried before refit");
+    size_t before = items.size();
+    if(_nodes.empty())
+        return 0;
+
+    std::vector<unsigned> stack(1, 0u);
+    while(!stack.empty()){
+        unsigned index = stack.back();
+        stack.pop_back();
+        const Node& node = _nodes[index];
+        if(!Overlaps(node.box, box))
+            continue;
+        if(node.right == 0 || Contains(box, node.box)){
+            items.insert(items.end(), _order.begin() + node.first, _order.begin() + node.first + node.count);
+        } else {
+            stack.push_back(node.right);
+            stack.push_back(index + 1);
+        }
+    }
+    return items.size() - before;
+}
+
+size_t BoundingVolumeHierarchy::overlapping(const BoundingSphere& sphere, std::vector<unsigned>& items) const {
+    if(_refitNeeded)
+        throw std::runtime_error("Bounding volume hierarchy queried before refit");
+    size_t before = items.size();
+    if(_nodes.empty())
+        return 0;
+
+    const float radiusSquared = sphere.radius * sphere.radius;
+    std::vector<unsigned> stack(1, 0u);
+    while(!stack.empty()){
+        unsigned index = stack.back();
+        stack.pop_back();
+        const Node& node = _nodes[index];
+
+        // nearest point of the box to the center, and the farthest corner
+        glm::vec3 nearest = glm::min(glm::max(sphere.center, node.box.min), node.box.max);
+        glm::vec3 toNearest = nearest - sphere.center;
+        if(glm::dot(toNearest, toNearest) > radiusSquared)
+            continue;
+        glm::vec3 toFarthest = glm::max(glm::abs(node.box.min - sphere.center), glm::abs(node.box.max - sphere.center));
+
+        if(node.right == 0 || glm::dot(toFarthest, toFarthest) <= radiusSquared){
+            items.insert(items.end(), _order.begin() + node.first, _order.begin() + node.first + node.count);
+        } else {
+            stack.push_back(node.right);
+            stack.push_back(index + 1);
+        }
+    }
+    return items.size() - before;
+}
+
+void BoundingVolumeHierarchy::_buildSubtree(unsigned root) {
+    // splits top down: a node's range of items is known before its children are placed
+    std::vector<unsigned> pending(1, root);
+    while(!pending.empty()){
+        unsigned index = pending.back();
+        pending.pop_back();
+        Node& node = _nodes[index];
+        node.dirty = false;
+
+        if(node.count == 1){
+            unsigned item = _order[node.first];
+            node.right = 0;
+            node.box = _boxes[item];
+            node.builtArea = SurfaceArea(node.box);
+            _leaves[item] = index;
+            continue;
+        }
+
+        unsigned leftCount = _split(node.first, node.count);
+        node.right = index + 2 * leftCount;
+
+        Node& left = _nodes[index + 1];
+        left.first = node.first;
+        left.count = leftCount;
+        left.parent = index;
+
+        Node& right = _nodes[node.right];
+        right.first = node.first + leftCount;
+        right.count = node.count - leftCount;
+        right.parent = index;
+
+        pending.push_back(node.right);
+        pending.push_back(index + 1);
+    }
+
+    // then the boxes bottom up, children come after their parent
+    for(size_t i = root + 2 * _nodes[root].count - 1; i-- > root;){
+        Node& node = _nodes[i];
+        if(node.right == 0)
+            continue;
+        node.box = Union(_nodes[i + 1].box, _nodes[node.right].box);
+        node.builtArea = SurfaceArea(node.box);
+    }
+}
+
+// reorders the items of the range so the left child's come first, returns how many that is
+unsigned BoundingVolumeHierarchy::_split(unsigned first, unsigned count) {
+    unsigned* begin = &_order[first];
+    unsigned* end = begin + count;
+
+    BoundingBox centers(_centers[*begin], _centers[*begin]);
+    for(unsigned* it = begin + 1; it != end; ++it){
+        centers.min = glm::min(centers.min, _centers[*it]);
+        centers.max = glm::max(centers.max, _centers[*it]);
+    }
+    glm::vec3 spread = centers.max - centers.min;
+    int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+
+    // all centers in one spot, any split is as good
+    if(!(spread[axis] > 0.0f))
+        return count / 2;
+
+    const float binScale = SplitBins / spread[axis];
+    const float axisMin = centers.min[axis];
+    struct Bin {
+        BoundingBox box;
+        unsigned count;
+    } bins[SplitBins];
+    for(unsigned b = 0; b < SplitBins; ++b)
+        bins[b].count = 0;
+
+    for(unsigned* it = begin; it != end; ++it){
+        const BoundingBox& box = _boxes[*it];
+        unsigned b = std::min(SplitBins - 1, (unsigned)((_centers[*it][axis] - axisMin) * binScale));
+        bins[b].box = bins[b].count == 0 ? box : Union(bins[b].box, box);
+        ++bins[b].count;
+    }
+
+    // area * count of everything right of each split, then sweep from the left
+    float rightCost[SplitBins];
+    BoundingBox rightBox;
+    unsigned rightCount = 0;
+    for(unsigned b = SplitBins; b-- > 1;){
+        if(bins[b].count > 0){
+            rightBox = rightCount == 0 ? bins[b].box : Union(rightBox, bins[b].box);
+            rightCount += bins[b].count;
+        }
+        rightCost[b] = rightCount == 0 ? 0.0f : SurfaceArea(rightBox) * rightCount;
+    }
+
+    unsigned bestBin = 0;
+    float bestCost = 0.0f;
+    bool found = false;
+    BoundingBox leftBox;
+    unsigned leftCount = 0;
+    for(unsigned b = 0; b + 1 < SplitBins; ++b){
+        if(bins[b].count > 0){
+            leftBox = leftCount == 0 ? bins[b].box : Union(leftBox, bins[b].box);
+            leftCount += bins[b].count;
+        }
+        if(leftCount == 0 || leftCount == count)
+            continue;
+        float cost = SurfaceArea(leftBox) * leftCount + rightCost[b + 1];
+        if(!found || cost < bestCost){
+            found = true;
+            bestCost = cost;
+            bestBin = b;
+        }
+    }
+
+    unsigned* middle = std::partition(begin, end, [&](unsigned item) {
+        return std::min(SplitBins - 1, (unsigned)((_centers[item][axis] - axisMin) * binScale)) <= bestBin;
+    });
+    unsigned split = (unsigned)(middle - begin);
+    return split == 0 || split == count ? count / 2 : split;
+}
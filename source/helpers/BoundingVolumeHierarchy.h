@@ -0,0 +1,105 @@
+#include "Frustum.h"
+#include <vector>
+#include <functional>
+#include <cstddef>
+
+namespace helpers {
+
+    /**
+     Tree of bounding boxes over a set of items, e.g. scene instances.
+
+     Items are numbered 0..count-1 by the order of the boxes given to
+     `build`. The tree is split by the surface area heuristic over binned
+     box centers, with one item per leaf. Moving items only refits the
+     boxes on their path to the root; subtrees whose boxes have grown too
+     much since they were built are rebuilt in place, the rest of the tree
+     is kept.
+     */
+    class BoundingVolumeHierarchy {
+    public:
+        BoundingVolumeHierarchy();
+
+        /** Builds the tree from scratch, replacing all the items */
+        void build(const std::vector<BoundingBox>& boxes);
+
+        size_t size() const;
+
+        /** The current box of `item` */
+        const BoundingBox& bounds(unsigned item) const;
+
+        /**
+         Gives `item` a new box.
+
+         The tree is not valid for queries again until `refit` is called.
+         Cheap if the box did not change, so it can be called for every
+         item every frame.
+         */
+        void update(unsigned item, const BoundingBox& box);
+
+        /**
+         Recomputes the boxes above the items changed by `update`.
+
+         Rebuilds the topmost subtrees that have grown to more than
+         RebuildGrowth times their surface area at build time.
+         Returns the number of items in the rebuilt subtrees.
+         */
+        size_t refit();
+
+        /**
+         Appends the items whose boxes intersect `frustum` to `visible`.
+
+         Subtrees fully inside the frustum are taken whole, small partly
+         visible ones are finished with the SIMD Frustum::cull. Items come
+         out in tree order, not sorted. Returns how many were appended.
+         */
+        size_t cull(const Frustum& frustum, std::vector<unsigned>& visible) const;
+
+        /**
+         Nearest item whose box is hit by the ray from `origin` along
+         `direction`, within `maxDistance`.
+
+         `direction` doesn't have to be normalized, `distance` is in its
+         lengths. Items for which `accept` returns false are passed
+         through. Returns false if nothing is hit.
+         */
+        bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                     unsigned& item, float& distance,
+                     const std::function<bool(unsigned)>& accept = std::function<bool(unsigned)>()) const;
+
+        /** Appends the items whose boxes overlap `box` to `items`, returns how many */
+        size_t overlapping(const BoundingBox& box, std::vector<unsigned>& items) const;
+
+        /** Appends the items whose boxes overlap `sphere` to `items`, returns how many */
+        size_t overlapping(const BoundingSphere& sphere, std::vector<unsigned>& items) const;
+
+        static const float RebuildGrowth;
+
+    private:
+        // nodes are stored depth first: the left child follows its parent, and a
+        // subtree of n items always takes 2n-1 nodes, so it can be rebuilt in place
+        struct Node {
+            BoundingBox box;
+            unsigned first; // range of the subtree's items in _order
+            unsigned count;
+            unsigned right; // index of the right child, 0 for leaves
+            unsigned parent;
+            float builtArea; // surface area after the last build of this subtree
+            bool dirty;
+        };
+
+        std::vector<Node> _nodes;
+        std::vector<unsigned> _order; // items in tree order
+        std::vector<unsigned> _leaves; // leaf node of each item
+        std::vector<BoundingBox> _boxes; // by item
+        std::vector<glm::vec3> _centers; // of _boxes, what the splits sort by
+        BoundingBoxList _orderedBoxes; // by position in _order, for Frustum::cull
+        bool _refitNeeded;
+
+        void _buildSubtree(unsigned node);
+        unsigned _split(unsigned first, unsigned count);
+
+        BoundingVolumeHierarchy(const BoundingVolumeHierarchy&);
+        const BoundingVolumeHierarchy& operator=(const BoundingVolumeHierarchy&);
+    };
+
+}
@@ -0,0 +1,47 @@
+#include "CpuFeatures.h"
+#include <cstring>
+
+#if HELPERS_X86_SIMD && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+using namespace helpers;
+
+static CpuFeatures DetectCpuFeatures() {
+    CpuFeatures features;
+    std::memset(&features, 0, sizeof(features));
+
+#if HELPERS_X86_SIMD && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    features.sse2 = (info[3] & (1 << 26)) != 0;
+    features.ssse3 = (info[2] & (1 << 9)) != 0;
+    features.sse41 = (info[2] & (1 << 19)) != 0;
+    bool osSavesAvx = false;
+    if((info[2] & (1 << 27)) && (info[2] & (1 << 28))){
+        // OSXSAVE and AVX: check that the OS saves XMM and YMM state
+        osSavesAvx = (_xgetbv(0) & 0x6) == 0x6;
+    }
+    if(maxLeaf >= 7 && osSavesAvx){
+        __cpuidex(info, 7, 0);
+        features.avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#elif HELPERS_X86_SIMD
+    __builtin_cpu_init();
+    features.sse2 = __builtin_cpu_supports("sse2") != 0;
+    features.ssse3 = __builtin_cpu_supports("ssse3") != 0;
+    features.sse41 = __builtin_cpu_supports("sse4.1") != 0;
+    features.avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+
+    return features;
+}
+
+const CpuFeatures& CpuFeatures::current() {
+    static const CpuFeatures features = DetectCpuFeatures();
+    return features;
+}
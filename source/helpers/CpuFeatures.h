@@ -0,0 +1,29 @@
+namespace helpers {
+
+    /**
+     SIMD extensions of the CPU the program runs on.
+
+     Detected once, on the first call to `current`. Everything is false on
+     non-x86 builds, so callers always fall back to their scalar code there.
+     */
+    struct CpuFeatures {
+        bool sse2;
+        bool ssse3;
+        bool sse41;
+        bool avx2;  // also requires the OS to save the AVX registers
+
+        static const CpuFeatures& current();
+    };
+
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define HELPERS_X86_SIMD 1
+#endif
+
+// lets one translation unit hold kernels for several instruction sets without global -m flags
+#if defined(__GNUC__) || defined(__clang__)
+    #define HELPERS_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define HELPERS_TARGET(isa)
+#endif
@@ -0,0 +1,276 @@
+#include "Frustum.h"
+#include "CpuFeatures.h"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#if HELPERS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace helpers;
+
+BoundingBox::BoundingBox() :
+    min(0.0f),
+    max(0.0f)
+{
+}
+
+BoundingBox::BoundingBox(const glm::vec3& min, const glm::vec3& max) :
+    min(min),
+    max(max)
+{
+}
+
+BoundingBox BoundingBox::fromPoints(const float* points, size_t count, size_t stride) {
+    if(count == 0)
+        throw std::runtime_error("Bounding box of no points");
+    if(stride < 3)
+        throw std::runtime_error("Point stride must be at least 3 floats");
+
+    BoundingBox box(glm::vec3(points[0], points[1], points[2]), glm::vec3(points[0], points[1], points[2]));
+    for(size_t i = 1; i < count; ++i){
+        glm::vec3 p(points[i*stride], points[i*stride + 1], points[i*stride + 2]);
+        box.min = glm::min(box.min, p);
+        box.max = glm::max(box.max, p);
+    }
+    return box;
+}
+
+glm::vec3 BoundingBox::center() const {
+    return (min + max) * 0.5f;
+}
+
+glm::vec3 BoundingBox::extent() const {
+    return (max - min) * 0.5f;
+}
+
+BoundingBox BoundingBox::transformed(const glm::mat4& transform) const {
+    glm::vec3 c = center();
+    glm::vec3 e = extent();
+    glm::vec3 newCenter(transform * glm::vec4(c, 1.0f));
+    glm::vec3 newExtent(0.0f);
+    for(int column = 0; column < 3; ++column)
+        newExtent += glm::abs(glm::vec3(transform[column])) * e[column];
+    return BoundingBox(newCenter - newExtent, newCenter + newExtent);
+}
+
+BoundingSphere::BoundingSphere() :
+    center(0.0f),
+    radius(0.0f)
+{
+}
+
+BoundingSphere::BoundingSphere(const glm::vec3& center, float radius) :
+    center(center),
+    radius(radius)
+{
+}
+
+BoundingSphere BoundingSphere::fromPoints(const float* points, size_t count, size_t stride) {
+    glm::vec3 center = BoundingBox::fromPoints(points, count, stride).center();
+    float radiusSquared = 0.0f;
+    for(size_t i = 0; i < count; ++i){
+        glm::vec3 d = glm::vec3(points[i*stride], points[i*stride + 1], points[i*stride + 2]) - center;
+        radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+    }
+    return BoundingSphere(center, std::sqrt(radiusSquared));
+}
+
+BoundingSphere BoundingSphere::transformed(const glm::mat4& transform) const {
+    float scale = std::max(glm::length(glm::vec3(transform[0])),
+                           std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+    return BoundingSphere(glm::vec3(transform * glm::vec4(center, 1.0f)), radius * scale);
+}
+
+BoundingBoxList::BoundingBoxList()
+{
+}
+
+void BoundingBoxList::clear() {
+    _centerX.clear(); _centerY.clear(); _centerZ.clear();
+    _extentX.clear(); _extentY.clear(); _extentZ.clear();
+}
+
+void BoundingBoxList::push(const BoundingBox& box) {
+    glm::vec3 c = box.center();
+    glm::vec3 e = box.extent();
+    _centerX.push_back(c.x); _centerY.push_back(c.y); _centerZ.push_back(c.z);
+    _extentX.push_back(e.x); _extentY.push_back(e.y); _extentZ.push_back(e.z);
+}
+
+void BoundingBoxList::set(size_t index, const BoundingBox& box) {
+    if(index >= size())
+        throw std::runtime_error("Bounding box index out of range");
+    glm::vec3 c = box.center();
+    glm::vec3 e = box.extent();
+    _centerX[index] = c.x; _centerY[index] = c.y; _centerZ[index] = c.z;
+    _extentX[index] = e.x; _extentY[index] = e.y; _extentZ[index] = e.z;
+}
+
+size_t BoundingBoxList::size() const {
+    return _centerX.size();
+}
+
+namespace {
+    struct BoxArrays {
+        const float* centerX;
+        const float* centerY;
+        const float* centerZ;
+        const float* extentX;
+        const float* extentY;
+        const float* extentZ;
+    };
+
+    // tests boxes [first, end)
+    typedef void (*CullFunc)(const glm::vec4* planes, const BoxArrays& boxes, size_t first, size_t end, std::vector<unsigned>& visible);
+}
+
+// distance of the box corner farthest along the plane normal; the SIMD kernels
+// add in the same order, so all of them agree on boxes that touch a plane
+static inline bool OutsidePlane(const glm::vec4& plane, float cx, float cy, float cz, float ex, float ey, float ez) {
+    float distance = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+    float reach = std::fabs(plane.x) * ex + std::fabs(plane.y) * ey + std::fabs(plane.z) * ez;
+    return distance + reach < 0.0f;
+}
+
+// scalar kernel, also finishes the tails of the SIMD ones
+static void CullBoxes_Scalar(const glm::vec4* planes, const BoxArrays& b, size_t first, size_t end, std::vector<unsigned>& visible) {
+    for(size_t i = first; i < end; ++i){
+        bool outside = false;
+        for(int p = 0; p < 6 && !outside; ++p)
+            outside = OutsidePlane(planes[p], b.centerX[i], b.centerY[i], b.centerZ[i], b.extentX[i], b.extentY[i], b.extentZ[i]);
+        if(!outside)
+            visible.push_back((unsigned)i);
+    }
+}
+
+#if HELPERS_X86_SIMD
+
+HELPERS_TARGET("sse2")
+static void CullBoxes_SSE2(const glm::vec4* planes, const BoxArrays& b, size_t first, size_t end, std::vector<unsigned>& visible) {
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = first;
+    // 4 boxes per step, one plane at a time
+    for(; i + 4 <= end; i += 4){
+        __m128 cx = _mm_loadu_ps(b.centerX + i), cy = _mm_loadu_ps(b.centerY + i), cz = _mm_loadu_ps(b.centerZ + i);
+        __m128 ex = _mm_loadu_ps(b.extentX + i), ey = _mm_loadu_ps(b.extentY + i), ez = _mm_loadu_ps(b.extentZ + i);
+        __m128 outside = zero;
+        for(int p = 0; p < 6; ++p){
+            __m128 nx = _mm_set1_ps(planes[p].x), ny = _mm_set1_ps(planes[p].y), nz = _mm_set1_ps(planes[p].z);
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_mul_ps(nz, cz)),
+                                         _mm_set1_ps(planes[p].w));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+                                                 _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+                                      _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), zero));
+        }
+        unsigned inside = ~(unsigned)_mm_movemask_ps(outside) & 0xF;
+        for(unsigned bit = 0; inside != 0; ++bit, inside >>= 1)
+            if(inside & 1)
+                visible.push_back((unsigned)(i + bit));
+    }
+    CullBoxes_Scalar(planes, b, i, end, visible);
+}
+
+HELPERS_TARGET("avx2")
+static void CullBoxes_AVX2(const glm::vec4* planes, const BoxArrays& b, size_t first, size_t end, std::vector<unsigned>& visible) {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    size_t i = first;
+    // 8 boxes per step; no FMA, it would round differently from the other kernels
+    for(; i + 8 <= end; i += 8){
+        __m256 cx = _mm256_loadu_ps(b.centerX + i), cy = _mm256_loadu_ps(b.centerY + i), cz = _mm256_loadu_ps(b.centerZ + i);
+        __m256 ex = _mm256_loadu_ps(b.extentX + i), ey = _mm256_loadu_ps(b.extentY + i), ez = _mm256_loadu_ps(b.extentZ + i);
+        __m256 outside = zero;
+        for(int p = 0; p < 6; ++p){
+            __m256 nx = _mm256_set1_ps(planes[p].x), ny = _mm256_set1_ps(planes[p].y), nz = _mm256_set1_ps(planes[p].z);
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)),
+                                                          _mm256_mul_ps(nz, cz)),
+                                            _mm256_set1_ps(planes[p].w));
+            __m256 reach = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, nx), ex),
+                                                       _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), ey)),
+                                         _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), ez));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), zero, _CMP_LT_OQ));
+        }
+        unsigned inside = ~(unsigned)_mm256_movemask_ps(outside) & 0xFF;
+        for(unsigned bit = 0; inside != 0; ++bit, inside >>= 1)
+            if(inside & 1)
+                visible.push_back((unsigned)(i + bit));
+    }
+    CullBoxes_SSE2(planes, b, i, end, visible);
+}
+
+#endif
+
+static CullFunc CullKernel() {
+#if HELPERS_X86_SIMD
+    const CpuFeatures& cpu = CpuFeatures::current();
+    if(cpu.avx2) return CullBoxes_AVX2;
+    if(cpu.sse2) return CullBoxes_SSE2;
+#endif
+    return CullBoxes_Scalar;
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection) {
+    // rows of the matrix, glm stores it by columns
+    glm::vec4 row[4];
+    for(int r = 0; r < 4; ++r)
+        row[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+
+    _planes[0] = row[3] + row[0];
+    _planes[1] = row[3] - row[0];
+    _planes[2] = row[3] + row[1];
+    _planes[3] = row[3] - row[1];
+    _planes[4] = row[3] + row[2];
+    _planes[5] = row[3] - row[2];
+    for(int p = 0; p < 6; ++p)
+        _planes[p] /= glm::length(glm::vec3(_planes[p]));
+}
+
+const glm::vec4& Frustum::plane(unsigned index) const {
+    if(index >= 6)
+        throw std::runtime_error("Frustum plane index out of range");
+    return _planes[index];
+}
+
+bool Frustum::intersects(const BoundingBox& box) const {
+    glm::vec3 c = box.center();
+    glm::vec3 e = box.extent();
+    for(int p = 0; p < 6; ++p)
+        if(OutsidePlane(_planes[p], c.x, c.y, c.z, e.x, e.y, e.z))
+            return false;
+    return true;
+}
+
+bool Frustum::intersects(const BoundingSphere& sphere) const {
+    for(int p = 0; p < 6; ++p)
+        if(glm::dot(glm::vec3(_planes[p]), sphere.center) + _planes[p].w < -sphere.radius)
+            return false;
+    return true;
+}
+
+size_t Frustum::cull(const BoundingBoxList& boxes, std::vector<unsigned>& visible) const {
+    return cull(boxes, 0, boxes.size(), visible);
+}
+
+size_t Frustum::cull(const BoundingBoxList& boxes, size_t first, size_t count, std::vector<unsigned>& visible) const {
+    static const CullFunc kernel = CullKernel();
+
+    if(first + count > boxes.size())
+        throw std::runtime_error("Bounding box range out of range");
+    size_t before = visible.size();
+    if(count == 0)
+        return 0;
+
+    BoxArrays arrays;
+    arrays.centerX = &boxes._centerX[0];
+    arrays.centerY = &boxes._centerY[0];
+    arrays.centerZ = &boxes._centerZ[0];
+    arrays.extentX = &boxes._extentX[0];
+    arrays.extentY = &boxes._extentY[0];
+    arrays.extentZ = &boxes._extentZ[0];
+    kernel(_planes, arrays, first, first + count, visible);
+    return visible.size() - before;
+}
@@ -0,0 +1,113 @@
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+
+namespace helpers {
+
+    /** Axis-aligned box, `min` <= `max` on every axis */
+    struct BoundingBox {
+        glm::vec3 min;
+        glm::vec3 max;
+
+        BoundingBox();
+        BoundingBox(const glm::vec3& min, const glm::vec3& max);
+
+        /**
+         Smallest box around `count` points.
+
+         The points are read from the first three floats of every `stride`
+         floats, which fits interleaved vertex data with the position first.
+         */
+        static BoundingBox fromPoints(const float* points, size_t count, size_t stride = 3);
+
+        glm::vec3 center() const;
+        // half the size on every axis
+        glm::vec3 extent() const;
+
+        /**
+         Box around this box after `transform`.
+
+         Uses the absolute values of the matrix on the extent, so it costs
+         the same as transforming one point, but is only tight for
+         rotations by multiples of 90 degrees.
+         */
+        BoundingBox transformed(const glm::mat4& transform) const;
+    };
+
+    struct BoundingSphere {
+        glm::vec3 center;
+        float radius;
+
+        BoundingSphere();
+        BoundingSphere(const glm::vec3& center, float radius);
+
+        /** Sphere centered on the box of the points, through the farthest one */
+        static BoundingSphere fromPoints(const float* points, size_t count, size_t stride = 3);
+
+        /** Sphere around this sphere after `transform`, scaled by its longest axis */
+        BoundingSphere transformed(const glm::mat4& transform) const;
+    };
+
+    /**
+     Boxes stored as separate arrays of center and extent coordinates.
+
+     This is the layout Frustum::cull reads several boxes at a time from.
+     Refill it after `clear` or change boxes in place with `set`, the
+     arrays keep their capacity.
+     */
+    class BoundingBoxList {
+    public:
+        BoundingBoxList();
+
+        void clear();
+        void push(const BoundingBox& box);
+        void set(size_t index, const BoundingBox& box);
+        size_t size() const;
+
+    private:
+        friend class Frustum;
+
+        std::vector<float> _centerX, _centerY, _centerZ;
+        std::vector<float> _extentX, _extentY, _extentZ;
+    };
+
+    /**
+     The six clip planes of a projection.
+
+     Plane normals point inwards and are normalized, so the plane equation
+     gives the distance to a point.
+     */
+    class Frustum {
+    public:
+        /**
+         Extracts the planes from `viewProjection`, e.g. Camera::matrix().
+
+         Expects OpenGL clip space, -w <= z <= w.
+         */
+        explicit Frustum(const glm::mat4& viewProjection);
+
+        // xyz is the normal, w the distance from the origin; left, right, bottom, top, near, far
+        const glm::vec4& plane(unsigned index) const;
+
+        /** False only if the box is entirely outside one of the planes */
+        bool intersects(const BoundingBox& box) const;
+        bool intersects(const BoundingSphere& sphere) const;
+
+        /**
+         Tests all the boxes of `boxes` and appends the indices of the ones
+         that intersect to `visible`, in increasing order.
+
+         Returns how many were appended. Tests 8 boxes at a time with AVX2
+         or 4 with SSE when the CPU has them, with the same result as
+         `intersects` box by box.
+         */
+        size_t cull(const BoundingBoxList& boxes, std::vector<unsigned>& visible) const;
+
+        /** Same as above for the `count` boxes from `first` on, indices are still into `boxes` */
+        size_t cull(const BoundingBoxList& boxes, size_t first, size_t count, std::vector<unsigned>& visible) const;
+
+    private:
+        glm::vec4 _planes[6];
+    };
+
+}
@@ -0,0 +1,81 @@
+#include "GLState.h"
+#include "Program.h"
+#include <stdexcept>
+
+using namespace helpers;
+
+// binding value that never matches a real one, forces the next call through
+static const GLuint Unknown = ~0u;
+
+GLState::GLState() :
+    _issued(0),
+    _skipped(0)
+{
+    invalidate();
+}
+
+void GLState::useProgram(const Program& program) {
+    if(_program == &program){
+        ++_skipped;
+        return;
+    }
+
+    program.use();
+    _program = &program;
+    ++_issued;
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    if(unit >= MaxTextureUnits)
+        throw std::runtime_error("Texture unit out of range");
+
+    TextureBinding& binding = _textures[unit];
+    if(binding.target == target && binding.texture == texture){
+        ++_skipped;
+        return;
+    }
+
+    if(_activeUnit != unit){
+        glActiveTexture(GL_TEXTURE0 + unit);
+        _activeUnit = unit;
+        ++_issued;
+    }
+
+    glBindTexture(target, texture);
+    binding.target = target;
+    binding.texture = texture;
+    ++_issued;
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+    if(_vao == vao){
+        ++_skipped;
+        return;
+    }
+
+    glBindVertexArray(vao);
+    _vao = vao;
+    ++_issued;
+}
+
+void GLState::invalidate() {
+    _program = NULL;
+    _activeUnit = Unknown;
+    forgetTextures();
+    _vao = Unknown;
+}
+
+void GLState::forgetTextures() {
+    for(GLuint unit = 0; unit < MaxTextureUnits; ++unit){
+        _textures[unit].target = GL_NONE;
+        _textures[unit].texture = Unknown;
+    }
+}
+
+unsigned long GLState::callsIssued() const {
+    return _issued;
+}
+
+unsigned long GLState::callsSkipped() const {
+    return _skipped;
+}
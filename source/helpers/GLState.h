@@ -0,0 +1,53 @@
+#include <GL/glew.h>
+
+namespace helpers {
+
+    class Program;
+
+    /**
+     Shadows the GL bindings used while submitting draws and drops calls that
+     would not change anything.
+
+     The cache never queries GL. It assumes it is the only code changing
+     these bindings on the render path; anything that binds behind its back
+     must be followed by `invalidate()`, or `forgetTextures()` if it only
+     bound or deleted textures (TextureStreamer and AssetLoader do that
+     themselves).
+     */
+    class GLState {
+    public:
+        static const GLuint MaxTextureUnits = 16;
+
+        GLState();
+
+        void useProgram(const Program& program);
+        void bindTexture(GLuint unit, GLenum target, GLuint texture);
+        void bindVertexArray(GLuint vao);
+
+        /** Forgets all shadowed state, so the next call of each kind reaches GL. */
+        void invalidate();
+        /** Forgets the texture bindings of every unit, the rest is kept. */
+        void forgetTextures();
+
+        // number of GL calls made and skipped since construction
+        unsigned long callsIssued() const;
+        unsigned long callsSkipped() const;
+
+    private:
+        struct TextureBinding {
+            GLenum target;
+            GLuint texture;
+        };
+
+        const Program* _program;
+        GLuint _activeUnit;
+        TextureBinding _textures[MaxTextureUnits];
+        GLuint _vao;
+        unsigned long _issued;
+        unsigned long _skipped;
+
+        GLState(const GLState&);
+        const GLState& operator=(const GLState&);
+    };
+
+}
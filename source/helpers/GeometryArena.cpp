@@ -0,0 +1,114 @@
+#include "GeometryArena.h"
+#include <stdexcept>
+
+using namespace helpers;
+
+static const GLsizeiptr InitialCapacity = 64 * 1024;
+
+GeometryArena::GeometryArena(GLsizei vertexStride) :
+    _vao(0),
+    _vertexBuffer(0),
+    _indexBuffer(0),
+    _vertexStride(vertexStride),
+    _vertexCount(0),
+    _indexCount(0),
+    _vertexCapacity(0),
+    _indexCapacity(0)
+{
+    if(vertexStride <= 0)
+        throw std::runtime_error("Vertex stride must be positive");
+
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(1, &_vertexBuffer);
+    glGenBuffers(1, &_indexBuffer);
+    if(_vao == 0 || _vertexBuffer == 0 || _indexBuffer == 0)
+        throw std::runtime_error("Failed to create geometry arena buffers");
+
+    // the element buffer binding is VAO state, so it is attached once here
+    glBindVertexArray(_vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+    glBindVertexArray(0);
+}
+
+GeometryArena::~GeometryArena() {
+    if(_vao != 0) glDeleteVertexArrays(1, &_vao);
+    if(_vertexBuffer != 0) glDeleteBuffers(1, &_vertexBuffer);
+    if(_indexBuffer != 0) glDeleteBuffers(1, &_indexBuffer);
+}
+
+GLuint GeometryArena::vao() const {
+    return _vao;
+}
+
+GLuint GeometryArena::vertexBuffer() const {
+    return _vertexBuffer;
+}
+
+GLuint GeometryArena::indexBuffer() const {
+    return _indexBuffer;
+}
+
+GLsizei GeometryArena::vertexStride() const {
+    return _vertexStride;
+}
+
+GLint GeometryArena::vertexCount() const {
+    return _vertexCount;
+}
+
+GLint GeometryArena::indexCount() const {
+    return _indexCount;
+}
+
+GLint GeometryArena::appendVertices(const void* vertices, GLsizei count) {
+    if(!vertices || count <= 0)
+        throw std::runtime_error("No vertices to append");
+
+    GLint first = _vertexCount;
+    _append(_vertexBuffer, _vertexCapacity, (GLsizeiptr)_vertexCount * _vertexStride, vertices, (GLsizeiptr)count * _vertexStride);
+    _vertexCount += count;
+    return first;
+}
+
+GLint GeometryArena::appendIndices(const GLuint* indices, GLsizei count) {
+    if(!indices || count <= 0)
+        throw std::runtime_error("No indices to append");
+
+    GLint first = _indexCount;
+    _append(_indexBuffer, _indexCapacity, (GLsizeiptr)_indexCount * sizeof(GLuint), indices, (GLsizeiptr)count * sizeof(GLuint));
+    _indexCount += count;
+    return first;
+}
+
+void GeometryArena::_append(GLuint buffer, GLsizeiptr& capacity, GLsizeiptr usedBytes, const void* data, GLsizeiptr bytes) {
+    if(usedBytes + bytes > capacity){
+        GLsizeiptr newCapacity = capacity > 0 ? capacity : InitialCapacity;
+        while(newCapacity < usedBytes + bytes)
+            newCapacity *= 2;
+
+        // reallocate under the same name, so VAO attribute pointers survive
+        GLuint scratch = 0;
+        if(usedBytes > 0){
+            glGenBuffers(1, &scratch);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+            glBufferData(GL_COPY_WRITE_BUFFER, usedBytes, NULL, GL_STREAM_COPY);
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, newCapacity, NULL, GL_STATIC_DRAW);
+
+        if(scratch != 0){
+            glBindBuffer(GL_COPY_READ_BUFFER, scratch);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, usedBytes);
+            glDeleteBuffers(1, &scratch);
+        }
+        capacity = newCapacity;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, usedBytes, bytes, data);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
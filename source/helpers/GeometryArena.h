@@ -0,0 +1,60 @@
+#include <GL/glew.h>
+
+namespace helpers {
+
+    /**
+     Vertex and index storage shared by many meshes.
+
+     Every mesh in the arena uses the same vertex format and lives in one
+     vertex buffer and one index buffer behind a single VAO. Meshes are
+     addressed by their first vertex / first index, so any mix of them can be
+     drawn without rebinding, including in one multi-draw call.
+
+     The caller sets up the vertex attributes once on `vao()` with
+     `vertexBuffer()` bound. Growing the arena keeps the buffer names, so
+     those attribute pointers stay valid.
+     */
+    class GeometryArena {
+    public:
+        GeometryArena(GLsizei vertexStride);
+        ~GeometryArena();
+
+        GLuint vao() const;
+        GLuint vertexBuffer() const;
+        GLuint indexBuffer() const;
+        GLsizei vertexStride() const;
+        GLint vertexCount() const;
+        GLint indexCount() const;
+
+        /**
+         Copies `count` vertices of `vertexStride()` bytes each into the arena.
+
+         Returns the index of the first vertex, to be used as the draw's
+         first vertex or base vertex.
+         */
+        GLint appendVertices(const void* vertices, GLsizei count);
+
+        /**
+         Copies `count` 32-bit indices into the arena.
+
+         Returns the position of the first index in the index buffer. Indices
+         are stored as given, relative to whatever base vertex the draw uses.
+         */
+        GLint appendIndices(const GLuint* indices, GLsizei count);
+
+    private:
+        GLuint _vao;
+        GLuint _vertexBuffer;
+        GLuint _indexBuffer;
+        GLsizei _vertexStride;
+        GLint _vertexCount;
+        GLint _indexCount;
+        GLsizeiptr _vertexCapacity;
+        GLsizeiptr _indexCapacity;
+
+        static void _append(GLuint buffer, GLsizeiptr& capacity, GLsizeiptr usedBytes, const void* data, GLsizeiptr bytes);
+        GeometryArena(const GeometryArena&);
+        const GeometryArena& operator=(const GeometryArena&);
+    };
+
+}
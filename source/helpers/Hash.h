@@ -0,0 +1,24 @@
+#include <cstddef>
+#include <stdint.h>
+
+namespace helpers {
+
+    const uint64_t HashSeed = 14695981039346656037ull;
+
+    /**
+     64-bit FNV-1a hash of a block of bytes.
+
+     Pass the result of a previous call as `seed` to hash several blocks as
+     if they were one. Fast and good enough for cache keys, not for security.
+     */
+    inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = HashSeed) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        uint64_t hash = seed;
+        for(size_t i = 0; i < size; ++i){
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+}
@@ -0,0 +1,169 @@
+#include "InstanceStore.h"
+#include <stdexcept>
+
+using namespace helpers;
+
+InstanceStore::InstanceStore() :
+    _treeStale(false),
+    _hiddenCount(0)
+{
+}
+
+InstanceStore::Handle InstanceStore::add(unsigned asset, int material, const BoundingBox& localBounds,
+                                         const glm::mat4& transform, unsigned flags) {
+    unsigned slot;
+    if(_freeSlots.empty()){
+        slot = (unsigned)_slotIndices.size();
+        _slotIndices.push_back(0);
+        _slotGenerations.push_back(0);
+    } else {
+        slot = _freeSlots.back();
+        _freeSlots.pop_back();
+    }
+    _slotIndices[slot] = (unsigned)_slots.size();
+
+    _transforms.push_back(transform);
+    _localBounds.push_back(localBounds);
+    _worldBounds.push_back(localBounds.transformed(transform));
+    _assets.push_back(asset);
+    _materials.push_back(material);
+    _flags.push_back(flags);
+    _slots.push_back(slot);
+    if(flags & Flag_Hidden)
+        ++_hiddenCount;
+
+    _treeStale = true;
+    return Handle(slot, _slotGenerations[slot]);
+}
+
+void InstanceStore::remove(Handle instance) {
+    unsigned index = _checkedIndex(instance);
+    unsigned last = (unsigned)_slots.size() - 1;
+    if(_flags[index] & Flag_Hidden)
+        --_hiddenCount;
+
+    // the last instance fills the hole, so the columns stay packed
+    if(index != last){
+        _transforms[index] = _transforms[last];
+        _localBounds[index] = _localBounds[last];
+        _worldBounds[index] = _worldBounds[last];
+        _assets[index] = _assets[last];
+        _materials[index] = _materials[last];
+        _flags[index] = _flags[last];
+        _slots[index] = _slots[last];
+        _slotIndices[_slots[index]] = index;
+    }
+    _transforms.pop_back();
+    _localBounds.pop_back();
+    _worldBounds.pop_back();
+    _assets.pop_back();
+    _materials.pop_back();
+    _flags.pop_back();
+    _slots.pop_back();
+
+    ++_slotGenerations[instance.slot];
+    _freeSlots.push_back(instance.slot);
+    _treeStale = true;
+}
+
+void InstanceStore::clear() {
+    while(!_slots.empty())
+        remove(handle(_slots.size() - 1));
+}
+
+bool InstanceStore::contains(Handle instance) const {
+    return instance.slot < _slotGenerations.size() && _slotGenerations[instance.slot] == instance.generation &&
+           _slotIndices[instance.slot] < _slots.size() && _slots[_slotIndices[instance.slot]] == instance.slot;
+}
+
+size_t InstanceStore::index(Handle instance) const {
+    return _checkedIndex(instance);
+}
+
+InstanceStore::Handle InstanceStore::handle(size_t index) const {
+    if(index >= _slots.size())
+        throw std::runtime_error("Instance index out of range");
+    return Handle(_slots[index], _slotGenerations[_slots[index]]);
+}
+
+size_t InstanceStore::size() const {
+    return _slots.size();
+}
+
+void InstanceStore::setTransform(Handle instance, const glm::mat4& transform) {
+    unsigned index = _checkedIndex(instance);
+    _transforms[index] = transform;
+    _worldBounds[index] = _localBounds[index].transformed(transform);
+    if(!_treeStale)
+        _tree.update(index, _worldBounds[index]);
+}
+
+void InstanceStore::setFlags(Handle instance, unsigned flags) {
+    unsigned index = _checkedIndex(instance);
+    if(_flags[index] & Flag_Hidden)
+        --_hiddenCount;
+    if(flags & Flag_Hidden)
+        ++_hiddenCount;
+    _flags[index] = flags;
+}
+
+const std::vector<glm::mat4>& InstanceStore::transforms() const {
+    return _transforms;
+}
+
+const std::vector<BoundingBox>& InstanceStore::worldBounds() const {
+    return _worldBounds;
+}
+
+const std::vector<unsigned>& InstanceStore::assets() const {
+    return _assets;
+}
+
+const std::vector<int>& InstanceStore::materials() const {
+    return _materials;
+}
+
+const std::vector<unsigned>& InstanceStore::flags() const {
+    return _flags;
+}
+
+size_t InstanceStore::cull(const Frustum& frustum, std::vector<unsigned>& visible) {
+    _updateTree();
+    size_t before = visible.size();
+    _tree.cull(frustum, visible);
+
+    if(_hiddenCount > 0){
+        size_t kept = before;
+        for(size_t i = before; i < visible.size(); ++i)
+            if(!(_flags[visible[i]] & Flag_Hidden))
+                visible[kept++] = visible[i];
+        visible.resize(kept);
+    }
+    return visible.size() - before;
+}
+
+bool InstanceStore::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                            unsigned& index, float& distance) {
+    _updateTree();
+    if(_hiddenCount == 0)
+        return _tree.raycast(origin, direction, maxDistance, index, distance);
+
+    const std::vector<unsigned>& flags = _flags;
+    return _tree.raycast(origin, direction, maxDistance, index, distance,
+                         [&flags](unsigned item) { return !(flags[item] & Flag_Hidden); });
+}
+
+unsigned InstanceStore::_checkedIndex(Handle instance) const {
+    if(!contains(instance))
+        throw std::runtime_error("Instance handle is not in the store");
+    return _slotIndices[instance.slot];
+}
+
+void InstanceStore::_updateTree() {
+    if(_treeStale){
+        _tree.build(_worldBounds);
+        _treeStale = false;
+    } else {
+        _tree.refit();
+    }
+}
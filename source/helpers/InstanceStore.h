@@ -0,0 +1,94 @@
+#include "BoundingVolumeHierarchy.h"
+#include <vector>
+#include <cstddef>
+
+namespace helpers {
+
+    /**
+     Scene instances kept as parallel arrays, one per attribute.
+
+     Instance i of every column belongs together, and the columns are
+     always packed: removing an instance moves the last one into its
+     place. Dense indices therefore change on `remove`. Hold on to a
+     `Handle` instead, it stays valid until its instance is removed.
+
+     World bounds are kept up to date from each instance's local bounds and
+     transform. The store also owns a BoundingVolumeHierarchy over them
+     for `cull` and `raycast`. The tree is refitted after transform changes
+     and rebuilt after adds and removes, lazily on the next query.
+     */
+    class InstanceStore {
+    public:
+        struct Handle {
+            unsigned slot;
+            unsigned generation;
+            Handle() : slot(~0u), generation(0) {}
+            Handle(unsigned s, unsigned g) : slot(s), generation(g) {}
+            bool isValid() const { return slot != ~0u; }
+        };
+
+        enum Flags {
+            Flag_Hidden = 1 // left out by `cull` and `raycast`
+        };
+
+        InstanceStore();
+
+        Handle add(unsigned asset, int material, const BoundingBox& localBounds, const glm::mat4& transform, unsigned flags = 0);
+        // throws for handles that are not in the store
+        void remove(Handle instance);
+        void clear();
+
+        bool contains(Handle instance) const;
+        // current dense index, valid until the next remove
+        size_t index(Handle instance) const;
+        Handle handle(size_t index) const;
+        size_t size() const;
+
+        void setTransform(Handle instance, const glm::mat4& transform);
+        void setFlags(Handle instance, unsigned flags);
+
+        // the columns, all size() long
+        const std::vector<glm::mat4>& transforms() const;
+        const std::vector<BoundingBox>& worldBounds() const;
+        const std::vector<unsigned>& assets() const;
+        const std::vector<int>& materials() const;
+        const std::vector<unsigned>& flags() const;
+
+        /**
+         Appends the dense indices of the instances that intersect
+         `frustum` to `visible`, in no particular order.
+
+         Returns how many were appended.
+         */
+        size_t cull(const Frustum& frustum, std::vector<unsigned>& visible);
+
+        /** Dense index of the nearest instance hit by the ray, see BoundingVolumeHierarchy::raycast */
+        bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+                     unsigned& index, float& distance);
+
+    private:
+        std::vector<glm::mat4> _transforms;
+        std::vector<BoundingBox> _localBounds;
+        std::vector<BoundingBox> _worldBounds;
+        std::vector<unsigned> _assets;
+        std::vector<int> _materials;
+        std::vector<unsigned> _flags;
+        std::vector<unsigned> _slots; // dense index -> slot
+
+        // by slot: dense index while in use, generation bumped on remove
+        std::vector<unsigned> _slotIndices;
+        std::vector<unsigned> _slotGenerations;
+        std::vector<unsigned> _freeSlots;
+
+        BoundingVolumeHierarchy _tree; // items are dense indices
+        bool _treeStale;
+        size_t _hiddenCount;
+
+        unsigned _checkedIndex(Handle instance) const;
+        void _updateTree();
+
+        InstanceStore(const InstanceStore&);
+        const InstanceStore& operator=(const InstanceStore&);
+    };
+
+}
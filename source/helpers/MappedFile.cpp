@@ -0,0 +1,89 @@
+#include "MappedFile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace helpers;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filePath) :
+    _data(NULL),
+    _size(0),
+    _file(INVALID_HANDLE_VALUE),
+    _mapping(NULL)
+{
+    _file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(_file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Failed to open file: " + filePath);
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(_file, &size) || size.QuadPart == 0){
+        CloseHandle(_file);
+        throw std::runtime_error("Failed to map empty file: " + filePath);
+    }
+    _size = (size_t)size.QuadPart;
+
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(_mapping)
+        _data = (const unsigned char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!_data){
+        if(_mapping)
+            CloseHandle(_mapping);
+        CloseHandle(_file);
+        throw std::runtime_error("Failed to map file: " + filePath);
+    }
+}
+
+MappedFile::~MappedFile() {
+    UnmapViewOfFile(_data);
+    CloseHandle(_mapping);
+    CloseHandle(_file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filePath) :
+    _data(NULL),
+    _size(0)
+{
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("Failed to open file: " + filePath);
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0){
+        close(fd);
+        throw std::runtime_error("Failed to map empty file: " + filePath);
+    }
+    _size = (size_t)info.st_size;
+
+    void* mapping = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if(mapping == MAP_FAILED)
+        throw std::runtime_error("Failed to map file: " + filePath);
+    _data = (const unsigned char*)mapping;
+}
+
+MappedFile::~MappedFile() {
+    munmap((void*)_data, _size);
+}
+
+#endif
+
+const unsigned char* MappedFile::data() const {
+    return _data;
+}
+
+size_t MappedFile::size() const {
+    return _size;
+}
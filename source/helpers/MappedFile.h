@@ -0,0 +1,33 @@
+#include <string>
+#include <cstddef>
+
+namespace helpers {
+
+    /**
+     Read-only memory mapping of a whole file.
+
+     The pages are loaded by the OS on first touch, so opening is cheap
+     and nothing is copied into the process until it is read.
+     */
+    class MappedFile {
+    public:
+        /** Maps the file, throws if it can't be opened or mapped */
+        explicit MappedFile(const std::string& filePath);
+        ~MappedFile();
+
+        const unsigned char* data() const;
+        size_t size() const;
+
+    private:
+        const unsigned char* _data;
+        size_t _size;
+#ifdef _WIN32
+        void* _file;
+        void* _mapping;
+#endif
+
+        MappedFile(const MappedFile&);
+        const MappedFile& operator=(const MappedFile&);
+    };
+
+}
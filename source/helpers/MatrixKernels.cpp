@@ -0,0 +1,212 @@
+#include "MatrixKernels.h"
+#include "CpuFeatures.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+#if HELPERS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace helpers;
+
+// batches below this stay on the calling thread, larger ones go to the pool in chunks of this size
+static const size_t ParallelMatrices = 4096;
+
+// the strided arrays of one InstanceMatrices call
+struct MatrixArrays {
+    const char* models;
+    size_t modelStride;
+    char* modelViewProjections; // NULL to skip
+    size_t modelViewProjectionStride;
+    char* normalMatrices; // NULL to skip
+    size_t normalMatrixStride;
+};
+
+typedef void (*MatrixFunc)(const glm::mat4& viewProjection, const MatrixArrays& a, size_t first, size_t count);
+
+static const float* Model(const MatrixArrays& a, size_t i) {
+    return reinterpret_cast<const float*>(a.models + i * a.modelStride);
+}
+
+static float* ModelViewProjection(const MatrixArrays& a, size_t i) {
+    return reinterpret_cast<float*>(a.modelViewProjections + i * a.modelViewProjectionStride);
+}
+
+static float* NormalMatrix(const MatrixArrays& a, size_t i) {
+    return reinterpret_cast<float*>(a.normalMatrices + i * a.normalMatrixStride);
+}
+
+static void InstanceMatrices_Scalar(const glm::mat4& viewProjection, const MatrixArrays& a, size_t first, size_t count) {
+    for(size_t i = first; i < first + count; ++i){
+        const glm::mat4& model = *reinterpret_cast<const glm::mat4*>(Model(a, i));
+        if(a.modelViewProjections)
+            *reinterpret_cast<glm::mat4*>(ModelViewProjection(a, i)) = viewProjection * model;
+        if(a.normalMatrices){
+            // rows of inverse(m) are the cross products of its columns over det(m),
+            // so they are the columns of the transposed inverse
+            glm::vec3 x(model[0]), y(model[1]), z(model[2]);
+            glm::vec3 yz = glm::cross(y, z);
+            float invDet = 1.0f / glm::dot(x, yz);
+            *reinterpret_cast<glm::mat3*>(NormalMatrix(a, i)) =
+                glm::mat3(yz * invDet, glm::cross(z, x) * invDet, glm::cross(x, y) * invDet);
+        }
+    }
+}
+
+#if HELPERS_X86_SIMD
+
+// the 9 floats of a mat3 from its columns in the xyz lanes; each column store's
+// fourth float is overwritten by the next column, the last one is stored as 2 + 1
+HELPERS_TARGET("sse2")
+static void StoreMat3_SSE2(float* out, __m128 c0, __m128 c1, __m128 c2) {
+    _mm_storeu_ps(out, c0);
+    _mm_storeu_ps(out + 3, c1);
+    _mm_storel_pi(reinterpret_cast<__m64*>(out + 6), c2);
+    _mm_store_ss(out + 8, _mm_movehl_ps(c2, c2));
+}
+
+// cross product of the xyz lanes, w is junk
+HELPERS_TARGET("sse2")
+static __m128 Cross_SSE2(__m128 a, __m128 b) {
+    __m128 t = _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1))),
+                          _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), b));
+    return _mm_shuffle_ps(t, t, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+HELPERS_TARGET("sse2")
+static void NormalMatrix_SSE2(const float* model, float* out) {
+    __m128 x = _mm_loadu_ps(model);
+    __m128 y = _mm_loadu_ps(model + 4);
+    __m128 z = _mm_loadu_ps(model + 8);
+    __m128 yz = Cross_SSE2(y, z);
+    __m128 p = _mm_mul_ps(x, yz);
+    __m128 det = _mm_add_ps(_mm_add_ps(_mm_shuffle_ps(p, p, 0x00), _mm_shuffle_ps(p, p, 0x55)), _mm_shuffle_ps(p, p, 0xAA));
+    __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+    StoreMat3_SSE2(out, _mm_mul_ps(yz, invDet), _mm_mul_ps(Cross_SSE2(z, x), invDet), _mm_mul_ps(Cross_SSE2(x, y), invDet));
+}
+
+HELPERS_TARGET("sse2")
+static void InstanceMatrices_SSE2(const glm::mat4& viewProjection, const MatrixArrays& a, size_t first, size_t count) {
+    const float* vp = &viewProjection[0][0];
+    const __m128 vp0 = _mm_loadu_ps(vp);
+    const __m128 vp1 = _mm_loadu_ps(vp + 4);
+    const __m128 vp2 = _mm_loadu_ps(vp + 8);
+    const __m128 vp3 = _mm_loadu_ps(vp + 12);
+
+    for(size_t i = first; i < first + count; ++i){
+        const float* model = Model(a, i);
+        if(a.modelViewProjections){
+            // each column of the result is viewProjection times that column of the model
+            float* out = ModelViewProjection(a, i);
+            for(int column = 0; column < 4; ++column){
+                __m128 c = _mm_loadu_ps(model + 4 * column);
+                __m128 r = _mm_mul_ps(vp0, _mm_shuffle_ps(c, c, 0x00));
+                r = _mm_add_ps(r, _mm_mul_ps(vp1, _mm_shuffle_ps(c, c, 0x55)));
+                r = _mm_add_ps(r, _mm_mul_ps(vp2, _mm_shuffle_ps(c, c, 0xAA)));
+                r = _mm_add_ps(r, _mm_mul_ps(vp3, _mm_shuffle_ps(c, c, 0xFF)));
+                _mm_storeu_ps(out + 4 * column, r);
+            }
+        }
+        if(a.normalMatrices)
+            NormalMatrix_SSE2(model, NormalMatrix(a, i));
+    }
+}
+
+HELPERS_TARGET("avx2")
+static __m256 LoadPair_AVX2(const float* low, const float* high) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(low)), _mm_loadu_ps(high), 1);
+}
+
+HELPERS_TARGET("avx2")
+static __m256 Cross_AVX2(__m256 a, __m256 b) {
+    __m256 t = _mm256_sub_ps(_mm256_mul_ps(a, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1))),
+                             _mm256_mul_ps(_mm256_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), b));
+    return _mm256_shuffle_ps(t, t, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+HELPERS_TARGET("avx2")
+static void InstanceMatrices_AVX2(const glm::mat4& viewProjection, const MatrixArrays& a, size_t first, size_t count) {
+    // viewProjection's columns in both halves; a model's columns go two at a time, one per half
+    const float* vp = &viewProjection[0][0];
+    const __m256 vp0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(vp));
+    const __m256 vp1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(vp + 4));
+    const __m256 vp2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(vp + 8));
+    const __m256 vp3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(vp + 12));
+
+    if(a.modelViewProjections){
+        for(size_t i = first; i < first + count; ++i){
+            const float* model = Model(a, i);
+            float* out = ModelViewProjection(a, i);
+            for(int columns = 0; columns < 2; ++columns){
+                __m256 c = _mm256_loadu_ps(model + 8 * columns);
+                __m256 r = _mm256_mul_ps(vp0, _mm256_shuffle_ps(c, c, 0x00));
+                r = _mm256_add_ps(r, _mm256_mul_ps(vp1, _mm256_shuffle_ps(c, c, 0x55)));
+                r = _mm256_add_ps(r, _mm256_mul_ps(vp2, _mm256_shuffle_ps(c, c, 0xAA)));
+                r = _mm256_add_ps(r, _mm256_mul_ps(vp3, _mm256_shuffle_ps(c, c, 0xFF)));
+                _mm256_storeu_ps(out + 8 * columns, r);
+            }
+        }
+    }
+
+    if(a.normalMatrices){
+        // two models at a time, one per half
+        size_t i = first;
+        for(; i + 2 <= first + count; i += 2){
+            const float* m0 = Model(a, i);
+            const float* m1 = Model(a, i + 1);
+            __m256 x = LoadPair_AVX2(m0, m1);
+            __m256 y = LoadPair_AVX2(m0 + 4, m1 + 4);
+            __m256 z = LoadPair_AVX2(m0 + 8, m1 + 8);
+            __m256 yz = Cross_AVX2(y, z);
+            __m256 p = _mm256_mul_ps(x, yz);
+            __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_shuffle_ps(p, p, 0x00), _mm256_shuffle_ps(p, p, 0x55)),
+                                       _mm256_shuffle_ps(p, p, 0xAA));
+            __m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+            __m256 n0 = _mm256_mul_ps(yz, invDet);
+            __m256 n1 = _mm256_mul_ps(Cross_AVX2(z, x), invDet);
+            __m256 n2 = _mm256_mul_ps(Cross_AVX2(x, y), invDet);
+            StoreMat3_SSE2(NormalMatrix(a, i), _mm256_castps256_ps128(n0), _mm256_castps256_ps128(n1), _mm256_castps256_ps128(n2));
+            StoreMat3_SSE2(NormalMatrix(a, i + 1), _mm256_extractf128_ps(n0, 1), _mm256_extractf128_ps(n1, 1),
+                           _mm256_extractf128_ps(n2, 1));
+        }
+        if(i < first + count)
+            NormalMatrix_SSE2(Model(a, i), NormalMatrix(a, i));
+    }
+}
+
+#endif
+
+static MatrixFunc MatrixKernel() {
+#if HELPERS_X86_SIMD
+    const CpuFeatures& cpu = CpuFeatures::current();
+    if(cpu.avx2) return InstanceMatrices_AVX2;
+    if(cpu.sse2) return InstanceMatrices_SSE2;
+#endif
+    return InstanceMatrices_Scalar;
+}
+
+void helpers::InstanceMatrices(const glm::mat4& viewProjection,
+                               const glm::mat4* models, size_t modelStride,
+                               glm::mat4* modelViewProjections, size_t modelViewProjectionStride,
+                               glm::mat3* normalMatrices, size_t normalMatrixStride,
+                               size_t count) {
+    static const MatrixFunc kernel = MatrixKernel();
+
+    MatrixArrays a;
+    a.models = reinterpret_cast<const char*>(models);
+    a.modelStride = modelStride;
+    a.modelViewProjections = reinterpret_cast<char*>(modelViewProjections);
+    a.modelViewProjectionStride = modelViewProjectionStride;
+    a.normalMatrices = reinterpret_cast<char*>(normalMatrices);
+    a.normalMatrixStride = normalMatrixStride;
+
+    if(count < ParallelMatrices){
+        kernel(viewProjection, a, 0, count);
+        return;
+    }
+    size_t tasks = (count + ParallelMatrices - 1) / ParallelMatrices;
+    ThreadPool::shared().parallelFor(tasks, [&](size_t task) {
+        size_t chunkFirst = task * ParallelMatrices;
+        kernel(viewProjection, a, chunkFirst, std::min(ParallelMatrices, count - chunkFirst));
+    });
+}
@@ -0,0 +1,33 @@
+#include <glm/glm.hpp>
+#include <cstddef>
+
+namespace helpers {
+
+    /**
+     Per-instance matrices for a whole draw list at once.
+
+     For every model matrix M[i] this writes
+
+         modelViewProjections[i] = viewProjection * M[i]
+         normalMatrices[i] = transpose(inverse(mat3(M[i])))
+
+     so the vertex shader only has to load them. The normal matrix is
+     computed from cross products of the columns of mat3(M[i]) divided by
+     its determinant, which is the same matrix without a general inverse.
+     Degenerate (zero scale) models give non-finite normal matrices, as
+     glm::inverse does.
+
+     Strides are in bytes between consecutive elements, so the inputs and
+     outputs can be members of one interleaved struct such as an instance
+     buffer. Either output may be NULL to skip it.
+
+     Runs on AVX2 or SSE2 when the CPU has them, and splits large batches
+     over ThreadPool::shared().
+     */
+    void InstanceMatrices(const glm::mat4& viewProjection,
+                          const glm::mat4* models, size_t modelStride,
+                          glm::mat4* modelViewProjections, size_t modelViewProjectionStride,
+                          glm::mat3* normalMatrices, size_t normalMatrixStride,
+                          size_t count);
+
+}
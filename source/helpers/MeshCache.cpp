@@ -0,0 +1,91 @@
+#include "MeshCache.h"
+#include "VertexCacheOptimizer.h"
+#include "Hash.h"
+#include <cstring>
+#include <stdexcept>
+
+using namespace helpers;
+
+MeshCache::MeshCache(GeometryArena& arena) :
+    _arena(arena)
+{
+    std::memset(&_stats, 0, sizeof(_stats));
+}
+
+MeshCache::Mesh MeshCache::mesh(const void* vertices, GLsizei vertexCount) {
+    if(vertexCount <= 0 || vertexCount % 3 != 0)
+        throw std::runtime_error("Mesh must be a non-empty triangle list");
+
+    ++_stats.meshesRequested;
+
+    const size_t stride = (size_t)_arena.vertexStride();
+    const size_t bytes = stride * vertexCount;
+    const unsigned char* source = (const unsigned char*)vertices;
+    uint64_t hash = HashBytes(source, bytes);
+
+    typedef std::unordered_multimap<uint64_t, size_t>::const_iterator Iterator;
+    std::pair<Iterator, Iterator> range = _meshesByHash.equal_range(hash);
+    for(Iterator it = range.first; it != range.second; ++it){
+        const std::vector<unsigned char>& cached = _sources[it->second];
+        if(cached.size() == bytes && std::memcmp(&cached[0], source, bytes) == 0)
+            return _meshes[it->second];
+    }
+
+    // weld identical vertices
+    std::vector<GLuint> indices(vertexCount);
+    std::vector<unsigned char> unique;
+    unique.reserve(bytes);
+    std::unordered_multimap<uint64_t, GLuint> vertexByHash;
+    GLuint uniqueCount = 0;
+    for(GLsizei i = 0; i < vertexCount; ++i){
+        const unsigned char* vertex = source + i * stride;
+        uint64_t vertexHash = HashBytes(vertex, stride);
+
+        GLuint index = uniqueCount;
+        typedef std::unordered_multimap<uint64_t, GLuint>::const_iterator VertexIterator;
+        std::pair<VertexIterator, VertexIterator> matches = vertexByHash.equal_range(vertexHash);
+        for(VertexIterator it = matches.first; it != matches.second; ++it){
+            if(std::memcmp(&unique[it->second * stride], vertex, stride) == 0){
+                index = it->second;
+                break;
+            }
+        }
+
+        if(index == uniqueCount){
+            unique.insert(unique.end(), vertex, vertex + stride);
+            vertexByHash.insert(std::make_pair(vertexHash, uniqueCount));
+            ++uniqueCount;
+        }
+        indices[i] = index;
+    }
+
+    OptimizeVertexCache(&indices[0], indices.size(), uniqueCount);
+
+    _stats.sourceVertices += vertexCount;
+    _stats.uniqueVertices += uniqueCount;
+    _stats.invocationsBefore += vertexCount;
+    _stats.invocationsAfter += SimulateVertexCacheMisses(&indices[0], indices.size(), uniqueCount, SimulatedCacheSize);
+    ++_stats.meshesUploaded;
+
+    Mesh mesh;
+    mesh.id = (GLuint)_meshes.size();
+    mesh.firstVertex = _arena.appendVertices(&unique[0], (GLsizei)uniqueCount);
+    mesh.vertexCount = (GLsizei)uniqueCount;
+    for(size_t i = 0; i < indices.size(); ++i)
+        indices[i] += mesh.firstVertex;
+    mesh.firstIndex = _arena.appendIndices(&indices[0], (GLsizei)indices.size());
+    mesh.indexCount = (GLsizei)indices.size();
+
+    _meshesByHash.insert(std::make_pair(hash, _meshes.size()));
+    _sources.push_back(std::vector<unsigned char>(source, source + bytes));
+    _meshes.push_back(mesh);
+    return _meshes.back();
+}
+
+const MeshCache::Stats& MeshCache::stats() const {
+    return _stats;
+}
+
+GeometryArena& MeshCache::arena() const {
+    return _arena;
+}
@@ -0,0 +1,66 @@
+#include "GeometryArena.h"
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <stdint.h>
+
+namespace helpers {
+
+    /**
+     Uploads meshes into a GeometryArena once per distinct content.
+
+     Meshes are given as plain (non-indexed) triangle lists in the arena's
+     vertex format. Each one is hashed; a mesh that was seen before returns
+     the existing entry without touching the GPU. New meshes are welded into
+     indexed form and their triangles are reordered for the post-transform
+     vertex cache before they are appended to the arena.
+
+     Indices are stored already offset by the mesh's first vertex, so draws
+     use a base vertex of 0.
+     */
+    class MeshCache {
+    public:
+        struct Mesh {
+            GLuint id;          // small dense id, same content -> same id
+            GLint firstIndex;   // in the arena's index buffer
+            GLsizei indexCount;
+            GLint firstVertex;
+            GLsizei vertexCount;
+        };
+
+        struct Stats {
+            unsigned meshesRequested;
+            unsigned meshesUploaded;
+            size_t sourceVertices;      // vertices passed in for uploaded meshes
+            size_t uniqueVertices;      // after welding
+            size_t invocationsBefore;   // vertex shader runs of the non-indexed draw
+            size_t invocationsAfter;    // simulated runs of the optimized indexed draw
+        };
+
+        // FIFO size assumed when estimating vertex shader invocations
+        static const unsigned SimulatedCacheSize = 16;
+
+        MeshCache(GeometryArena& arena);
+
+        /**
+         Returns the cached mesh for `vertexCount` vertices of triangle list,
+         uploading it first if this content has not been seen yet.
+         */
+        Mesh mesh(const void* vertices, GLsizei vertexCount);
+
+        const Stats& stats() const;
+        GeometryArena& arena() const;
+
+    private:
+        GeometryArena& _arena;
+        std::vector<Mesh> _meshes;
+        std::unordered_multimap<uint64_t, size_t> _meshesByHash;
+        // source bytes of each mesh, to rule out hash collisions
+        std::vector<std::vector<unsigned char> > _sources;
+        Stats _stats;
+
+        MeshCache(const MeshCache&);
+        const MeshCache& operator=(const MeshCache&);
+    };
+
+}
@@ -0,0 +1,220 @@
+#include "PixelConversion.h"
+#include "CpuFeatures.h"
+#include <stdexcept>
+
+#if HELPERS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+using namespace helpers;
+
+// (r + g + b) / 3 without a division, exact for every sum up to 765
+static inline unsigned char AverageRGB(const unsigned char* rgb) {
+    unsigned sum = rgb[0] + rgb[1] + rgb[2];
+    return (unsigned char)((sum * 43691u) >> 17);
+}
+
+// scalar kernels, also finish the tails of the SIMD ones
+
+static void Grayscale2GrayscaleAlpha(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 1, dest += 2){
+        dest[0] = src[0];
+        dest[1] = 255;
+    }
+}
+
+static void Grayscale2RGB(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 1, dest += 3){
+        dest[0] = src[0];
+        dest[1] = src[0];
+        dest[2] = src[0];
+    }
+}
+
+static void Grayscale2RGBA(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 1, dest += 4){
+        dest[0] = src[0];
+        dest[1] = src[0];
+        dest[2] = src[0];
+        dest[3] = 255;
+    }
+}
+
+static void GrayscaleAlpha2Grayscale(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 2, dest += 1)
+        dest[0] = src[0];
+}
+
+static void GrayscaleAlpha2RGB(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 2, dest += 3){
+        dest[0] = src[0];
+        dest[1] = src[0];
+        dest[2] = src[0];
+    }
+}
+
+static void GrayscaleAlpha2RGBA(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 2, dest += 4){
+        dest[0] = src[0];
+        dest[1] = src[0];
+        dest[2] = src[0];
+        dest[3] = src[1];
+    }
+}
+
+static void RGB2Grayscale(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 3, dest += 1)
+        dest[0] = AverageRGB(src);
+}
+
+static void RGB2GrayscaleAlpha(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 3, dest += 2){
+        dest[0] = AverageRGB(src);
+        dest[1] = 255;
+    }
+}
+
+static void RGB2RGBA(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 3, dest += 4){
+        dest[0] = src[0];
+        dest[1] = src[1];
+        dest[2] = src[2];
+        dest[3] = 255;
+    }
+}
+
+static void RGBA2Grayscale(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 4, dest += 1)
+        dest[0] = AverageRGB(src);
+}
+
+static void RGBA2GrayscaleAlpha(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 4, dest += 2){
+        dest[0] = AverageRGB(src);
+        dest[1] = src[3];
+    }
+}
+
+static void RGBA2RGB(const unsigned char* src, unsigned char* dest, unsigned count){
+    for(unsigned i = 0; i < count; ++i, src += 4, dest += 3){
+        dest[0] = src[0];
+        dest[1] = src[1];
+        dest[2] = src[2];
+    }
+}
+
+#if HELPERS_X86_SIMD
+
+// SSE2 has no byte shuffle, the RGB kernels need SSSE3's pshufb
+
+HELPERS_TARGET("sse2")
+static void Grayscale2RGBA_SSE2(const unsigned char* src, unsigned char* dest, unsigned count){
+    const __m128i opaque = _mm_set1_epi8((char)0xFF);
+    unsigned i = 0;
+    for(; i + 16 <= count; i += 16){
+        __m128i gray = _mm_loadu_si128((const __m128i*)(src + i));
+        // (g, g) and (g, 255) pairs interleave into g g g 255
+        __m128i grayGrayLo = _mm_unpacklo_epi8(gray, gray);
+        __m128i grayGrayHi = _mm_unpackhi_epi8(gray, gray);
+        __m128i grayAlphaLo = _mm_unpacklo_epi8(gray, opaque);
+        __m128i grayAlphaHi = _mm_unpackhi_epi8(gray, opaque);
+        __m128i* out = (__m128i*)(dest + i*4);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(grayGrayLo, grayAlphaLo));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(grayGrayLo, grayAlphaLo));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(grayGrayHi, grayAlphaHi));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(grayGrayHi, grayAlphaHi));
+    }
+    Grayscale2RGBA(src + i, dest + i*4, count - i);
+}
+
+HELPERS_TARGET("ssse3")
+static void RGB2RGBA_SSSE3(const unsigned char* src, unsigned char* dest, unsigned count){
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+    unsigned i = 0;
+    // 4 pixels per step, the 16-byte load reads 4 bytes past them
+    for(; i + 6 <= count; i += 4){
+        __m128i rgb = _mm_loadu_si128((const __m128i*)(src + i*3));
+        __m128i rgba = _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), opaque);
+        _mm_storeu_si128((__m128i*)(dest + i*4), rgba);
+    }
+    RGB2RGBA(src + i*3, dest + i*4, count - i);
+}
+
+HELPERS_TARGET("ssse3")
+static void RGBA2RGB_SSSE3(const unsigned char* src, unsigned char* dest, unsigned count){
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    unsigned i = 0;
+    // 4 pixels per step, the 16-byte store writes 4 bytes the next step overwrites
+    for(; i + 6 <= count; i += 4){
+        __m128i rgba = _mm_loadu_si128((const __m128i*)(src + i*4));
+        _mm_storeu_si128((__m128i*)(dest + i*3), _mm_shuffle_epi8(rgba, shuffle));
+    }
+    RGBA2RGB(src + i*4, dest + i*3, count - i);
+}
+
+HELPERS_TARGET("avx2")
+static void RGB2RGBA_AVX2(const unsigned char* src, unsigned char* dest, unsigned count){
+    // vpshufb works per 128-bit lane, so each lane gets its own 4 source pixels
+    const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                             0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i opaque = _mm256_set1_epi32((int)0xFF000000);
+    unsigned i = 0;
+    // 8 pixels per step, the upper load reads 4 bytes past them
+    for(; i + 10 <= count; i += 8){
+        __m128i lo = _mm_loadu_si128((const __m128i*)(src + i*3));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(src + i*3 + 12));
+        __m256i rgb = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        __m256i rgba = _mm256_or_si256(_mm256_shuffle_epi8(rgb, shuffle), opaque);
+        _mm256_storeu_si256((__m256i*)(dest + i*4), rgba);
+    }
+    RGB2RGBA_SSSE3(src + i*3, dest + i*4, count - i);
+}
+
+HELPERS_TARGET("avx2")
+static void RGBA2RGB_AVX2(const unsigned char* src, unsigned char* dest, unsigned count){
+    const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                             0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    unsigned i = 0;
+    // 8 pixels per step; each lane's 16-byte store has 4 bytes of padding the next store overwrites
+    for(; i + 10 <= count; i += 8){
+        __m256i rgba = _mm256_loadu_si256((const __m256i*)(src + i*4));
+        __m256i rgb = _mm256_shuffle_epi8(rgba, shuffle);
+        _mm_storeu_si128((__m128i*)(dest + i*3), _mm256_castsi256_si128(rgb));
+        _mm_storeu_si128((__m128i*)(dest + i*3 + 12), _mm256_extracti128_si256(rgb, 1));
+    }
+    RGBA2RGB_SSSE3(src + i*4, dest + i*3, count - i);
+}
+
+#endif
+
+RowConverterFunc helpers::RowConverterForChannels(unsigned srcChannels, unsigned destChannels) {
+    if(srcChannels == destChannels)
+        throw std::runtime_error("Just use memcpy if pixel formats are the same");
+    if(srcChannels < 1 || srcChannels > 4 || destChannels < 1 || destChannels > 4)
+        throw std::runtime_error("Unhandled bitmap format");
+
+    // [src - 1][dest - 1]
+    static const RowConverterFunc scalar[4][4] = {
+        { NULL,                     Grayscale2GrayscaleAlpha, Grayscale2RGB,      Grayscale2RGBA },
+        { GrayscaleAlpha2Grayscale, NULL,                     GrayscaleAlpha2RGB, GrayscaleAlpha2RGBA },
+        { RGB2Grayscale,            RGB2GrayscaleAlpha,       NULL,               RGB2RGBA },
+        { RGBA2Grayscale,           RGBA2GrayscaleAlpha,      RGBA2RGB,           NULL }
+    };
+
+#if HELPERS_X86_SIMD
+    const CpuFeatures& cpu = CpuFeatures::current();
+    if(srcChannels == 3 && destChannels == 4){
+        if(cpu.avx2) return RGB2RGBA_AVX2;
+        if(cpu.ssse3) return RGB2RGBA_SSSE3;
+    }
+    if(srcChannels == 4 && destChannels == 3){
+        if(cpu.avx2) return RGBA2RGB_AVX2;
+        if(cpu.ssse3) return RGBA2RGB_SSSE3;
+    }
+    if(srcChannels == 1 && destChannels == 4 && cpu.sse2)
+        return Grayscale2RGBA_SSE2;
+#endif
+
+    return scalar[srcChannels - 1][destChannels - 1];
+}
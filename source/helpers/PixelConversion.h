@@ -0,0 +1,22 @@
+namespace helpers {
+
+    /**
+     Converts `pixelCount` consecutive pixels from one channel layout to another.
+
+     Layouts are given by channel count, as in Bitmap::Format: 1 grayscale,
+     2 grayscale + alpha, 3 RGB, 4 RGBA. Added alpha is opaque, colour to
+     grayscale is the plain average of R, G and B. Source and destination
+     must not overlap.
+     */
+    typedef void (*RowConverterFunc)(const unsigned char* src, unsigned char* dest, unsigned pixelCount);
+
+    /**
+     Best converter for this CPU between two different channel counts.
+
+     Picks AVX2 or SSE kernels when the CPU has them and falls back to
+     scalar code otherwise. Throws if the layouts are equal or invalid, a
+     row copy is just a memcpy then.
+     */
+    RowConverterFunc RowConverterForChannels(unsigned srcChannels, unsigned destChannels);
+
+}
@@ -1,10 +1,12 @@
 #include "Program.h"
 #include <stdexcept>
+#include <cassert>
+#include <cstring>
 #include <glm/gtc/type_ptr.hpp>
 
 using namespace helpers;
 
-Program::Program(const std::vector<Shader>& shaders) :
+Program::Program(const std::vector<Shader>& shaders, bool retrievableBinary) :
     _object(0)
 {
     if(shaders.size() <= 0)
@@ -17,49 +19,59 @@ Program::Program(const std::vector<Shader>& shaders) :
     for(unsigned i = 0; i < shaders.size(); ++i)
         glAttachShader(_object, shaders[i].shaderId());
     
+    if(retrievableBinary)
+        glProgramParameteri(_object, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
     glLinkProgram(_object);
 
     for(unsigned i = 0; i < shaders.size(); ++i)
         glDetachShader(_object, shaders[i].shaderId());
     
-    GLint status;
-    glGetProgramiv(_object, GL_LINK_STATUS, &status);
-    if (status == GL_FALSE) {
-        std::string msg("Program linking failure: ");
-        
-        GLint infoLogLength;
-        glGetProgramiv(_object, GL_INFO_LOG_LENGTH, &infoLogLength);
-        char* strInfoLog = new char[infoLogLength + 1];
-        glGetProgramInfoLog(_object, infoLogLength, NULL, strInfoLog);
-        msg += strInfoLog;
-        delete[] strInfoLog;
-        
-        glDeleteProgram(_object); _object = 0;
-        throw std::runtime_error(msg);
-    }
+    _checkLinkStatus("Program linking failure: ");
+    _reflectUniforms();
+}
+
+Program::Program(GLenum binaryFormat, const void* binary, GLsizei length) :
+    _object(0)
+{
+    if(!binary || length <= 0)
+        throw std::runtime_error("No program binary was provided");
+
+    _object = glCreateProgram();
+    if(_object == 0)
+        throw std::runtime_error("glCreateProgram failed");
+
+    // the driver may refuse binaries from another version, that is reported as a link failure
+    glProgramBinary(_object, binaryFormat, binary, length);
+    _checkLinkStatus("Program binary rejected: ");
+    _reflectUniforms();
 }
 
 Program::~Program() {
     if(_object != 0) glDeleteProgram(_object);
+    if(_current == _object) _current = 0;
 }
 
 GLuint Program::object() const {
     return _object;
 }
 
+GLuint Program::_current = 0;
+
 void Program::use() const {
     glUseProgram(_object);
+    _current = _object;
 }
 
 bool Program::isInUse() const {
-    GLint currentProgram = 0;
-    glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgram);
-    return (currentProgram == (GLint)_object);
+    // tracked by use()/stopUsing(), querying GL_CURRENT_PROGRAM would stall
+    return _current == _object;
 }
 
 void Program::stopUsing() const {
     assert(isInUse());
     glUseProgram(0);
+    _current = 0;
 }
 
 GLint Program::attrib(const GLchar* attribName) const {
@@ -74,14 +86,167 @@ GLint Program::attrib(const GLchar* attribName) const {
 }
 
 GLint Program::uniform(const GLchar* uniformName) const {
+    return _location(uniformHandle(uniformName));
+}
+
+Program::UniformHandle Program::uniformHandle(const GLchar* uniformName) const {
     if(!uniformName)
         throw std::runtime_error("uniformName was NULL");
-    
-    GLint uniform = glGetUniformLocation(_object, uniformName);
-    if(uniform == -1)
+
+    std::unordered_map<std::string, GLint>::const_iterator it = _uniformSlots.find(uniformName);
+    if(it != _uniformSlots.end())
+        return UniformHandle(this, it->second);
+
+    // not reflected under this name, e.g. "arr[3]" of a plain array
+    GLint location = glGetUniformLocation(_object, uniformName);
+    if(location == -1)
         throw std::runtime_error(std::string("Program uniform not found: ") + uniformName);
-    
-    return uniform;
+
+    // an element of a reflected array joins that array's slots
+    GLint array = -1;
+    std::string name(uniformName);
+    size_t bracket = name.rfind('[');
+    if(bracket != std::string::npos && name[name.size() - 1] == ']'){
+        it = _uniformSlots.find(name.substr(0, bracket));
+        if(it != _uniformSlots.end())
+            array = _uniforms[it->second].array;
+    }
+    return UniformHandle(this, _addUniformSlot(name, location, GL_NONE, 1, array));
+}
+
+bool Program::binary(GLenum& binaryFormat, std::vector<unsigned char>& binary) const {
+    GLint length = 0;
+    glGetProgramiv(_object, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return false;
+
+    binary.resize(length);
+    GLsizei written = 0;
+    glGetProgramBinary(_object, length, &written, &binaryFormat, &binary[0]);
+    binary.resize(written);
+    return written > 0;
+}
+
+bool Program::hasUniform(const GLchar* uniformName) const {
+    if(!uniformName)
+        throw std::runtime_error("uniformName was NULL");
+
+    if(_uniformSlots.count(uniformName))
+        return true;
+    return glGetUniformLocation(_object, uniformName) != -1;
+}
+
+void Program::bindUniformBlock(const GLchar* blockName, GLuint bindingPoint) {
+    if(!blockName)
+        throw std::runtime_error("blockName was NULL");
+
+    GLuint blockIndex = glGetUniformBlockIndex(_object, blockName);
+    if(blockIndex == GL_INVALID_INDEX)
+        throw std::runtime_error(std::string("Program uniform block not found: ") + blockName);
+
+    glUniformBlockBinding(_object, blockIndex, bindingPoint);
+}
+
+bool Program::hasUniformBlock(const GLchar* blockName) const {
+    if(!blockName)
+        throw std::runtime_error("blockName was NULL");
+
+    return glGetUniformBlockIndex(_object, blockName) != GL_INVALID_INDEX;
+}
+
+void Program::_checkLinkStatus(const char* failureMessage) {
+    GLint status;
+    glGetProgramiv(_object, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        std::string msg(failureMessage);
+        
+        GLint infoLogLength;
+        glGetProgramiv(_object, GL_INFO_LOG_LENGTH, &infoLogLength);
+        char* strInfoLog = new char[infoLogLength + 1];
+        glGetProgramInfoLog(_object, infoLogLength, NULL, strInfoLog);
+        strInfoLog[infoLogLength] = '\0';
+        msg += strInfoLog;
+        delete[] strInfoLog;
+        
+        glDeleteProgram(_object); _object = 0;
+        throw std::runtime_error(msg);
+    }
+}
+
+void Program::_reflectUniforms() {
+    GLint numUniforms = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(_object, GL_ACTIVE_UNIFORMS, &numUniforms);
+    glGetProgramiv(_object, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::vector<GLchar> nameBuffer(maxNameLength + 1);
+    _uniforms.reserve(numUniforms);
+    for(GLint i = 0; i < numUniforms; ++i){
+        GLint size = 0;
+        GLenum type = GL_NONE;
+        GLsizei nameLength = 0;
+        glGetActiveUniform(_object, (GLuint)i, (GLsizei)nameBuffer.size(), &nameLength, &size, &type, &nameBuffer[0]);
+
+        std::string name(&nameBuffer[0], nameLength);
+        GLint location = glGetUniformLocation(_object, name.c_str());
+        if(location == -1)
+            continue; // member of a uniform block, has no location
+
+        // arrays are reported as "name[0]", also make them reachable as "name"
+        bool isArray = name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0;
+        GLint slot = _addUniformSlot(name, location, type, size, isArray ? (GLint)_uniforms.size() : -1);
+        if(isArray)
+            _uniformSlots[name.substr(0, name.size() - 3)] = slot;
+    }
+}
+
+GLint Program::_addUniformSlot(const std::string& name, GLint location, GLenum type, GLint size, GLint array) const {
+    UniformSlot uniformSlot;
+    uniformSlot.location = location;
+    uniformSlot.type = type;
+    uniformSlot.size = size;
+    uniformSlot.array = array;
+
+    GLint slot = (GLint)_uniforms.size();
+    _uniforms.push_back(uniformSlot);
+    _uniformSlots[name] = slot;
+    return slot;
+}
+
+GLint Program::_location(UniformHandle uniform) const {
+    if(!uniform.isValid() || uniform.slot >= (GLint)_uniforms.size())
+        throw std::runtime_error("Invalid uniform handle");
+    if(uniform.program != this)
+        throw std::runtime_error("Uniform handle belongs to another program");
+
+    return _uniforms[uniform.slot].location;
+}
+
+bool Program::_shadowUniform(UniformHandle uniform, const void* value, size_t size) {
+    _location(uniform); // validates the handle
+    std::vector<unsigned char>& shadow = _uniforms[uniform.slot].shadow;
+    if(!shadow.empty() && shadow.size() == size && memcmp(&shadow[0], value, size) == 0)
+        return false;
+
+    const unsigned char* bytes = (const unsigned char*)value;
+    shadow.assign(bytes, bytes + size);
+    _forgetArraySiblings(uniform.slot);
+    return true;
+}
+
+void Program::_forgetUniform(UniformHandle uniform) {
+    _location(uniform);
+    _uniforms[uniform.slot].shadow.clear();
+    _forgetArraySiblings(uniform.slot);
+}
+
+void Program::_forgetArraySiblings(GLint slot) {
+    GLint array = _uniforms[slot].array;
+    if(array < 0)
+        return;
+    for(size_t i = 0; i < _uniforms.size(); ++i)
+        if(_uniforms[i].array == array && (GLint)i != slot)
+            _uniforms[i].shadow.clear();
 }
 
 #define ATTRIB_N_UNIFORM_SETTERS(OGL_TYPE, TYPE_PREFIX, TYPE_SUFFIX) \
@@ -105,22 +270,40 @@ GLint Program::uniform(const GLchar* uniformName) const {
         { assert(isInUse()); glVertexAttrib ## TYPE_PREFIX ## 4 ## TYPE_SUFFIX ## v (attrib(name), v); } \
 \
     void Program::setUniform(const GLchar* name, OGL_TYPE v0) \
-        { assert(isInUse()); glUniform1 ## TYPE_SUFFIX (uniform(name), v0); } \
+        { setUniform(uniformHandle(name), v0); } \
     void Program::setUniform(const GLchar* name, OGL_TYPE v0, OGL_TYPE v1) \
-        { assert(isInUse()); glUniform2 ## TYPE_SUFFIX (uniform(name), v0, v1); } \
+        { setUniform(uniformHandle(name), v0, v1); } \
     void Program::setUniform(const GLchar* name, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2) \
-        { assert(isInUse()); glUniform3 ## TYPE_SUFFIX (uniform(name), v0, v1, v2); } \
+        { setUniform(uniformHandle(name), v0, v1, v2); } \
     void Program::setUniform(const GLchar* name, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3) \
-        { assert(isInUse()); glUniform4 ## TYPE_SUFFIX (uniform(name), v0, v1, v2, v3); } \
+        { setUniform(uniformHandle(name), v0, v1, v2, v3); } \
 \
     void Program::setUniform1v(const GLchar* name, const OGL_TYPE* v, GLsizei count) \
-        { assert(isInUse()); glUniform1 ## TYPE_SUFFIX ## v (uniform(name), count, v); } \
+        { setUniform1v(uniformHandle(name), v, count); } \
     void Program::setUniform2v(const GLchar* name, const OGL_TYPE* v, GLsizei count) \
-        { assert(isInUse()); glUniform2 ## TYPE_SUFFIX ## v (uniform(name), count, v); } \
+        { setUniform2v(uniformHandle(name), v, count); } \
     void Program::setUniform3v(const GLchar* name, const OGL_TYPE* v, GLsizei count) \
-        { assert(isInUse()); glUniform3 ## TYPE_SUFFIX ## v (uniform(name), count, v); } \
+        { setUniform3v(uniformHandle(name), v, count); } \
     void Program::setUniform4v(const GLchar* name, const OGL_TYPE* v, GLsizei count) \
-        { assert(isInUse()); glUniform4 ## TYPE_SUFFIX ## v (uniform(name), count, v); }
+        { setUniform4v(uniformHandle(name), v, count); } \
+\
+    void Program::setUniform(UniformHandle h, OGL_TYPE v0) \
+        { const OGL_TYPE v[] = { v0 }; setUniform1v(h, v); } \
+    void Program::setUniform(UniformHandle h, OGL_TYPE v0, OGL_TYPE v1) \
+        { const OGL_TYPE v[] = { v0, v1 }; setUniform2v(h, v); } \
+    void Program::setUniform(UniformHandle h, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2) \
+        { const OGL_TYPE v[] = { v0, v1, v2 }; setUniform3v(h, v); } \
+    void Program::setUniform(UniformHandle h, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3) \
+        { const OGL_TYPE v[] = { v0, v1, v2, v3 }; setUniform4v(h, v); } \
+\
+    void Program::setUniform1v(UniformHandle h, const OGL_TYPE* v, GLsizei count) \
+        { assert(isInUse()); if(_shadowUniform(h, v, sizeof(OGL_TYPE)*1*count)) glUniform1 ## TYPE_SUFFIX ## v (_location(h), count, v); } \
+    void Program::setUniform2v(UniformHandle h, const OGL_TYPE* v, GLsizei count) \
+        { assert(isInUse()); if(_shadowUniform(h, v, sizeof(OGL_TYPE)*2*count)) glUniform2 ## TYPE_SUFFIX ## v (_location(h), count, v); } \
+    void Program::setUniform3v(UniformHandle h, const OGL_TYPE* v, GLsizei count) \
+        { assert(isInUse()); if(_shadowUniform(h, v, sizeof(OGL_TYPE)*3*count)) glUniform3 ## TYPE_SUFFIX ## v (_location(h), count, v); } \
+    void Program::setUniform4v(UniformHandle h, const OGL_TYPE* v, GLsizei count) \
+        { assert(isInUse()); if(_shadowUniform(h, v, sizeof(OGL_TYPE)*4*count)) glUniform4 ## TYPE_SUFFIX ## v (_location(h), count, v); }
 
 ATTRIB_N_UNIFORM_SETTERS(GLfloat, , f);
 ATTRIB_N_UNIFORM_SETTERS(GLdouble, , d);
@@ -128,33 +311,27 @@ ATTRIB_N_UNIFORM_SETTERS(GLint, I, i);
 ATTRIB_N_UNIFORM_SETTERS(GLuint, I, ui);
 
 void Program::setUniformMatrix2(const GLchar* name, const GLfloat* v, GLsizei count, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix2fv(uniform(name), count, transpose, v);
+    setUniformMatrix2(uniformHandle(name), v, count, transpose);
 }
 
 void Program::setUniformMatrix3(const GLchar* name, const GLfloat* v, GLsizei count, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix3fv(uniform(name), count, transpose, v);
+    setUniformMatrix3(uniformHandle(name), v, count, transpose);
 }
 
 void Program::setUniformMatrix4(const GLchar* name, const GLfloat* v, GLsizei count, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix4fv(uniform(name), count, transpose, v);
+    setUniformMatrix4(uniformHandle(name), v, count, transpose);
 }
 
 void Program::setUniform(const GLchar* name, const glm::mat2& m, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix2fv(uniform(name), 1, transpose, glm::value_ptr(m));
+    setUniform(uniformHandle(name), m, transpose);
 }
 
 void Program::setUniform(const GLchar* name, const glm::mat3& m, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix3fv(uniform(name), 1, transpose, glm::value_ptr(m));
+    setUniform(uniformHandle(name), m, transpose);
 }
 
 void Program::setUniform(const GLchar* name, const glm::mat4& m, GLboolean transpose) {
-    assert(isInUse());
-    glUniformMatrix4fv(uniform(name), 1, transpose, glm::value_ptr(m));
+    setUniform(uniformHandle(name), m, transpose);
 }
 
 void Program::setUniform(const GLchar* uniformName, const glm::vec3& v) {
@@ -165,4 +342,39 @@ void Program::setUniform(const GLchar* uniformName, const glm::vec4& v) {
     setUniform4v(uniformName, glm::value_ptr(v));
 }
 
+// the shadow copy only knows the bytes, so transposed uploads always go through
+#define UNIFORM_MATRIX_SETTER(N) \
+    void Program::setUniformMatrix ## N (UniformHandle h, const GLfloat* v, GLsizei count, GLboolean transpose) { \
+        assert(isInUse()); \
+        if(transpose) \
+            _forgetUniform(h); \
+        else if(!_shadowUniform(h, v, sizeof(GLfloat)*N*N*count)) \
+            return; \
+        glUniformMatrix ## N ## fv(_location(h), count, transpose, v); \
+    }
+
+UNIFORM_MATRIX_SETTER(2)
+UNIFORM_MATRIX_SETTER(3)
+UNIFORM_MATRIX_SETTER(4)
+
+void Program::setUniform(UniformHandle h, const glm::mat2& m, GLboolean transpose) {
+    setUniformMatrix2(h, glm::value_ptr(m), 1, transpose);
+}
+
+void Program::setUniform(UniformHandle h, const glm::mat3& m, GLboolean transpose) {
+    setUniformMatrix3(h, glm::value_ptr(m), 1, transpose);
+}
+
+void Program::setUniform(UniformHandle h, const glm::mat4& m, GLboolean transpose) {
+    setUniformMatrix4(h, glm::value_ptr(m), 1, transpose);
+}
+
+void Program::setUniform(UniformHandle h, const glm::vec3& v) {
+    setUniform3v(h, glm::value_ptr(v));
+}
+
+void Program::setUniform(UniformHandle h, const glm::vec4& v) {
+    setUniform4v(h, glm::value_ptr(v));
+}
+
 
@@ -1,22 +1,64 @@
 #include "Shader.h"
 #include <vector>
+#include <string>
+#include <unordered_map>
 #include <glm/glm.hpp>
 
 namespace helpers {
 
-    class Program { 
+    class Program {
     public:
-        Program(const std::vector<Shader>& shaders);
+        /**
+         Pre-resolved reference to an active uniform of a program.
+
+         Look it up once with `uniformHandle` and keep it. Setters that take a
+         handle skip the name lookup, and skip the GL call entirely when the
+         value is the same as the last one uploaded. A handle only works with
+         the program it came from, the setters throw for any other.
+         */
+        struct UniformHandle {
+            const Program* program;
+            GLint slot;
+            UniformHandle() : program(NULL), slot(-1) {}
+            UniformHandle(const Program* p, GLint s) : program(p), slot(s) {}
+            bool isValid() const { return program != NULL && slot >= 0; }
+        };
+
+        /**
+         Links the shaders into a program.
+
+         Pass `retrievableBinary` to be able to read the linked program back
+         with `binary`, see ProgramCache.
+         */
+        Program(const std::vector<Shader>& shaders, bool retrievableBinary = false);
+
+        /**
+         Recreates a program from a binary returned by `binary`.
+
+         Throws if the driver rejects the binary, which it may do after any
+         driver or hardware change. Uniform block bindings are not part of
+         the binary and have to be set again.
+         */
+        Program(GLenum binaryFormat, const void* binary, GLsizei length);
         ~Program();
         // program id
         GLuint object() const;
         void use() const;
+        // only sees programs bound through use(), not raw glUseProgram calls
         bool isInUse() const;
         void stopUsing() const;
+        // driver-specific linked binary, false if the driver does not provide one
+        bool binary(GLenum& binaryFormat, std::vector<unsigned char>& binary) const;
         // attribute index
         GLint attrib(const GLchar* attribName) const;
         // uniform index
         GLint uniform(const GLchar* uniformName) const;
+        // uniform table entry, throws if the uniform is not active
+        UniformHandle uniformHandle(const GLchar* uniformName) const;
+        bool hasUniform(const GLchar* uniformName) const;
+        // connects a uniform block to a buffer binding point, see UniformBuffer
+        void bindUniformBlock(const GLchar* blockName, GLuint bindingPoint);
+        bool hasUniformBlock(const GLchar* blockName) const;
 		// attrib & uniform setters
 #define _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(OGL_TYPE) \
         void setAttrib(const GLchar* attribName, OGL_TYPE v0); \
@@ -38,6 +80,16 @@ namespace helpers {
         void setUniform2v(const GLchar* uniformName, const OGL_TYPE* v, GLsizei count=1); \
         void setUniform3v(const GLchar* uniformName, const OGL_TYPE* v, GLsizei count=1); \
         void setUniform4v(const GLchar* uniformName, const OGL_TYPE* v, GLsizei count=1); \
+\
+        void setUniform(UniformHandle uniform, OGL_TYPE v0); \
+        void setUniform(UniformHandle uniform, OGL_TYPE v0, OGL_TYPE v1); \
+        void setUniform(UniformHandle uniform, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2); \
+        void setUniform(UniformHandle uniform, OGL_TYPE v0, OGL_TYPE v1, OGL_TYPE v2, OGL_TYPE v3); \
+\
+        void setUniform1v(UniformHandle uniform, const OGL_TYPE* v, GLsizei count=1); \
+        void setUniform2v(UniformHandle uniform, const OGL_TYPE* v, GLsizei count=1); \
+        void setUniform3v(UniformHandle uniform, const OGL_TYPE* v, GLsizei count=1); \
+        void setUniform4v(UniformHandle uniform, const OGL_TYPE* v, GLsizei count=1); \
 
         _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLfloat)
         _TDOGL_PROGRAM_ATTRIB_N_UNIFORM_SETTERS(GLdouble)
@@ -53,8 +105,43 @@ namespace helpers {
         void setUniform(const GLchar* uniformName, const glm::vec3& v);
         void setUniform(const GLchar* uniformName, const glm::vec4& v);
 
+        void setUniformMatrix2(UniformHandle uniform, const GLfloat* v, GLsizei count=1, GLboolean transpose=GL_FALSE);
+        void setUniformMatrix3(UniformHandle uniform, const GLfloat* v, GLsizei count=1, GLboolean transpose=GL_FALSE);
+        void setUniformMatrix4(UniformHandle uniform, const GLfloat* v, GLsizei count=1, GLboolean transpose=GL_FALSE);
+        void setUniform(UniformHandle uniform, const glm::mat2& m, GLboolean transpose=GL_FALSE);
+        void setUniform(UniformHandle uniform, const glm::mat3& m, GLboolean transpose=GL_FALSE);
+        void setUniform(UniformHandle uniform, const glm::mat4& m, GLboolean transpose=GL_FALSE);
+        void setUniform(UniformHandle uniform, const glm::vec3& v);
+        void setUniform(UniformHandle uniform, const glm::vec4& v);
+
     private:
+        struct UniformSlot {
+            GLint location;
+            GLenum type;
+            GLint size;
+            // slot of the reflected array this is, or is an element of, -1 otherwise;
+            // slots of one array share GL storage, so writing one forgets the others
+            GLint array;
+            // bytes of the last value sent to GL, empty until the first upload
+            std::vector<unsigned char> shadow;
+        };
+
         GLuint _object;
+        // program bound by the last use()/stopUsing(), GL is never asked
+        static GLuint _current;
+        // filled from glGetActiveUniform at link time; element names of
+        // arrays that were not reflected are added on first lookup
+        mutable std::vector<UniformSlot> _uniforms;
+        mutable std::unordered_map<std::string, GLint> _uniformSlots;
+
+        void _checkLinkStatus(const char* failureMessage);
+        void _reflectUniforms();
+        GLint _addUniformSlot(const std::string& name, GLint location, GLenum type, GLint size, GLint array) const;
+        GLint _location(UniformHandle uniform) const;
+        bool _shadowUniform(UniformHandle uniform, const void* value, size_t size);
+        void _forgetUniform(UniformHandle uniform);
+        // clears the shadows of the other slots that overlap `slot`'s array
+        void _forgetArraySiblings(GLint slot);
         Program(const Program&);
         const Program& operator=(const Program&);
     };
@@ -0,0 +1,183 @@
+#include "ProgramCache.h"
+#include "Hash.h"
+#include <stdexcept>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+using namespace helpers;
+
+namespace {
+    const char BinaryMagic[4] = { 'P', 'B', 'I', 'N' };
+    const uint32_t BinaryVersion = 1;
+
+    // header of a cached program binary file, followed by `length` bytes of binary
+    struct BinaryHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint64_t driver;    // hash of GL_VENDOR, GL_RENDERER and GL_VERSION
+        uint32_t format;
+        uint32_t length;
+    };
+}
+
+static uint64_t HashGLString(GLenum name, uint64_t seed) {
+    const GLubyte* value = glGetString(name);
+    if(!value)
+        return seed;
+    return HashBytes(value, std::strlen((const char*)value), seed);
+}
+
+ProgramCache::ProgramCache(const std::string& binaryPathPrefix) :
+    _binaryPathPrefix(binaryPathPrefix),
+    _binariesSupported(false),
+    _driverHash(0)
+{
+    std::memset(&_stats, 0, sizeof(_stats));
+
+    if(GLEW_ARB_get_program_binary){
+        GLint numFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        _binariesSupported = numFormats > 0;
+    }
+
+    _driverHash = HashGLString(GL_VENDOR, HashSeed);
+    _driverHash = HashGLString(GL_RENDERER, _driverHash);
+    _driverHash = HashGLString(GL_VERSION, _driverHash);
+}
+
+ProgramCache::~ProgramCache() {
+    std::unordered_map<uint64_t, Program*>::iterator it;
+    for(it = _programs.begin(); it != _programs.end(); ++it)
+        delete it->second;
+}
+
+Program* ProgramCache::program(const std::vector<ShaderSource>& sources) {
+    ++_stats.requests;
+
+    uint64_t key = _key(sources);
+    std::unordered_map<uint64_t, Program*>::const_iterator it = _programs.find(key);
+    if(it != _programs.end()){
+        ++_stats.memoryHits;
+        return it->second;
+    }
+
+    bool useDisk = _binariesSupported && !_binaryPathPrefix.empty();
+    Program* program = useDisk ? _loadBinary(key) : NULL;
+    if(program){
+        ++_stats.diskHits;
+    } else {
+        std::vector<Shader> shaders;
+        for(size_t i = 0; i < sources.size(); ++i)
+            shaders.push_back(Shader(sources[i].code, sources[i].type));
+        program = new Program(shaders, useDisk);
+        ++_stats.compiled;
+
+        if(useDisk)
+            _saveBinary(key, *program);
+    }
+
+    _programs[key] = program;
+    return program;
+}
+
+Program* ProgramCache::programFromFiles(const std::string& vertexFile, const std::string& fragmentFile) {
+    std::vector<ShaderSource> sources;
+    sources.push_back(ShaderSource(GL_VERTEX_SHADER, Shader::sourceFromFile(vertexFile)));
+    sources.push_back(ShaderSource(GL_FRAGMENT_SHADER, Shader::sourceFromFile(fragmentFile)));
+    return program(sources);
+}
+
+bool ProgramCache::binariesSupported() const {
+    return _binariesSupported;
+}
+
+const ProgramCache::Stats& ProgramCache::stats() const {
+    return _stats;
+}
+
+uint64_t ProgramCache::_key(const std::vector<ShaderSource>& sources) {
+    uint64_t hash = HashSeed;
+    for(size_t i = 0; i < sources.size(); ++i){
+        uint64_t length = sources[i].code.size();
+        hash = HashBytes(&sources[i].type, sizeof(sources[i].type), hash);
+        hash = HashBytes(&length, sizeof(length), hash);
+        hash = HashBytes(sources[i].code.data(), sources[i].code.size(), hash);
+    }
+    return hash;
+}
+
+std::string ProgramCache::_binaryPath(uint64_t key) const {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    return _binaryPathPrefix + name + ".bin";
+}
+
+Program* ProgramCache::_loadBinary(uint64_t key) {
+    std::ifstream f(_binaryPath(key).c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+    if(!f.is_open())
+        return NULL;
+    const std::streamoff fileSize = f.tellg();
+    f.seekg(0);
+
+    BinaryHeader header;
+    if(!f.read((char*)&header, sizeof(header)))
+        return NULL;
+    if(std::memcmp(header.magic, BinaryMagic, sizeof(BinaryMagic)) != 0 ||
+       header.version != BinaryVersion ||
+       header.key != key ||
+       header.driver != _driverHash ||
+       header.length == 0 ||
+       header.length > (uint64_t)(fileSize - (std::streamoff)sizeof(header)))
+        return NULL; // includes a corrupt length, which must not size the buffer
+
+    std::vector<unsigned char> binary(header.length);
+    if(!f.read((char*)&binary[0], binary.size()))
+        return NULL;
+
+    try {
+        return new Program((GLenum)header.format, &binary[0], (GLsizei)binary.size());
+    } catch(const std::runtime_error&) {
+        // same driver strings but the binary is still refused, rebuild it
+        ++_stats.binariesRejected;
+        return NULL;
+    }
+}
+
+void ProgramCache::_saveBinary(uint64_t key, const Program& program) {
+    GLenum format = GL_NONE;
+    std::vector<unsigned char> binary;
+    if(!program.binary(format, binary))
+        return;
+
+    BinaryHeader header;
+    std::memcpy(header.magic, BinaryMagic, sizeof(BinaryMagic));
+    header.version = BinaryVersion;
+    header.key = key;
+    header.driver = _driverHash;
+    header.format = (uint32_t)format;
+    header.length = (uint32_t)binary.size();
+
+    // a failed write only costs a recompile on the next run; the binary goes to a
+    // temporary file that is renamed over, so a crash never leaves a torn one behind
+    const std::string path = _binaryPath(key);
+    const std::string tempPath = path + ".tmp";
+    std::ofstream f(tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!f.is_open())
+        return;
+    f.write((const char*)&header, sizeof(header));
+    f.write((const char*)&binary[0], binary.size());
+    f.close();
+    if(!f.good()){
+        std::remove(tempPath.c_str());
+        return;
+    }
+
+    // rename doesn't replace an existing file on every platform
+    if(std::rename(tempPath.c_str(), path.c_str()) != 0){
+        std::remove(path.c_str());
+        if(std::rename(tempPath.c_str(), path.c_str()) != 0)
+            std::remove(tempPath.c_str());
+    }
+}
@@ -0,0 +1,68 @@
+#include "Program.h"
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace helpers {
+
+    /**
+     Owns shader programs and builds each distinct one only once.
+
+     Programs are keyed by a hash of their shader types and sources, so
+     asking twice for the same shader set returns the same Program.
+
+     When given a path prefix and the driver supports program binaries,
+     linked programs are also stored on disk as `<prefix><key>.bin` and
+     loaded from there on the next run, skipping compilation. Binaries
+     written by another driver, rejected by this one, or truncated are
+     recompiled and overwritten. Files are replaced by renaming a finished
+     temporary file over them.
+
+     Programs loaded from a binary have no uniform block bindings, set them
+     on every program returned.
+     */
+    class ProgramCache {
+    public:
+        struct ShaderSource {
+            GLenum type;
+            std::string code;
+
+            ShaderSource(GLenum t, const std::string& c) : type(t), code(c) {}
+        };
+
+        struct Stats {
+            unsigned requests;
+            unsigned memoryHits;
+            unsigned diskHits;
+            unsigned compiled;
+            unsigned binariesRejected;
+        };
+
+        // empty prefix: keep programs in memory only
+        ProgramCache(const std::string& binaryPathPrefix = std::string());
+        ~ProgramCache();
+
+        Program* program(const std::vector<ShaderSource>& sources);
+        Program* programFromFiles(const std::string& vertexFile, const std::string& fragmentFile);
+
+        // the driver can save and load program binaries
+        bool binariesSupported() const;
+        const Stats& stats() const;
+
+    private:
+        std::string _binaryPathPrefix;
+        bool _binariesSupported;
+        uint64_t _driverHash;
+        std::unordered_map<uint64_t, Program*> _programs;
+        Stats _stats;
+
+        static uint64_t _key(const std::vector<ShaderSource>& sources);
+        std::string _binaryPath(uint64_t key) const;
+        Program* _loadBinary(uint64_t key);
+        void _saveBinary(uint64_t key, const Program& program);
+        ProgramCache(const ProgramCache&);
+        const ProgramCache& operator=(const ProgramCache&);
+    };
+
+}
@@ -0,0 +1,126 @@
+#include "RenderQueue.h"
+#include <stdexcept>
+
+using namespace helpers;
+
+static const unsigned PassBits = 4;
+static const unsigned ProgramBits = 10;
+static const unsigned TextureBits = 12;
+static const unsigned VaoBits = 8;
+static const unsigned MeshBits = 10;
+static const unsigned DepthBits = 20;
+
+static const unsigned DepthShift = 0;
+static const unsigned MeshShift = DepthShift + DepthBits;
+static const unsigned VaoShift = MeshShift + MeshBits;
+static const unsigned TextureShift = VaoShift + VaoBits;
+static const unsigned ProgramShift = TextureShift + TextureBits;
+static const unsigned PassShift = ProgramShift + ProgramBits;
+
+static_assert(PassShift + PassBits == 64, "Sort key fields must fill 64 bits");
+
+// masking instead would let ids alias and merge batches of different state
+inline uint64_t Field(unsigned value, unsigned bits, unsigned shift) {
+    if(value >= (1u << bits))
+        throw std::runtime_error("Sort key field out of range");
+    return (uint64_t)value << shift;
+}
+
+static const unsigned StateFieldBits[RenderQueue::StateFieldCount] = { ProgramBits, TextureBits, VaoBits, MeshBits };
+
+uint64_t RenderQueue::makeKey(unsigned pass, unsigned program, unsigned texture, unsigned vao, unsigned mesh, float depth) {
+    if(!(depth > 0.0f)) depth = 0.0f; // also catches NaN
+    if(depth > 1.0f) depth = 1.0f;
+    unsigned quantizedDepth = (unsigned)(depth * (float)((1u << DepthBits) - 1));
+
+    return Field(pass, PassBits, PassShift) |
+           Field(program, ProgramBits, ProgramShift) |
+           Field(texture, TextureBits, TextureShift) |
+           Field(vao, VaoBits, VaoShift) |
+           Field(mesh, MeshBits, MeshShift) |
+           Field(quantizedDepth, DepthBits, DepthShift);
+}
+
+uint64_t RenderQueue::stateBits(uint64_t key) {
+    return key & ~(((uint64_t)1 << DepthBits) - 1);
+}
+
+unsigned RenderQueue::stateId(StateField field, unsigned name) {
+    if(field >= StateFieldCount)
+        throw std::runtime_error("Invalid sort key field");
+
+    std::unordered_map<unsigned, unsigned>& ids = _stateIds[field];
+    std::unordered_map<unsigned, unsigned>::const_iterator it = ids.find(name);
+    if(it != ids.end())
+        return it->second;
+
+    unsigned id = (unsigned)ids.size();
+    if(id >= (1u << StateFieldBits[field]))
+        throw std::runtime_error("Too many distinct GL objects for one sort key field");
+    ids[name] = id;
+    return id;
+}
+
+void RenderQueue::clear() {
+    _items.clear();
+    for(unsigned field = 0; field < StateFieldCount; ++field)
+        _stateIds[field].clear();
+}
+
+void RenderQueue::reserve(size_t count) {
+    _items.reserve(count);
+    _scratch.reserve(count);
+}
+
+void RenderQueue::push(uint64_t key, unsigned payload) {
+    Item item;
+    item.key = key;
+    item.payload = payload;
+    _items.push_back(item);
+}
+
+void RenderQueue::sort() {
+    const size_t count = _items.size();
+    if(count < 2)
+        return;
+
+    _scratch.resize(count);
+    Item* src = &_items[0];
+    Item* dest = &_scratch[0];
+
+    // eight passes of one byte each, least significant first
+    for(unsigned shift = 0; shift < 64; shift += 8){
+        size_t offsets[256] = {0};
+        for(size_t i = 0; i < count; ++i)
+            ++offsets[(src[i].key >> shift) & 0xFF];
+
+        // all keys share this byte, the pass would not change anything
+        if(offsets[(src[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        size_t total = 0;
+        for(unsigned digit = 0; digit < 256; ++digit){
+            size_t digitCount = offsets[digit];
+            offsets[digit] = total;
+            total += digitCount;
+        }
+
+        for(size_t i = 0; i < count; ++i)
+            dest[offsets[(src[i].key >> shift) & 0xFF]++] = src[i];
+
+        Item* swapTmp = src;
+        src = dest;
+        dest = swapTmp;
+    }
+
+    if(src != &_items[0])
+        _items.swap(_scratch);
+}
+
+size_t RenderQueue::size() const {
+    return _items.size();
+}
+
+const RenderQueue::Item& RenderQueue::operator[](size_t index) const {
+    return _items[index];
+}
@@ -0,0 +1,73 @@
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <stdint.h>
+
+namespace helpers {
+
+    /**
+     Collects draw items under 64-bit sort keys and orders them so that
+     items sharing GL state end up next to each other.
+
+     Key layout, most significant bits first:
+
+         pass (4) | program (10) | texture (12) | vao (8) | mesh (10) | depth (20)
+
+     Sorting by the key groups draws by pass, then by the most expensive state
+     change, and puts items that can share one instanced draw (same program,
+     texture, VAO and mesh) side by side in front-to-back order.
+
+     GL names grow without bound as objects are created and deleted, so
+     the state fields hold dense ids from `stateId` rather than the names
+     themselves.
+     */
+    class RenderQueue {
+    public:
+        struct Item {
+            uint64_t key;
+            unsigned payload;
+        };
+
+        enum StateField {
+            StateField_Program,
+            StateField_Texture,
+            StateField_Vao,
+            StateField_Mesh,
+            StateFieldCount
+        };
+
+        /**
+         Builds a sort key from dense ids. Throws if an id doesn't fit its
+         bit field (see the class comment); `depth` is clamped to [0, 1],
+         smaller is drawn first.
+         */
+        static uint64_t makeKey(unsigned pass, unsigned program, unsigned texture, unsigned vao, unsigned mesh, float depth);
+
+        /**
+         Dense id of the GL object `name` for `field`, handed out in order of
+         first use since the last `clear`. Throws once more distinct objects
+         are queued in one frame than the field can tell apart.
+         */
+        unsigned stateId(StateField field, unsigned name);
+
+        /** The key with the depth bits cleared, i.e. everything that selects GL state. */
+        static uint64_t stateBits(uint64_t key);
+
+        // also forgets the state ids
+        void clear();
+        void reserve(size_t count);
+        void push(uint64_t key, unsigned payload);
+
+        /** Stable LSD radix sort of the items by key. */
+        void sort();
+
+        size_t size() const;
+        const Item& operator[](size_t index) const;
+
+    private:
+        std::vector<Item> _items;
+        std::vector<Item> _scratch;
+        std::unordered_map<unsigned, unsigned> _stateIds[StateFieldCount]; // GL name -> id
+    };
+
+}
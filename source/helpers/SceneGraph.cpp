@@ -0,0 +1,146 @@
+#include "SceneGraph.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace helpers;
+
+const SceneGraph::Node SceneGraph::NoParent;
+
+SceneGraph::SceneGraph()
+{
+}
+
+SceneGraph::Node SceneGraph::createNode(Node parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale) {
+    unsigned position = (unsigned)_nodes.size();
+    unsigned parentPosition = NoParent;
+    if(parent != NoParent){
+        parentPosition = _checkedPosition(parent);
+        position = parentPosition + _subtreeSizes[parentPosition];
+    }
+
+    // everything from `position` on moves one place back
+    for(size_t i = 0; i < _parents.size(); ++i)
+        if(_parents[i] != NoParent && _parents[i] >= position)
+            ++_parents[i];
+    for(size_t i = position; i < _nodes.size(); ++i)
+        ++_positions[_nodes[i]];
+    for(unsigned ancestor = parentPosition; ancestor != NoParent; ancestor = _parents[ancestor])
+        ++_subtreeSizes[ancestor];
+
+    Node node = (Node)_positions.size();
+    _nodes.insert(_nodes.begin() + position, node);
+    _parents.insert(_parents.begin() + position, parentPosition);
+    _subtreeSizes.insert(_subtreeSizes.begin() + position, 1u);
+    _translations.insert(_translations.begin() + position, translation);
+    _rotations.insert(_rotations.begin() + position, rotation);
+    _scales.insert(_scales.begin() + position, scale);
+    _world.insert(_world.begin() + position, glm::mat4());
+    _positions.push_back(position);
+    _isDirty.push_back(false);
+
+    _markDirty(node);
+    return node;
+}
+
+size_t SceneGraph::size() const {
+    return _nodes.size();
+}
+
+SceneGraph::Node SceneGraph::parent(Node node) const {
+    unsigned parentPosition = _parents[_checkedPosition(node)];
+    return parentPosition == NoParent ? NoParent : _nodes[parentPosition];
+}
+
+const glm::vec3& SceneGraph::translation(Node node) const {
+    return _translations[_checkedPosition(node)];
+}
+
+const glm::quat& SceneGraph::rotation(Node node) const {
+    return _rotations[_checkedPosition(node)];
+}
+
+const glm::vec3& SceneGraph::scale(Node node) const {
+    return _scales[_checkedPosition(node)];
+}
+
+void SceneGraph::setTranslation(Node node, const glm::vec3& translation) {
+    _translations[_checkedPosition(node)] = translation;
+    _markDirty(node);
+}
+
+void SceneGraph::setRotation(Node node, const glm::quat& rotation) {
+    _rotations[_checkedPosition(node)] = rotation;
+    _markDirty(node);
+}
+
+void SceneGraph::setScale(Node node, const glm::vec3& scale) {
+    _scales[_checkedPosition(node)] = scale;
+    _markDirty(node);
+}
+
+const glm::mat4& SceneGraph::worldMatrix(Node node) const {
+    return _world[_checkedPosition(node)];
+}
+
+size_t SceneGraph::update() {
+    _changed.clear();
+    if(_dirty.empty())
+        return 0;
+
+    // topmost dirty nodes first; a dirty node inside a range already done is covered by it
+    std::vector<unsigned> starts;
+    starts.reserve(_dirty.size());
+    for(size_t i = 0; i < _dirty.size(); ++i){
+        starts.push_back(_positions[_dirty[i]]);
+        _isDirty[_dirty[i]] = false;
+    }
+    _dirty.clear();
+    std::sort(starts.begin(), starts.end());
+
+    unsigned doneUntil = 0;
+    for(size_t i = 0; i < starts.size(); ++i){
+        unsigned first = starts[i];
+        if(first < doneUntil)
+            continue;
+        unsigned end = first + _subtreeSizes[first];
+
+        // parents come before children, and the range's own parent is up to date
+        for(unsigned p = first; p < end; ++p){
+            unsigned parentPosition = _parents[p];
+            if(parentPosition == NoParent)
+                _world[p] = _localMatrix(p);
+            else
+                _world[p] = _world[parentPosition] * _localMatrix(p);
+            _changed.push_back(_nodes[p]);
+        }
+        doneUntil = end;
+    }
+    return _changed.size();
+}
+
+const std::vector<SceneGraph::Node>& SceneGraph::changed() const {
+    return _changed;
+}
+
+unsigned SceneGraph::_checkedPosition(Node node) const {
+    if(node >= _positions.size())
+        throw std::runtime_error("Scene graph node does not exist");
+    return _positions[node];
+}
+
+void SceneGraph::_markDirty(Node node) {
+    if(_isDirty[node])
+        return;
+    _isDirty[node] = true;
+    _dirty.push_back(node);
+}
+
+// translation * rotation * scale, without building the three matrices
+glm::mat4 SceneGraph::_localMatrix(unsigned position) const {
+    glm::mat4 local = glm::mat4_cast(_rotations[position]);
+    local[0] *= _scales[position].x;
+    local[1] *= _scales[position].y;
+    local[2] *= _scales[position].z;
+    local[3] = glm::vec4(_translations[position], 1.0f);
+    return local;
+}
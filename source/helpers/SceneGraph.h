@@ -0,0 +1,82 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <vector>
+#include <cstddef>
+
+namespace helpers {
+
+    /**
+     Hierarchy of transforms: each node has a local translation, rotation
+     and scale relative to its parent.
+
+     Nodes are stored in arrays sorted so that every subtree is one
+     contiguous range, parent first. Changing a node only marks it dirty;
+     `update` then recomputes the world matrices of the dirty subtrees in
+     one linear pass over each range and leaves the rest of the scene alone.
+
+     Adding a node shifts the arrays behind its parent's subtree, so
+     building the graph is O(n) per node and belongs in scene setup, not in
+     the frame loop.
+     */
+    class SceneGraph {
+    public:
+        typedef unsigned Node;
+        static const Node NoParent = ~0u;
+
+        SceneGraph();
+
+        /** Adds a node as the last child of `parent`, or as a new root */
+        Node createNode(Node parent = NoParent,
+                        const glm::vec3& translation = glm::vec3(0.0f),
+                        const glm::quat& rotation = glm::quat(),
+                        const glm::vec3& scale = glm::vec3(1.0f));
+
+        size_t size() const;
+        Node parent(Node node) const;
+
+        const glm::vec3& translation(Node node) const;
+        const glm::quat& rotation(Node node) const;
+        const glm::vec3& scale(Node node) const;
+        void setTranslation(Node node, const glm::vec3& translation);
+        void setRotation(Node node, const glm::quat& rotation);
+        void setScale(Node node, const glm::vec3& scale);
+
+        /** Local to world matrix as of the last `update` */
+        const glm::mat4& worldMatrix(Node node) const;
+
+        /**
+         Recomputes the world matrices of the changed nodes and everything
+         below them.
+
+         Returns the number of nodes recomputed, which are then listed by
+         `changed`.
+         */
+        size_t update();
+
+        /** Nodes whose world matrix was recomputed by the last `update` */
+        const std::vector<Node>& changed() const;
+
+    private:
+        // by position, parents before children, every subtree contiguous
+        std::vector<Node> _nodes;
+        std::vector<unsigned> _parents; // position of the parent, NoParent for roots
+        std::vector<unsigned> _subtreeSizes; // including the node itself
+        std::vector<glm::vec3> _translations;
+        std::vector<glm::quat> _rotations;
+        std::vector<glm::vec3> _scales;
+        std::vector<glm::mat4> _world;
+
+        std::vector<unsigned> _positions; // by node
+        std::vector<Node> _dirty; // changed since the last update
+        std::vector<bool> _isDirty; // by node, so a node is queued once
+        std::vector<Node> _changed;
+
+        unsigned _checkedPosition(Node node) const;
+        void _markDirty(Node node);
+        glm::mat4 _localMatrix(unsigned position) const;
+
+        SceneGraph(const SceneGraph&);
+        const SceneGraph& operator=(const SceneGraph&);
+    };
+
+}
@@ -60,6 +60,11 @@ Shader& Shader::operator = (const Shader& other) {
 }
 
 Shader Shader::shaderFromFile(const std::string& filePath, GLenum shaderType) {
+    Shader shader(sourceFromFile(filePath), shaderType);
+    return shader;
+}
+
+std::string Shader::sourceFromFile(const std::string& filePath) {
     std::ifstream f;
     f.open(filePath.c_str(), std::ios::in | std::ios::binary);
     if(!f.is_open()){
@@ -68,8 +73,7 @@ Shader Shader::shaderFromFile(const std::string& filePath, GLenum shaderType) {
 
     std::stringstream buffer;
     buffer << f.rdbuf();
-    Shader shader(buffer.str(), shaderType);
-    return shader;
+    return buffer.str();
 }
 
 void Shader::_retain() {
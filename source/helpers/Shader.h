@@ -5,6 +5,8 @@ namespace helpers {
     class Shader { 
     public:
         static Shader shaderFromFile(const std::string& filePath, GLenum shaderType);
+        // reads the source without compiling it
+        static std::string sourceFromFile(const std::string& filePath);
         Shader(const std::string& shaderCode, GLenum shaderType);
         GLuint shaderId() const;
         Shader(const Shader& other);
@@ -0,0 +1,62 @@
+#include "ShaderVariants.h"
+#include <sstream>
+#include <algorithm>
+
+using namespace helpers;
+
+ShaderVariants::ShaderVariants(ProgramCache& cache, const std::string& vertexFile, const std::string& fragmentFile, SetupFunc setup) :
+    _cache(cache),
+    _vertexSource(Shader::sourceFromFile(vertexFile)),
+    _fragmentSource(Shader::sourceFromFile(fragmentFile)),
+    _setup(setup)
+{
+}
+
+Program* ShaderVariants::find(uint64_t key) const {
+    std::unordered_map<uint64_t, Program*>::const_iterator it = _variants.find(key);
+    return it != _variants.end() ? it->second : NULL;
+}
+
+Program* ShaderVariants::variant(uint64_t key, const Defines& defines) {
+    Program* program = find(key);
+    if(program)
+        return program;
+
+    std::vector<ProgramCache::ShaderSource> sources;
+    sources.push_back(ProgramCache::ShaderSource(GL_VERTEX_SHADER, injectDefines(_vertexSource, defines)));
+    sources.push_back(ProgramCache::ShaderSource(GL_FRAGMENT_SHADER, injectDefines(_fragmentSource, defines)));
+    program = _cache.program(sources);
+
+    if(_setup)
+        _setup(program);
+    _variants[key] = program;
+    return program;
+}
+
+size_t ShaderVariants::variantCount() const {
+    return _variants.size();
+}
+
+std::string ShaderVariants::injectDefines(const std::string& source, const Defines& defines) {
+    // #version has to stay the first statement
+    size_t insertAt = 0;
+    size_t version = source.find("#version");
+    if(version != std::string::npos){
+        size_t lineEnd = source.find('\n', version);
+        insertAt = (lineEnd == std::string::npos) ? source.size() : lineEnd + 1;
+    }
+
+    std::ostringstream out;
+    out << source.substr(0, insertAt);
+    if(insertAt > 0 && source[insertAt - 1] != '\n')
+        out << '\n';
+    for(size_t i = 0; i < defines.size(); ++i)
+        out << "#define " << defines[i].first << ' ' << defines[i].second << '\n';
+
+    // the line after #version keeps its number
+    size_t nextLine = std::count(source.begin(), source.begin() + insertAt, '\n') + 1;
+    if(version != std::string::npos)
+        out << "#line " << nextLine << '\n';
+    out << source.substr(insertAt);
+    return out.str();
+}
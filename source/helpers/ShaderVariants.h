@@ -0,0 +1,53 @@
+#include "ProgramCache.h"
+#include <vector>
+#include <string>
+#include <utility>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace helpers {
+
+    /**
+     Compile-time specialized versions of one vertex/fragment shader pair.
+
+     Each variant is the same source with a set of `#define NAME VALUE`
+     lines inserted after `#version`, so loops over a constant count can be
+     unrolled and disabled features compiled out. Variants are built through
+     a ProgramCache the first time they are asked for, and are addressed by
+     a key the caller derives from the defines.
+     */
+    class ShaderVariants {
+    public:
+        typedef std::vector<std::pair<std::string, int> > Defines;
+        // called once for every new variant, e.g. to bind uniform blocks
+        typedef void (*SetupFunc)(Program* program);
+
+        ShaderVariants(ProgramCache& cache, const std::string& vertexFile, const std::string& fragmentFile, SetupFunc setup = NULL);
+
+        // already built variant, NULL if `key` was not asked for yet
+        Program* find(uint64_t key) const;
+
+        /**
+         Returns the variant for `key`, building it from `defines` if needed.
+
+         The same key must always come with the same defines.
+         */
+        Program* variant(uint64_t key, const Defines& defines);
+
+        size_t variantCount() const;
+
+        // inserts the defines after the #version line, keeping line numbers in compile errors
+        static std::string injectDefines(const std::string& source, const Defines& defines);
+
+    private:
+        ProgramCache& _cache;
+        std::string _vertexSource;
+        std::string _fragmentSource;
+        SetupFunc _setup;
+        std::unordered_map<uint64_t, Program*> _variants;
+
+        ShaderVariants(const ShaderVariants&);
+        const ShaderVariants& operator=(const ShaderVariants&);
+    };
+
+}
@@ -1,5 +1,6 @@
 #include "Texture.h"
 #include <stdexcept>
+#include <algorithm>
 
 using namespace helpers;
 
@@ -14,6 +15,44 @@ static GLenum TextureFormatForBitmapFormat(Bitmap::Format format, bool srgb)
     }
 }
 
+// uploads one level of the texture bound to GL_TEXTURE_2D
+static void UploadLevel(GLint level, Bitmap::Format format, unsigned width, unsigned height, const unsigned char* pixels) {
+    // RGB rows and small mip levels are not 4-byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D,
+                 level, 
+                 TextureFormatForBitmapFormat(format, true),
+                 (GLsizei)width, 
+                 (GLsizei)height,
+                 0, 
+                 TextureFormatForBitmapFormat(format, false),
+                 GL_UNSIGNED_BYTE, 
+                 pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+static void UploadLevel(GLint level, const Bitmap& bitmap) {
+    UploadLevel(level, bitmap.format(), bitmap.width(), bitmap.height(), bitmap.pixelBuffer());
+}
+
+// size of one level of a block-compressed texture
+static GLsizei CompressedLevelSize(BlockFormat format, unsigned width, unsigned height)
+{
+    return (GLsizei)(((width + 3) / 4) * ((height + 3) / 4) * (unsigned)format);
+}
+
+// uploads one block-compressed level of the texture bound to GL_TEXTURE_2D
+static void UploadCompressedLevel(GLint level, BlockFormat format, unsigned width, unsigned height, const unsigned char* blocks, size_t size) {
+    glCompressedTexImage2D(GL_TEXTURE_2D,
+                           level,
+                           Texture::compressedFormat(format),
+                           (GLsizei)width,
+                           (GLsizei)height,
+                           0,
+                           (GLsizei)size,
+                           blocks);
+}
+
 Texture::Texture(const Bitmap& bitmap, GLint minMagFiler, GLint wrapMode) {
     glGenTextures(1, &_object);
     glBindTexture(GL_TEXTURE_2D, _object);
@@ -21,18 +60,155 @@ Texture::Texture(const Bitmap& bitmap, GLint minMagFiler, GLint wrapMode) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, minMagFiler);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
-    glTexImage2D(GL_TEXTURE_2D,
-                 0, 
-                 TextureFormatForBitmapFormat(bitmap.format(), true),
-                 (GLsizei)bitmap.width(), 
-                 (GLsizei)bitmap.height(),
-                 0, 
-                 TextureFormatForBitmapFormat(bitmap.format(), false),
-                 GL_UNSIGNED_BYTE, 
-                 bitmap.pixelBuffer());
+    UploadLevel(0, bitmap);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(const std::vector<Bitmap>& mipLevels, GLint wrapMode, GLfloat maxAnisotropy) {
+    if(mipLevels.empty())
+        throw std::runtime_error("No mip levels were provided to create the texture");
+
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D, _object);
+    setMipmapSampling(GL_TEXTURE_2D, (unsigned)mipLevels.size(), wrapMode, maxAnisotropy);
+    for(size_t level = 0; level < mipLevels.size(); ++level)
+        UploadLevel((GLint)level, mipLevels[level]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(const std::vector<CompressedImage>& mipLevels, GLint wrapMode, GLfloat maxAnisotropy) {
+    if(mipLevels.empty())
+        throw std::runtime_error("No mip levels were provided to create the texture");
+    if(!GLEW_EXT_texture_compression_s3tc)
+        throw std::runtime_error("S3TC compressed textures are not supported by the driver");
+
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D, _object);
+    setMipmapSampling(GL_TEXTURE_2D, (unsigned)mipLevels.size(), wrapMode, maxAnisotropy);
+    for(size_t level = 0; level < mipLevels.size(); ++level){
+        const CompressedImage& image = mipLevels[level];
+        UploadCompressedLevel((GLint)level, image.format, image.width, image.height, &image.data[0], image.data.size());
+    }
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+Texture::Texture(const BakedTexture& baked, GLint wrapMode, GLfloat maxAnisotropy) {
+    if(baked.isCompressed() && !GLEW_EXT_texture_compression_s3tc)
+        throw std::runtime_error("S3TC compressed textures are not supported by the driver");
+
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D, _object);
+    setMipmapSampling(GL_TEXTURE_2D, baked.levelCount(), wrapMode, maxAnisotropy);
+    for(unsigned level = 0; level < baked.levelCount(); ++level){
+        BakedTexture::Level data = baked.level(level);
+        if(baked.isCompressed())
+            UploadCompressedLevel((GLint)level, baked.blockFormat(), data.width, data.height, data.data, data.size);
+        else
+            UploadLevel((GLint)level, baked.pixelFormat(), data.width, data.height, data.data);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(Bitmap::Format format, unsigned width, unsigned height, unsigned levelCount, GLint wrapMode, GLfloat maxAnisotropy) {
+    if(levelCount == 0)
+        throw std::runtime_error("A texture needs at least one mip level");
+
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D, _object);
+    setMipmapSampling(GL_TEXTURE_2D, levelCount, wrapMode, maxAnisotropy);
+
+    GLenum sizedFormat = storageFormat(format);
+    if(GLEW_ARB_texture_storage){
+        glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levelCount, sizedFormat, (GLsizei)width, (GLsizei)height);
+    } else {
+        for(unsigned level = 0; level < levelCount; ++level){
+            GLsizei levelWidth = (GLsizei)std::max(1u, width >> level);
+            GLsizei levelHeight = (GLsizei)std::max(1u, height >> level);
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, (GLint)sizedFormat, levelWidth, levelHeight, 0,
+                         transferFormat(format), GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+
+    if(format == Bitmap::Format_Grayscale){
+        const GLint grey[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, grey);
+    } else if(format == Bitmap::Format_GrayscaleAlpha){
+        const GLint greyAlpha[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, greyAlpha);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+Texture::Texture(BlockFormat format, unsigned width, unsigned height, unsigned levelCount, GLint wrapMode, GLfloat maxAnisotropy) {
+    if(levelCount == 0)
+        throw std::runtime_error("A texture needs at least one mip level");
+    if(!GLEW_EXT_texture_compression_s3tc)
+        throw std::runtime_error("S3TC compressed textures are not supported by the driver");
+
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D, _object);
+    setMipmapSampling(GL_TEXTURE_2D, levelCount, wrapMode, maxAnisotropy);
+
+    if(GLEW_ARB_texture_storage){
+        glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levelCount, compressedFormat(format), (GLsizei)width, (GLsizei)height);
+    } else {
+        for(unsigned level = 0; level < levelCount; ++level){
+            unsigned levelWidth = std::max(1u, width >> level);
+            unsigned levelHeight = std::max(1u, height >> level);
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, compressedFormat(format), (GLsizei)levelWidth, (GLsizei)levelHeight, 0,
+                                   CompressedLevelSize(format, levelWidth, levelHeight), NULL);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void Texture::setMipmapSampling(GLenum target, unsigned levelCount, GLint wrapMode, GLfloat maxAnisotropy) {
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, wrapMode);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, wrapMode);
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)levelCount - 1);
+
+    if(maxAnisotropy > 1.0f && GLEW_EXT_texture_filter_anisotropic){
+        GLfloat driverMax = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &driverMax);
+        glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy < driverMax ? maxAnisotropy : driverMax);
+    }
+}
+
+// grayscale has no sized sRGB/luminance format in core GL, it is swizzled back to grey instead
+GLenum Texture::storageFormat(Bitmap::Format format)
+{
+    switch (format) {
+        case Bitmap::Format_Grayscale: return GL_R8;
+        case Bitmap::Format_GrayscaleAlpha: return GL_RG8;
+        case Bitmap::Format_RGB: return GL_SRGB8;
+        case Bitmap::Format_RGBA: return GL_SRGB8_ALPHA8;
+        default: throw std::runtime_error("Unrecognised Bitmap Format");
+    }
+}
+
+GLenum Texture::transferFormat(Bitmap::Format format)
+{
+    switch (format) {
+        case Bitmap::Format_Grayscale: return GL_RED;
+        case Bitmap::Format_GrayscaleAlpha: return GL_RG;
+        case Bitmap::Format_RGB: return GL_RGB;
+        case Bitmap::Format_RGBA: return GL_RGBA;
+        default: throw std::runtime_error("Unrecognised Bitmap Format");
+    }
+}
+
+GLenum Texture::compressedFormat(BlockFormat format)
+{
+    switch (format) {
+        case BlockFormat_BC1: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+        case BlockFormat_BC3: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+        default: throw std::runtime_error("Unrecognised BlockFormat");
+    }
+}
+
 Texture::~Texture()
 {
     glDeleteTextures(1, &_object);
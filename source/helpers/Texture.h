@@ -1,5 +1,6 @@
 #include <GL/glew.h>
-#include "Bitmap.h"
+#include "BakedTexture.h"
+#include <vector>
 
 namespace helpers {
     class Texture {
@@ -7,6 +8,72 @@ namespace helpers {
         Texture(const Bitmap& bitmap,
                 GLint minMagFiler = GL_LINEAR,
                 GLint wrapMode = GL_CLAMP_TO_EDGE);
+
+        /**
+         Uploads a precomputed mip chain, level 0 first, e.g. from Bitmap::mipChain.
+
+         Sampling is trilinear, plus anisotropic up to `maxAnisotropy` when
+         the driver supports it (clamped to the driver's maximum). A chain
+         that stops before 1x1 is fine, GL_TEXTURE_MAX_LEVEL is set to its
+         last level.
+         */
+        Texture(const std::vector<Bitmap>& mipLevels,
+                GLint wrapMode = GL_CLAMP_TO_EDGE,
+                GLfloat maxAnisotropy = 8.0f);
+
+        /**
+         Uploads a block-compressed mip chain, level 0 first, see CompressBitmap.
+
+         The levels stay compressed in video memory (sRGB DXT1/DXT5), so they
+         take 1/8 or 1/4 of the space of RGBA. Needs
+         GLEW_EXT_texture_compression_s3tc, throws without it. Sampling is the
+         same as for the uncompressed mip chain.
+         */
+        Texture(const std::vector<CompressedImage>& mipLevels,
+                GLint wrapMode = GL_CLAMP_TO_EDGE,
+                GLfloat maxAnisotropy = 8.0f);
+
+        /**
+         Uploads every level of a baked texture straight from its mapping.
+
+         Throws if the levels are block-compressed and the driver has no
+         S3TC support.
+         */
+        Texture(const BakedTexture& baked,
+                GLint wrapMode = GL_CLAMP_TO_EDGE,
+                GLfloat maxAnisotropy = 8.0f);
+
+        /**
+         Allocates `levelCount` mip levels without filling them, for
+         TextureStreamer to fill in later.
+
+         Uses immutable storage (glTexStorage2D) when the driver has it.
+         Grayscale is stored as R8/RG8 and swizzled back to grey when
+         sampled.
+         */
+        Texture(Bitmap::Format format,
+                unsigned width,
+                unsigned height,
+                unsigned levelCount,
+                GLint wrapMode = GL_CLAMP_TO_EDGE,
+                GLfloat maxAnisotropy = 8.0f);
+
+        /** Allocates `levelCount` block-compressed mip levels without filling them */
+        Texture(BlockFormat format,
+                unsigned width,
+                unsigned height,
+                unsigned levelCount,
+                GLint wrapMode = GL_CLAMP_TO_EDGE,
+                GLfloat maxAnisotropy = 8.0f);
+
+        // trilinear, optionally anisotropic sampling of levels 0..levelCount-1 of the texture bound to `target`
+        static void setMipmapSampling(GLenum target, unsigned levelCount, GLint wrapMode, GLfloat maxAnisotropy);
+        // sized internal format the storage constructors use for `format`
+        static GLenum storageFormat(Bitmap::Format format);
+        // pixel format for glTexSubImage2D into a texture made by the storage constructors
+        static GLenum transferFormat(Bitmap::Format format);
+        // internal format of block-compressed textures, also for glCompressedTexSubImage2D
+        static GLenum compressedFormat(BlockFormat format);
         
         ~Texture();
 		GLuint object() const;
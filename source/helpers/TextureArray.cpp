@@ -0,0 +1,89 @@
+#include "TextureArray.h"
+#include <stdexcept>
+#include <algorithm>
+
+using namespace helpers;
+
+TextureArray::TextureArray(Bitmap::Format format, unsigned width, unsigned height, unsigned layerCount, unsigned levelCount, GLint wrapMode, GLfloat maxAnisotropy) :
+    _object(0),
+    _format(format),
+    _layerCount(layerCount)
+{
+    if(format != Bitmap::Format_RGB && format != Bitmap::Format_RGBA)
+        throw std::runtime_error("Texture arrays hold RGB or RGBA layers");
+    if(layerCount == 0 || levelCount == 0)
+        throw std::runtime_error("A texture array needs at least one layer and one mip level");
+
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _object);
+    Texture::setMipmapSampling(GL_TEXTURE_2D_ARRAY, levelCount, wrapMode, maxAnisotropy);
+
+    GLenum sizedFormat = Texture::storageFormat(format);
+    if(GLEW_ARB_texture_storage){
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, (GLsizei)levelCount, sizedFormat, (GLsizei)width, (GLsizei)height, (GLsizei)layerCount);
+    } else {
+        for(unsigned level = 0; level < levelCount; ++level){
+            GLsizei levelWidth = (GLsizei)std::max(1u, width >> level);
+            GLsizei levelHeight = (GLsizei)std::max(1u, height >> level);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, (GLint)sizedFormat, levelWidth, levelHeight, (GLsizei)layerCount, 0,
+                         Texture::transferFormat(format), GL_UNSIGNED_BYTE, NULL);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+TextureArray::TextureArray(BlockFormat format, unsigned width, unsigned height, unsigned layerCount, unsigned levelCount, GLint wrapMode, GLfloat maxAnisotropy) :
+    _object(0),
+    _format(Bitmap::Format_RGBA),
+    _layerCount(layerCount)
+{
+    if(layerCount == 0 || levelCount == 0)
+        throw std::runtime_error("A texture array needs at least one layer and one mip level");
+    if(!GLEW_EXT_texture_compression_s3tc)
+        throw std::runtime_error("S3TC compressed textures are not supported by the driver");
+
+    glGenTextures(1, &_object);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _object);
+    Texture::setMipmapSampling(GL_TEXTURE_2D_ARRAY, levelCount, wrapMode, maxAnisotropy);
+
+    GLenum compressedFormat = Texture::compressedFormat(format);
+    if(GLEW_ARB_texture_storage){
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, (GLsizei)levelCount, compressedFormat, (GLsizei)width, (GLsizei)height, (GLsizei)layerCount);
+    } else {
+        for(unsigned level = 0; level < levelCount; ++level){
+            unsigned levelWidth = std::max(1u, width >> level);
+            unsigned levelHeight = std::max(1u, height >> level);
+            GLsizei levelSize = (GLsizei)(((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * (unsigned)format * layerCount);
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, compressedFormat, (GLsizei)levelWidth, (GLsizei)levelHeight,
+                                   (GLsizei)layerCount, 0, levelSize, NULL);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+TextureArray::~TextureArray() {
+    glDeleteTextures(1, &_object);
+}
+
+GLuint TextureArray::object() const {
+    return _object;
+}
+
+unsigned TextureArray::layerCount() const {
+    return _layerCount;
+}
+
+void TextureArray::setLayer(unsigned layer, unsigned level, const Bitmap& bitmap) {
+    if(layer >= _layerCount)
+        throw std::runtime_error("Texture array layer out of range");
+    if(bitmap.format() != _format)
+        throw std::runtime_error("Bitmap format does not match the texture array");
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, _object);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)level, 0, 0, (GLint)layer,
+                    (GLsizei)bitmap.width(), (GLsizei)bitmap.height(), 1,
+                    Texture::transferFormat(bitmap.format()), GL_UNSIGNED_BYTE, bitmap.pixelBuffer());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
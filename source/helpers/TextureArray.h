@@ -0,0 +1,54 @@
+#include "Texture.h"
+
+namespace helpers {
+
+    /**
+     A GL_TEXTURE_2D_ARRAY: `layerCount` images of the same size and format,
+     bound and sampled as one texture, so draws using different layers
+     don't need a bind in between.
+
+     Only storage is allocated, the layers are filled with `setLayer` or by
+     TextureStreamer. Sampling is trilinear like the mipmapped Texture.
+     */
+    class TextureArray {
+    public:
+        /** RGB or RGBA layers, sRGB like Texture */
+        TextureArray(Bitmap::Format format,
+                     unsigned width,
+                     unsigned height,
+                     unsigned layerCount,
+                     unsigned levelCount,
+                     GLint wrapMode = GL_CLAMP_TO_EDGE,
+                     GLfloat maxAnisotropy = 8.0f);
+
+        /** Block-compressed layers, throws without S3TC support */
+        TextureArray(BlockFormat format,
+                     unsigned width,
+                     unsigned height,
+                     unsigned layerCount,
+                     unsigned levelCount,
+                     GLint wrapMode = GL_CLAMP_TO_EDGE,
+                     GLfloat maxAnisotropy = 8.0f);
+
+        ~TextureArray();
+
+        GLuint object() const;
+        unsigned layerCount() const;
+
+        /**
+         Uploads one level of one layer right away, for small textures such
+         as placeholders. The bitmap must have the layer's size at that
+         level and the array's format.
+         */
+        void setLayer(unsigned layer, unsigned level, const Bitmap& bitmap);
+
+    private:
+        GLuint _object;
+        Bitmap::Format _format;
+        unsigned _layerCount;
+
+        TextureArray(const TextureArray&);
+        const TextureArray& operator=(const TextureArray&);
+    };
+
+}
@@ -0,0 +1,280 @@
+#include "TextureStreamer.h"
+#include "GLState.h"
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using namespace helpers;
+
+// ring offsets stay aligned to this, for the copies into the ring
+static const size_t RingAlignment = 16;
+
+TextureStreamer::Upload::Upload(const Texture& texture, Bitmap::Format format, const std::vector<Level>& levels) :
+    _target(GL_TEXTURE_2D),
+    _texture(texture.object()),
+    _layer(0),
+    _compressed(false),
+    _format(Texture::transferFormat(format)),
+    _bytesPerPixel((size_t)format),
+    _bytesPerBlock(0),
+    _levels(levels),
+    _levelsSent(0),
+    _finestLevel(0),
+    _row(0)
+{
+    _checkLevelSizes();
+}
+
+TextureStreamer::Upload::Upload(const Texture& texture, BlockFormat format, const std::vector<Level>& levels) :
+    _target(GL_TEXTURE_2D),
+    _texture(texture.object()),
+    _layer(0),
+    _compressed(true),
+    _format(Texture::compressedFormat(format)),
+    _bytesPerPixel(0),
+    _bytesPerBlock((size_t)format),
+    _levels(levels),
+    _levelsSent(0),
+    _finestLevel(0),
+    _row(0)
+{
+    _checkLevelSizes();
+}
+
+TextureStreamer::Upload::Upload(const TextureArray& array, unsigned layer, Bitmap::Format format, const std::vector<Level>& levels) :
+    _target(GL_TEXTURE_2D_ARRAY),
+    _texture(array.object()),
+    _layer((GLint)layer),
+    _compressed(false),
+    _format(Texture::transferFormat(format)),
+    _bytesPerPixel((size_t)format),
+    _bytesPerBlock(0),
+    _levels(levels),
+    _levelsSent(0),
+    _finestLevel(0),
+    _row(0)
+{
+    if(layer >= array.layerCount())
+        throw std::runtime_error("Texture array layer out of range");
+    _checkLevelSizes();
+}
+
+TextureStreamer::Upload::Upload(const TextureArray& array, unsigned layer, BlockFormat format, const std::vector<Level>& levels) :
+    _target(GL_TEXTURE_2D_ARRAY),
+    _texture(array.object()),
+    _layer((GLint)layer),
+    _compressed(true),
+    _format(Texture::compressedFormat(format)),
+    _bytesPerPixel(0),
+    _bytesPerBlock((size_t)format),
+    _levels(levels),
+    _levelsSent(0),
+    _finestLevel(0),
+    _row(0)
+{
+    if(layer >= array.layerCount())
+        throw std::runtime_error("Texture array layer out of range");
+    _checkLevelSizes();
+}
+
+bool TextureStreamer::Upload::done() const {
+    return _levelsSent >= _levels.size();
+}
+
+unsigned TextureStreamer::Upload::residentLevel() const {
+    return (unsigned)_levels.size() - _levelsSent;
+}
+
+void TextureStreamer::Upload::setFinestLevel(unsigned level) {
+    _finestLevel = level;
+}
+
+unsigned TextureStreamer::Upload::_level() const {
+    return residentLevel() - 1;
+}
+
+bool TextureStreamer::Upload::_held() const {
+    return residentLevel() <= _finestLevel;
+}
+
+void TextureStreamer::Upload::_checkLevelSizes() const {
+    for(size_t i = 0; i < _levels.size(); ++i){
+        size_t expected = _compressed ? (size_t)((_levels[i].width + 3) / 4) * ((_levels[i].height + 3) / 4) * _bytesPerBlock
+                                      : (size_t)_levels[i].width * _levels[i].height * _bytesPerPixel;
+        if(_levels[i].size < expected)
+            throw std::runtime_error("Texture level to stream is smaller than its dimensions");
+    }
+}
+
+TextureStreamer::TextureStreamer(size_t ringBytes, size_t tileBytes) :
+    _buffer(0),
+    _ringBytes(ringBytes / RingAlignment * RingAlignment),
+    _tileBytes(tileBytes),
+    _mapping(NULL),
+    _head(0),
+    _tail(0)
+{
+    if(_ringBytes == 0 || tileBytes == 0 || tileBytes > _ringBytes)
+        throw std::runtime_error("Texture streaming ring must hold at least one tile");
+    std::memset(&_stats, 0, sizeof(_stats));
+
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+    if(GLEW_ARB_buffer_storage){
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)_ringBytes, NULL, flags);
+        _mapping = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)_ringBytes, flags);
+        if(!_mapping){
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glDeleteBuffers(1, &_buffer);
+            throw std::runtime_error("Failed to map the texture streaming ring");
+        }
+    } else {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)_ringBytes, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureStreamer::~TextureStreamer() {
+    for(size_t i = 0; i < _fences.size(); ++i)
+        glDeleteSync(_fences[i].sync);
+
+    if(_mapping){
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &_buffer);
+}
+
+size_t TextureStreamer::stream(Upload& upload, size_t byteBudget, GLState& state) {
+    if(upload.done() || upload._held())
+        return 0;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+    glBindTexture(upload._target, upload._texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    size_t sent = 0;
+    while(!upload.done() && !upload._held() && (sent == 0 || sent < byteBudget)){
+        const GLint levelIndex = (GLint)upload._level();
+        const Level& level = upload._levels[levelIndex];
+
+        // a unit is one row, or one row of 4x4 blocks
+        const unsigned rowsPerUnit = upload._compressed ? 4 : 1;
+        const size_t unitBytes = upload._compressed ? ((level.width + 3) / 4) * upload._bytesPerBlock
+                                                    : level.width * upload._bytesPerPixel;
+        const size_t unitsLeft = (level.height - upload._row + rowsPerUnit - 1) / rowsPerUnit;
+        const size_t units = std::min(unitsLeft, std::max((size_t)1, _tileBytes / unitBytes));
+        const size_t bytes = units * unitBytes;
+
+        // wait for GL only if this call would otherwise send nothing
+        size_t offset = 0;
+        if(!_reserve(bytes, sent == 0, offset))
+            break;
+
+        const unsigned char* source = level.data + (upload._row / rowsPerUnit) * unitBytes;
+        if(_mapping){
+            std::memcpy(_mapping + offset, source, bytes);
+        } else {
+            // the fences already keep GL off this range, so no implicit sync is needed
+            const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+            void* destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, (GLintptr)offset, (GLsizeiptr)bytes, access);
+            if(!destination)
+                throw std::runtime_error("Failed to map the texture streaming ring");
+            std::memcpy(destination, source, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        const unsigned rows = std::min((unsigned)(units * rowsPerUnit), level.height - upload._row);
+        if(upload._target == GL_TEXTURE_2D_ARRAY && upload._compressed){
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, levelIndex, 0, (GLint)upload._row, upload._layer,
+                                      (GLsizei)level.width, (GLsizei)rows, 1, upload._format,
+                                      (GLsizei)bytes, (const GLvoid*)offset);
+        } else if(upload._target == GL_TEXTURE_2D_ARRAY){
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, levelIndex, 0, (GLint)upload._row, upload._layer,
+                            (GLsizei)level.width, (GLsizei)rows, 1, upload._format,
+                            GL_UNSIGNED_BYTE, (const GLvoid*)offset);
+        } else if(upload._compressed){
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, levelIndex, 0, (GLint)upload._row,
+                                      (GLsizei)level.width, (GLsizei)rows, upload._format,
+                                      (GLsizei)bytes, (const GLvoid*)offset);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, levelIndex, 0, (GLint)upload._row,
+                            (GLsizei)level.width, (GLsizei)rows, upload._format,
+                            GL_UNSIGNED_BYTE, (const GLvoid*)offset);
+        }
+
+        Fence fence;
+        fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        fence.end = _head;
+        _fences.push_back(fence);
+
+        sent += bytes;
+        _stats.bytesUploaded += bytes;
+        ++_stats.tilesUploaded;
+
+        upload._row += rows;
+        if(upload._row >= level.height){
+            upload._row = 0;
+            ++upload._levelsSent;
+            if(upload.done())
+                ++_stats.texturesUploaded;
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(upload._target, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    state.forgetTextures();
+    return sent;
+}
+
+bool TextureStreamer::persistentlyMapped() const {
+    return _mapping != NULL;
+}
+
+const TextureStreamer::Stats& TextureStreamer::stats() const {
+    return _stats;
+}
+
+// finds `bytes` of contiguous ring space, skipping the end of the ring if the tile doesn't fit there
+bool TextureStreamer::_reserve(size_t bytes, bool mayWait, size_t& offset) {
+    const size_t aligned = (bytes + RingAlignment - 1) / RingAlignment * RingAlignment;
+    if(aligned > _ringBytes)
+        throw std::runtime_error("Texture tile is larger than the streaming ring");
+
+    const size_t position = (size_t)(_head % _ringBytes);
+    const size_t skip = position + aligned > _ringBytes ? _ringBytes - position : 0;
+
+    while(_head + skip + aligned - _tail > _ringBytes){
+        if(_fences.empty())
+            throw std::logic_error("Texture streaming ring is full with no tiles in flight");
+
+        const Fence& oldest = _fences.front();
+        GLenum status = glClientWaitSync(oldest.sync, 0, 0);
+        if(status == GL_TIMEOUT_EXPIRED){
+            if(!mayWait)
+                return false;
+
+            typedef std::chrono::steady_clock Clock;
+            const Clock::time_point start = Clock::now();
+            do {
+                status = glClientWaitSync(oldest.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while(status == GL_TIMEOUT_EXPIRED);
+            ++_stats.stalls;
+            _stats.stallSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        if(status == GL_WAIT_FAILED)
+            throw std::runtime_error("Waiting for a texture streaming fence failed");
+
+        _tail = oldest.end;
+        glDeleteSync(oldest.sync);
+        _fences.pop_front();
+    }
+
+    offset = skip ? 0 : position;
+    _head += skip + aligned;
+    return true;
+}
@@ -0,0 +1,130 @@
+#include "TextureArray.h"
+#include <deque>
+#include <stdint.h>
+
+namespace helpers {
+
+    class GLState;
+
+    /**
+     Streams texture levels to GL a few tiles per frame through a ring of
+     pixel buffer memory.
+
+     Each tile (a band of whole rows, or block rows when compressed) is
+     copied into the ring and then handed to glTexSubImage2D /
+     glCompressedTexSubImage2D from there, so GL copies to the texture
+     asynchronously instead of stalling the frame. Every tile is followed by
+     a fence, and ring space is only reused once its fence has passed.
+
+     Levels go smallest first, so the mip tail of a large texture is in
+     place after the first few tiles and can be sampled with
+     GL_TEXTURE_BASE_LEVEL at `residentLevel` while the larger levels are
+     still on their way.
+
+     The ring is mapped once and left mapped when the driver has
+     ARB_buffer_storage, otherwise each tile maps its own range
+     unsynchronized. Textures must have their storage already, see the
+     storage constructors of Texture.
+
+     Create and use the streamer on the thread that owns the GL context.
+     */
+    class TextureStreamer {
+    public:
+        struct Level {
+            unsigned width;
+            unsigned height;
+            const unsigned char* data;
+            size_t size;
+        };
+
+        /**
+         One texture, or one layer of a texture array, being streamed, the
+         last (smallest) level first. The caller owns it and keeps
+         `levels[i].data` alive until `done()`.
+         */
+        class Upload {
+        public:
+            Upload(const Texture& texture, Bitmap::Format format, const std::vector<Level>& levels);
+            Upload(const Texture& texture, BlockFormat format, const std::vector<Level>& levels);
+            Upload(const TextureArray& array, unsigned layer, Bitmap::Format format, const std::vector<Level>& levels);
+            Upload(const TextureArray& array, unsigned layer, BlockFormat format, const std::vector<Level>& levels);
+
+            bool done() const;
+            // lowest level that is sent along with every level after it, the level count before that
+            unsigned residentLevel() const;
+            // holds back the levels below `level` until it is lowered again, 0 by default
+            void setFinestLevel(unsigned level);
+
+        private:
+            friend class TextureStreamer;
+
+            GLenum _target;
+            GLuint _texture;
+            GLint _layer;               // GL_TEXTURE_2D_ARRAY only
+            bool _compressed;
+            GLenum _format;
+            size_t _bytesPerPixel;      // uncompressed only
+            size_t _bytesPerBlock;      // compressed only
+            std::vector<Level> _levels;
+            unsigned _levelsSent;       // from the end of `_levels`, the next level is the one before
+            unsigned _finestLevel;
+            unsigned _row;              // next row of that level, a multiple of 4 when compressed
+
+            unsigned _level() const;
+            bool _held() const;
+
+            void _checkLevelSizes() const;
+        };
+
+        struct Stats {
+            uint64_t bytesUploaded;
+            unsigned tilesUploaded;
+            unsigned texturesUploaded;
+            unsigned stalls;            // times the CPU waited for GL to release ring space
+            double stallSeconds;
+        };
+
+        /**
+         `ringBytes` of pixel buffer memory, handed out in tiles of about
+         `tileBytes` (at least one row).
+         */
+        explicit TextureStreamer(size_t ringBytes = 16 * 1024 * 1024, size_t tileBytes = 256 * 1024);
+        ~TextureStreamer();
+
+        /**
+         Sends tiles of `upload` until about `byteBudget` bytes went out or
+         the upload is done or held back at its finest level. Returns the
+         bytes sent, which may overshoot the budget by less than a tile.
+
+         If the ring is full of data GL hasn't consumed yet, it returns early
+         rather than wait, unless nothing could be sent at all this call.
+         Binds the upload's texture target and GL_PIXEL_UNPACK_BUFFER, which
+         are unbound again afterwards, and has `state` forget its texture
+         bindings whenever it did.
+         */
+        size_t stream(Upload& upload, size_t byteBudget, GLState& state);
+
+        bool persistentlyMapped() const;
+        const Stats& stats() const;
+
+    private:
+        struct Fence {
+            GLsync sync;
+            uint64_t end;               // ring position the fenced tiles end at
+        };
+
+        GLuint _buffer;
+        size_t _ringBytes;
+        size_t _tileBytes;
+        unsigned char* _mapping;        // NULL unless persistently mapped
+        uint64_t _head;                 // total bytes handed out, the ring offset is _head % _ringBytes
+        uint64_t _tail;                 // everything before this is free again
+        std::deque<Fence> _fences;
+        Stats _stats;
+
+        bool _reserve(size_t bytes, bool mayWait, size_t& offset);
+        TextureStreamer(const TextureStreamer&);
+        const TextureStreamer& operator=(const TextureStreamer&);
+    };
+
+}
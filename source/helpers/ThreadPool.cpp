@@ -0,0 +1,121 @@
+#include "ThreadPool.h"
+#include <atomic>
+#include <memory>
+#include <exception>
+
+using namespace helpers;
+
+namespace {
+    // lives until the last helper task lets go, which may be after parallelFor returned
+    struct ParallelForState {
+        std::function<void(size_t)> body;
+        size_t count;
+        std::atomic<size_t> next;
+        std::atomic<size_t> finished;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+
+        void run() {
+            size_t i;
+            while((i = next++) < count){
+                try {
+                    body(i);
+                } catch(...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(!error)
+                        error = std::current_exception();
+                }
+                if(++finished == count){
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done.notify_all();
+                }
+            }
+        }
+    };
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) :
+    _stopping(false)
+{
+    if(threadCount == 0){
+        unsigned hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    for(unsigned i = 0; i < threadCount; ++i)
+        _threads.push_back(std::thread(&ThreadPool::_workerLoop, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for(size_t i = 0; i < _threads.size(); ++i)
+        _threads[i].join();
+}
+
+void ThreadPool::submit(const std::function<void()>& task) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(task);
+    }
+    _wake.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if(count == 0)
+        return;
+    if(count == 1 || _threads.empty()){
+        for(size_t i = 0; i < count; ++i)
+            body(i);
+        return;
+    }
+
+    std::shared_ptr<ParallelForState> state(new ParallelForState());
+    state->body = body;
+    state->count = count;
+    state->next = 0;
+    state->finished = 0;
+
+    size_t helperCount = count - 1 < _threads.size() ? count - 1 : _threads.size();
+    for(size_t i = 0; i < helperCount; ++i)
+        submit([state]() { state->run(); });
+
+    // the caller works too, so nested calls from a worker can't deadlock
+    state->run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while(state->finished < count)
+        state->done.wait(lock);
+
+    if(state->error)
+        std::rethrow_exception(state->error);
+}
+
+unsigned ThreadPool::threadCount() const {
+    return (unsigned)_threads.size();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::_workerLoop() {
+    for(;;){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while(!_stopping && _tasks.empty())
+                _wake.wait(lock);
+            if(_tasks.empty())
+                return; // stopping and drained
+            task = _tasks.front();
+            _tasks.pop_front();
+        }
+        task();
+    }
+}
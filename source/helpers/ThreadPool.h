@@ -0,0 +1,53 @@
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+namespace helpers {
+
+    /**
+     Fixed set of worker threads running queued tasks.
+
+     `parallelFor` splits a loop across the workers and the calling thread
+     and waits for it, which is what the image kernels use. `submit` queues
+     fire-and-forget work.
+     */
+    class ThreadPool {
+    public:
+        // 0 threads: one less than the hardware threads, since parallelFor's caller works too
+        explicit ThreadPool(unsigned threadCount = 0);
+        // runs the tasks still queued, then joins the workers
+        ~ThreadPool();
+
+        void submit(const std::function<void()>& task);
+
+        /**
+         Calls `body(i)` for every i in [0, count) and returns once all calls are done.
+
+         Indices are handed out one at a time, so give each call a decent
+         chunk of work (e.g. a row of tiles). The first exception thrown by
+         `body` is rethrown here, after the other calls finish.
+         */
+        void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+        unsigned threadCount() const;
+
+        // pool shared by the helpers, created on first use
+        static ThreadPool& shared();
+
+    private:
+        std::vector<std::thread> _threads;
+        std::deque<std::function<void()> > _tasks;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        bool _stopping;
+
+        void _workerLoop();
+        ThreadPool(const ThreadPool&);
+        const ThreadPool& operator=(const ThreadPool&);
+    };
+
+}
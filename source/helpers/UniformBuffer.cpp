@@ -0,0 +1,62 @@
+#include "UniformBuffer.h"
+#include <stdexcept>
+#include <cstring>
+
+using namespace helpers;
+
+UniformBuffer::UniformBuffer(GLsizeiptr size, GLuint bindingPoint, GLenum usage) :
+    _object(0),
+    _bindingPoint(bindingPoint),
+    _contents(size),
+    _uploaded(false)
+{
+    if(size <= 0)
+        throw std::runtime_error("Uniform buffer size must be positive");
+
+    glGenBuffers(1, &_object);
+    if(_object == 0)
+        throw std::runtime_error("glGenBuffers failed");
+
+    glBindBuffer(GL_UNIFORM_BUFFER, _object);
+    glBufferData(GL_UNIFORM_BUFFER, size, NULL, usage);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, _bindingPoint, _object);
+}
+
+UniformBuffer::~UniformBuffer() {
+    if(_object != 0) glDeleteBuffers(1, &_object);
+}
+
+GLuint UniformBuffer::object() const {
+    return _object;
+}
+
+GLuint UniformBuffer::bindingPoint() const {
+    return _bindingPoint;
+}
+
+GLsizeiptr UniformBuffer::size() const {
+    return (GLsizeiptr)_contents.size();
+}
+
+bool UniformBuffer::update(const void* data, GLsizeiptr size, GLintptr offset) {
+    if(offset < 0 || size <= 0 || offset + size > (GLsizeiptr)_contents.size())
+        throw std::runtime_error("Uniform buffer update out of range");
+
+    unsigned char* contents = &_contents[offset];
+    if(_uploaded && memcmp(contents, data, size) == 0)
+        return false;
+
+    memcpy(contents, data, size);
+    glBindBuffer(GL_UNIFORM_BUFFER, _object);
+    if(_uploaded){
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+    } else {
+        // the first upload fills the whole buffer, including unwritten bytes
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, (GLsizeiptr)_contents.size(), &_contents[0]);
+        _uploaded = true;
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return true;
+}
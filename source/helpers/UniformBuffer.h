@@ -0,0 +1,41 @@
+#include <GL/glew.h>
+#include <vector>
+
+namespace helpers {
+
+    /**
+     A uniform buffer object attached to a fixed binding point.
+
+     Programs see the buffer through any uniform block that has been bound to
+     the same binding point with `Program::bindUniformBlock`. The buffer keeps
+     a copy of its contents, so `update` only talks to GL when the bytes
+     actually change.
+     */
+    class UniformBuffer {
+    public:
+        UniformBuffer(GLsizeiptr size, GLuint bindingPoint, GLenum usage = GL_DYNAMIC_DRAW);
+        ~UniformBuffer();
+
+        GLuint object() const;
+        GLuint bindingPoint() const;
+        GLsizeiptr size() const;
+
+        /**
+         Writes `size` bytes at `offset` into the buffer.
+
+         Returns false, without any GL call, if the range already holds
+         exactly these bytes.
+         */
+        bool update(const void* data, GLsizeiptr size, GLintptr offset = 0);
+
+    private:
+        GLuint _object;
+        GLuint _bindingPoint;
+        std::vector<unsigned char> _contents;
+        bool _uploaded;
+
+        UniformBuffer(const UniformBuffer&);
+        const UniformBuffer& operator=(const UniformBuffer&);
+    };
+
+}
@@ -0,0 +1,171 @@
+#include "VertexCacheOptimizer.h"
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+
+using namespace helpers;
+
+// constants from Forsyth's "Linear-Speed Vertex Cache Optimisation"
+static const int CacheSize = 32;
+static const float CacheDecayPower = 1.5f;
+static const float LastTriScore = 0.75f;
+static const float ValenceBoostScale = 2.0f;
+static const float ValenceBoostPower = 0.5f;
+
+static float VertexScore(int cachePosition, unsigned remainingTriangles) {
+    if(remainingTriangles == 0)
+        return -1.0f; // no triangles left to emit, never worth picking
+
+    float score = 0.0f;
+    if(cachePosition >= 0){
+        if(cachePosition < 3){
+            // used by the triangle just emitted, fixed score so it is not
+            // preferred over slightly older vertices
+            score = LastTriScore;
+        } else {
+            float scaler = 1.0f / (CacheSize - 3);
+            score = powf(1.0f - (cachePosition - 3) * scaler, CacheDecayPower);
+        }
+    }
+
+    // vertices with few triangles left get a boost, to finish them off
+    score += ValenceBoostScale * powf((float)remainingTriangles, -ValenceBoostPower);
+    return score;
+}
+
+void helpers::OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount) {
+    if(indexCount % 3 != 0)
+        throw std::runtime_error("Index count is not a multiple of three");
+
+    const size_t triangleCount = indexCount / 3;
+    if(triangleCount < 2)
+        return;
+
+    // triangles using each vertex, as offsets into one flat array
+    std::vector<unsigned> triangleStart(vertexCount + 1, 0);
+    for(size_t i = 0; i < indexCount; ++i){
+        if(indices[i] >= vertexCount)
+            throw std::runtime_error("Index out of range");
+        ++triangleStart[indices[i] + 1];
+    }
+    for(size_t v = 0; v < vertexCount; ++v)
+        triangleStart[v + 1] += triangleStart[v];
+
+    std::vector<unsigned> vertexTriangles(indexCount);
+    std::vector<unsigned> remaining(vertexCount, 0);
+    for(size_t i = 0; i < indexCount; ++i){
+        GLuint v = indices[i];
+        vertexTriangles[triangleStart[v] + remaining[v]++] = (unsigned)(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v)
+        vertexScore[v] = VertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for(size_t t = 0; t < triangleCount; ++t)
+        triangleScore[t] = vertexScore[indices[t*3]] + vertexScore[indices[t*3 + 1]] + vertexScore[indices[t*3 + 2]];
+
+    std::vector<GLuint> output;
+    output.reserve(indexCount);
+
+    // one extra slot for the three vertices pushed by each triangle
+    std::vector<int> cache;
+    cache.reserve(CacheSize + 3);
+
+    size_t scanCursor = 0;
+    int bestTriangle = -1;
+    float bestScore = -1.0f;
+
+    while(output.size() < indexCount){
+        if(bestTriangle < 0){
+            // nothing good in the cache, fall back to the best remaining triangle
+            while(scanCursor < triangleCount && emitted[scanCursor])
+                ++scanCursor;
+            bestScore = -1.0f;
+            for(size_t t = scanCursor; t < triangleCount; ++t){
+                if(!emitted[t] && triangleScore[t] > bestScore){
+                    bestScore = triangleScore[t];
+                    bestTriangle = (int)t;
+                }
+            }
+        }
+
+        // emit it and take it out of its vertices' triangle lists
+        emitted[bestTriangle] = true;
+        for(int corner = 0; corner < 3; ++corner){
+            GLuint v = indices[bestTriangle*3 + corner];
+            output.push_back(v);
+
+            unsigned* first = &vertexTriangles[triangleStart[v]];
+            for(unsigned i = 0; i < remaining[v]; ++i){
+                if(first[i] == (unsigned)bestTriangle){
+                    first[i] = first[remaining[v] - 1];
+                    break;
+                }
+            }
+            --remaining[v];
+        }
+
+        // move its vertices to the front of the LRU cache
+        std::vector<int> newCache;
+        newCache.reserve(CacheSize + 3);
+        for(int corner = 0; corner < 3; ++corner)
+            newCache.push_back((int)indices[bestTriangle*3 + corner]);
+        for(size_t i = 0; i < cache.size(); ++i){
+            int v = cache[i];
+            if(v != newCache[0] && v != newCache[1] && v != newCache[2])
+                newCache.push_back(v);
+        }
+        for(size_t i = CacheSize; i < newCache.size(); ++i)
+            cachePosition[newCache[i]] = -1;
+        if(newCache.size() > (size_t)CacheSize)
+            newCache.resize(CacheSize);
+        cache.swap(newCache);
+
+        // rescore what is in the cache and pick the next triangle among its neighbours
+        for(size_t i = 0; i < cache.size(); ++i){
+            cachePosition[cache[i]] = (int)i;
+        }
+        for(size_t i = 0; i < cache.size(); ++i){
+            int v = cache[i];
+            float newScore = VertexScore((int)i, remaining[v]);
+            float delta = newScore - vertexScore[v];
+            vertexScore[v] = newScore;
+            for(unsigned k = 0; k < remaining[v]; ++k)
+                triangleScore[vertexTriangles[triangleStart[v] + k]] += delta;
+        }
+
+        bestTriangle = -1;
+        bestScore = -1.0f;
+        for(size_t i = 0; i < cache.size(); ++i){
+            int v = cache[i];
+            for(unsigned k = 0; k < remaining[v]; ++k){
+                unsigned t = vertexTriangles[triangleStart[v] + k];
+                if(triangleScore[t] > bestScore){
+                    bestScore = triangleScore[t];
+                    bestTriangle = (int)t;
+                }
+            }
+        }
+    }
+
+    for(size_t i = 0; i < indexCount; ++i)
+        indices[i] = output[i];
+}
+
+size_t helpers::SimulateVertexCacheMisses(const GLuint* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize) {
+    // FIFO, like most fixed-size post-transform caches
+    std::vector<size_t> insertedAt(vertexCount, 0);
+    size_t misses = 0;
+    for(size_t i = 0; i < indexCount; ++i){
+        GLuint v = indices[i];
+        if(insertedAt[v] == 0 || misses - insertedAt[v] >= cacheSize){
+            ++misses;
+            insertedAt[v] = misses;
+        }
+    }
+    return misses;
+}
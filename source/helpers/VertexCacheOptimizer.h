@@ -0,0 +1,23 @@
+#include <GL/glew.h>
+#include <cstddef>
+
+namespace helpers {
+
+    /**
+     Reorders the triangles of an indexed triangle list for the GPU's
+     post-transform vertex cache, using Tom Forsyth's linear-speed algorithm.
+
+     The triangles are kept as they are, only their order changes, so the
+     mesh renders the same but re-uses more vertex shader results.
+     */
+    void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount);
+
+    /**
+     Number of vertex shader invocations an indexed triangle list costs on a
+     FIFO post-transform cache with `cacheSize` entries.
+
+     Divide by the triangle count to get the ACMR (average cache miss ratio).
+     */
+    size_t SimulateVertexCacheMisses(const GLuint* indices, size_t indexCount, size_t vertexCount, unsigned cacheSize);
+
+}
@@ -5,53 +5,101 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
-#include <list>
-#include <sstream>
 
-#include "helpers/Program.h"
-#include "helpers/Texture.h"
+#include "helpers/ShaderVariants.h"
+#include "helpers/AssetLoader.h"
 #include "helpers/Camera.h"
+#include "helpers/UniformBuffer.h"
+#include "helpers/MeshCache.h"
+#include "helpers/RenderQueue.h"
+#include "helpers/GLState.h"
+#include "helpers/InstanceStore.h"
+#include "helpers/SceneGraph.h"
+#include "helpers/MatrixKernels.h"
 
 using namespace helpers;
 
-//  , , VBO, VAO    glDrawArrays
+//    MAX_LIGHTS  MAX_MATERIALS   
+const size_t MAX_LIGHTS = 10;
+const size_t MAX_MATERIALS = 256;
+
+//   uniform-,    
+enum UniformBlockBinding {
+    LIGHTS_BLOCK_BINDING = 0,
+    FRAME_BLOCK_BINDING = 1,
+    MATERIALS_BLOCK_BINDING = 2
+};
+
+//    ,     
+enum VertexAttrib {
+    VERT_ATTRIB = 0,
+    VERT_TEX_COORD_ATTRIB = 1,
+    VERT_NORMAL_ATTRIB = 2,
+    INSTANCE_MODEL_ATTRIB = 3,          // mat4,  4 
+    INSTANCE_NORMAL_MATRIX_ATTRIB = 7,  // mat3,  3 
+    INSTANCE_MATERIAL_ATTRIB = 10,
+    INSTANCE_MVP_ATTRIB = 11            // mat4,  4 
+};
+
+//     GPU
+enum RenderMode {
+    RENDER_INSTANCED,            // glDrawElementsInstanced   
+    RENDER_MULTI_DRAW_INDIRECT   //  glMultiDrawElementsIndirect  
+};
+
+//  , , VAO       glDrawElements
 struct ModelAsset {
-    Program* shaders;
-    Texture* texture;
-    GLuint vbo;
+    ShaderVariants* shaders; //     
+    TextureAsset* texture; //    ,  ,  
+    GLint textureImage; //     , . TextureAsset::region
     GLuint vao;
+    GLuint mesh; //     
     GLenum drawType;
-    GLint drawStart;
-    GLint drawCount;
+    GLint drawStart; //      
+    GLint drawCount; //  
     GLfloat shininess;
     glm::vec3 specularColor;
+    GLint material; //    Materials
+    GLuint id; //   gModelAssets,        gInstances
+    BoundingBox bounds; //    
+    BoundingSphere boundingSphere;
 
     ModelAsset() :
         shaders(NULL),
         texture(NULL),
-        vbo(0),
+        textureImage(-1),
         vao(0),
+        mesh(0),
         drawType(GL_TRIANGLES),
         drawStart(0),
         drawCount(0),
         shininess(0.0f),
-        specularColor(1.0f, 1.0f, 1.0f)
+        specularColor(1.0f, 1.0f, 1.0f),
+        material(-1),
+        id(0)
     {}
 };
 
-//   -       
-struct ModelInstance {
-    ModelAsset* asset;
-    glm::mat4 transform;
+//      
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat4 modelViewProjection;
+    glm::mat3 normalMatrix;
+    GLint material;
+};
 
-    ModelInstance() :
-        asset(NULL),
-        transform()
-    {}
+//     GL  ,    
+struct InstanceBatch {
+    ModelAsset* asset;
+    Program* program; //      
+    GLsizei firstInstance;
+    GLsizei instanceCount;
 };
 
 // 
@@ -64,50 +112,258 @@ struct Light {
     glm::vec3 coneDirection;
 };
 
+//     std140  Lights
+struct PackedLight {
+    glm::vec4 position;
+    glm::vec3 intensities;
+    GLfloat attenuation;
+    glm::vec3 coneDirection;
+    GLfloat coneCosine;
+    GLfloat ambientCoefficient;
+    GLfloat padding[3];
+};
+
+//  uniform- Lights   :   ,  
+struct LightBlock {
+    PackedLight lights[MAX_LIGHTS];
+};
+
+//      ,  std140  FrameConstants
+struct FrameConstants {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec3 cameraPosition;
+    GLfloat time;
+};
+
+//    std140  Materials
+struct PackedMaterial {
+    glm::vec3 specularColor;
+    GLfloat shininess;
+    GLint textureLayer;
+    GLint padding;
+    glm::vec2 textureGutter; //        UV
+    glm::vec4 textureRect; //    UV   
+};
+
+//  uniform- Materials,     
+struct MaterialBlock {
+    PackedMaterial materials[MAX_MATERIALS];
+};
+
+//  glMultiDrawElementsIndirect,   OpenGL
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+static_assert(sizeof(PackedMaterial) == 48, "PackedMaterial must match the std140 Material struct");
+static_assert(sizeof(FrameConstants) == 3 * 64 + 16, "FrameConstants must match the std140 FrameConstants block");
+static_assert(sizeof(PackedLight) == 64, "PackedLight must match the std140 Light struct");
+static_assert(sizeof(LightBlock) == 64 * MAX_LIGHTS, "LightBlock must match the std140 Lights block");
+
 const glm::vec2 SCREEN_SIZE(1280, 720);
+const size_t TEXTURE_UPLOAD_BUDGET = 4 * 1024 * 1024; //  ,   GL  
+const size_t TEXTURE_MEMORY_BUDGET = 256 * 1024 * 1024; //    ,    
 
 GLFWwindow* gWindow = NULL;
+ProgramCache* gPrograms = NULL;
+ShaderVariants* gStandardShaders = NULL;
 Camera gCamera;
 ModelAsset gWoodenCube;
 ModelAsset gGrassFloor;
 ModelAsset gBrickWall;
-std::list<ModelInstance> gInstances;
-GLfloat gDegreesRotated = 0.0f;
+std::vector<ModelAsset*> gModelAssets;
+InstanceStore gInstances; //   : , , , 
+GLfloat gDegreesRotated = 0.0f; //   P  
+SceneGraph gScene; //    gInstances   
+std::vector<InstanceStore::Handle> gNodeInstances; //    gScene,   - 
+SceneGraph::Node gLetterP = SceneGraph::NoParent;
 std::vector<Light> gLights;
+UniformBuffer* gLightBuffer = NULL;
+UniformBuffer* gFrameBuffer = NULL;
+UniformBuffer* gMaterialBuffer = NULL;
+MaterialBlock gMaterialBlock;
+GLint gMaterialCount = 0;
+GeometryArena* gGeometry = NULL;
+MeshCache* gMeshCache = NULL;
+AssetLoader* gAssets = NULL;
+bool gTexturesReported = false;
+std::vector<std::string> gMaterialTextureFiles;
+TextureAsset* gMaterialTextures = NULL;
+TextureAsset::State gMaterialTexturesState = TextureAsset::State_Loading;
+GLuint gInstanceBuffer = 0;
+GLuint gIndirectBuffer = 0;
+std::vector<InstanceData> gInstanceData;
+std::vector<InstanceBatch> gBatches;
+bool gPickKeyDown = false;
+std::vector<unsigned> gVisibleInstances; //   gInstances
+size_t gCulledInstanceCount = 0;
+size_t gReportedVisibleCount = ~size_t(0);
+RenderQueue gRenderQueue;
+GLState gState;
+std::vector<DrawElementsIndirectCommand> gIndirectCommands;
+RenderMode gRenderMode = RENDER_INSTANCED;
+bool gMultiDrawIndirectSupported = false;
+GLint gDirectionalLightCount = 0;
+GLint gSpotLightCount = 0;
+
+
+//    :     ,   
+static void SetupProgram(Program* program) {
+    //       ,   
+    program->bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+    program->bindUniformBlock("FrameConstants", FRAME_BLOCK_BINDING);
+    program->bindUniformBlock("Materials", MATERIALS_BLOCK_BINDING);
+
+    gState.useProgram(*program);
+    program->setUniform(program->uniformHandle("materialTex"), 0);
+}
 
 
-//       
-static Program* LoadShaders(const char* vertFilename, const char* fragFilename) {
-    std::vector<Shader> shaders;
-    shaders.push_back(Shader::shaderFromFile(ResourcePath(vertFilename), GL_VERTEX_SHADER));
-    shaders.push_back(Shader::shaderFromFile(ResourcePath(fragFilename), GL_FRAGMENT_SHADER));
-    return new Program(shaders);
+// ,          
+static ShaderVariants* LoadShaders(const char* vertFilename, const char* fragFilename) {
+    return new ShaderVariants(*gPrograms, ResourcePath(vertFilename), ResourcePath(fragFilename), SetupProgram);
 }
 
 
-//     (bitmap)
-static Texture* LoadTexture(const char* filename) {
-    Bitmap bmp = Bitmap::bitmapFromFile(ResourcePath(filename));
-    bmp.flipVertically();
-    return new Texture(bmp);
+//         ,     
+static Program* ProgramFor(const ModelAsset* asset) {
+	bool specular = asset->shininess > 0.0f && asset->specularColor != glm::vec3(0.0f);
+	uint64_t key = (uint64_t)gDirectionalLightCount | ((uint64_t)gSpotLightCount << 8) | ((uint64_t)specular << 16);
+
+	Program* program = asset->shaders->find(key);
+	if (program)
+		return program;
+
+	ShaderVariants::Defines defines;
+	defines.push_back(std::make_pair(std::string("NUM_DIRECTIONAL_LIGHTS"), (int)gDirectionalLightCount));
+	defines.push_back(std::make_pair(std::string("NUM_SPOT_LIGHTS"), (int)gSpotLightCount));
+	defines.push_back(std::make_pair(std::string("SPECULAR"), specular ? 1 : 0));
+	return asset->shaders->variant(key, defines);
 }
 
 
-static void LoadWoodenCubeAsset() {
-    gWoodenCube.shaders = LoadShaders("vertex-shader.txt", "fragment-shader.txt");
-    gWoodenCube.drawType = GL_TRIANGLES;
-    gWoodenCube.drawStart = 0;
-    gWoodenCube.drawCount = 6*2*3;
-    gWoodenCube.texture = LoadTexture("wooden-crate.jpg");
-    gWoodenCube.shininess = 80.0;
-    gWoodenCube.specularColor = glm::vec3(1.0f, 1.0f, 1.0f);
-    
-	glGenBuffers(1, &gWoodenCube.vbo);
-    glGenVertexArrays(1, &gWoodenCube.vao);
-    glBindVertexArray(gWoodenCube.vao);
-    glBindBuffer(GL_ARRAY_BUFFER, gWoodenCube.vbo);
-	
-	GLfloat vertexData[] = {
+//           ;
+//        LoadMaterialTextures,    
+static GLint LoadTexture(const char* filename) {
+	gMaterialTextureFiles.push_back(ResourcePath(filename));
+	return (GLint)gMaterialTextureFiles.size() - 1;
+}
+
+//        GL_TEXTURE_2D_ARRAY,   
+//       ; , , mip-   
+//   ,   GL        ProgramCycle (. AssetLoader)
+static void LoadMaterialTextures() {
+	gMaterialTextures = gAssets->textureArray(gMaterialTextureFiles);
+	for (size_t i = 0; i < gModelAssets.size(); ++i)
+		gModelAssets[i]->texture = gMaterialTextures;
+}
+
+//        
+static void PackMaterialTexture(const ModelAsset& asset, PackedMaterial& packed) {
+	TextureAsset::Region region = asset.texture->region(asset.textureImage);
+	packed.textureLayer = (GLint)region.layer;
+	packed.textureRect = glm::vec4(region.offsetU, region.offsetV, region.scaleU, region.scaleV);
+	packed.textureGutter = glm::vec2(region.gutterU, region.gutterV);
+}
+
+//    ,        
+static void UpdateMaterialTextures() {
+	if (!gMaterialTextures || gMaterialTextures->state() == gMaterialTexturesState)
+		return;
+	gMaterialTexturesState = gMaterialTextures->state();
+
+	for (size_t i = 0; i < gModelAssets.size(); ++i)
+		PackMaterialTexture(*gModelAssets[i], gMaterialBlock.materials[gModelAssets[i]->material]);
+	gMaterialBuffer->update(gMaterialBlock.materials, gMaterialCount * sizeof(PackedMaterial), 0);
+}
+
+
+//       gInstanceBuffer   offset, VAO   
+static void SetInstanceAttribPointers(GLintptr offset) {
+	glBindBuffer(GL_ARRAY_BUFFER, gInstanceBuffer);
+	for (GLuint column = 0; column < 4; ++column) {
+		GLintptr columnOffset = offset + offsetof(InstanceData, model) + column * sizeof(glm::vec4);
+		glVertexAttribPointer(INSTANCE_MODEL_ATTRIB + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const GLvoid*)columnOffset);
+	}
+	for (GLuint column = 0; column < 3; ++column) {
+		GLintptr columnOffset = offset + offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3);
+		glVertexAttribPointer(INSTANCE_NORMAL_MATRIX_ATTRIB + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const GLvoid*)columnOffset);
+	}
+	GLintptr materialOffset = offset + offsetof(InstanceData, material);
+	glVertexAttribIPointer(INSTANCE_MATERIAL_ATTRIB, 1, GL_INT, sizeof(InstanceData), (const GLvoid*)materialOffset);
+	for (GLuint column = 0; column < 4; ++column) {
+		GLintptr columnOffset = offset + offsetof(InstanceData, modelViewProjection) + column * sizeof(glm::vec4);
+		glVertexAttribPointer(INSTANCE_MVP_ATTRIB + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const GLvoid*)columnOffset);
+	}
+}
+
+//      VAO,     ,    
+static void EnableInstanceAttribs() {
+	for (GLuint column = 0; column < 4; ++column) {
+		glEnableVertexAttribArray(INSTANCE_MODEL_ATTRIB + column);
+		glVertexAttribDivisor(INSTANCE_MODEL_ATTRIB + column, 1);
+	}
+	for (GLuint column = 0; column < 3; ++column) {
+		glEnableVertexAttribArray(INSTANCE_NORMAL_MATRIX_ATTRIB + column);
+		glVertexAttribDivisor(INSTANCE_NORMAL_MATRIX_ATTRIB + column, 1);
+	}
+	glEnableVertexAttribArray(INSTANCE_MATERIAL_ATTRIB);
+	glVertexAttribDivisor(INSTANCE_MATERIAL_ATTRIB, 1);
+	for (GLuint column = 0; column < 4; ++column) {
+		glEnableVertexAttribArray(INSTANCE_MVP_ATTRIB + column);
+		glVertexAttribDivisor(INSTANCE_MVP_ATTRIB + column, 1);
+	}
+	SetInstanceAttribPointers(0);
+}
+
+//    : X Y Z, U V,    
+static void InitGeometry() {
+	const GLsizei stride = 8 * sizeof(GLfloat);
+	gGeometry = new GeometryArena(stride);
+
+	glBindVertexArray(gGeometry->vao());
+	glBindBuffer(GL_ARRAY_BUFFER, gGeometry->vertexBuffer());
+
+	glEnableVertexAttribArray(VERT_ATTRIB);
+	glVertexAttribPointer(VERT_ATTRIB, 3, GL_FLOAT, GL_FALSE, stride, NULL);
+
+	glEnableVertexAttribArray(VERT_TEX_COORD_ATTRIB);
+	glVertexAttribPointer(VERT_TEX_COORD_ATTRIB, 2, GL_FLOAT, GL_TRUE, stride, (const GLvoid*)(3 * sizeof(GLfloat)));
+
+	glEnableVertexAttribArray(VERT_NORMAL_ATTRIB);
+	glVertexAttribPointer(VERT_NORMAL_ATTRIB, 3, GL_FLOAT, GL_TRUE, stride, (const GLvoid*)(5 * sizeof(GLfloat)));
+
+	EnableInstanceAttribs();
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+//      Materials
+static void RegisterMaterial(ModelAsset& asset) {
+	if (gMaterialCount >= (GLint)MAX_MATERIALS)
+		throw std::runtime_error("Too many materials");
+
+	asset.material = gMaterialCount++;
+	PackedMaterial& packed = gMaterialBlock.materials[asset.material];
+	packed.specularColor = asset.specularColor;
+	packed.shininess = asset.shininess;
+	packed.textureLayer = 0;
+	packed.textureRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+	packed.textureGutter = glm::vec2(1.0f, 1.0f);
+	asset.id = (GLuint)gModelAssets.size();
+	gModelAssets.push_back(&asset);
+
+	gMaterialBuffer->update(&packed, sizeof(packed), asset.material * sizeof(PackedMaterial));
+}
+
+//   12 : X Y Z, U V, ;    -
+static const GLfloat CubeVertexData[] = {
         //  X     Y     Z       U     V          Normal
         //  
         -1.0f,-1.0f,-1.0f,   0.0f, 0.0f,   0.0f, -1.0f, 0.0f,
@@ -156,256 +412,359 @@ static void LoadWoodenCubeAsset() {
          1.0f,-1.0f, 1.0f,   1.0f, 1.0f,   1.0f, 0.0f, 0.0f,
          1.0f, 1.0f,-1.0f,   0.0f, 0.0f,   1.0f, 0.0f, 0.0f,
          1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   1.0f, 0.0f, 0.0f
-    };
-    
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(gWoodenCube.shaders->attrib("vert"));
-    glVertexAttribPointer(gWoodenCube.shaders->attrib("vert"), 3, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), NULL);
-
-    glEnableVertexAttribArray(gWoodenCube.shaders->attrib("vertTexCoord"));
-    glVertexAttribPointer(gWoodenCube.shaders->attrib("vertTexCoord"), 2, GL_FLOAT, GL_TRUE,  8*sizeof(GLfloat), (const GLvoid*)(3 * sizeof(GLfloat)));
+};
 
-    glEnableVertexAttribArray(gWoodenCube.shaders->attrib("vertNormal"));
-    glVertexAttribPointer(gWoodenCube.shaders->attrib("vertNormal"), 3, GL_FLOAT, GL_TRUE,  8*sizeof(GLfloat), (const GLvoid*)(5 * sizeof(GLfloat)));
+//     ,     GPU  
+static void LoadCubeMesh(ModelAsset& asset) {
+	MeshCache::Mesh mesh = gMeshCache->mesh(CubeVertexData, 6 * 2 * 3);
+	asset.vao = gGeometry->vao();
+	asset.mesh = mesh.id;
+	asset.drawType = GL_TRIANGLES;
+	asset.drawStart = mesh.firstIndex;
+	asset.drawCount = mesh.indexCount;
+	asset.bounds = BoundingBox::fromPoints(CubeVertexData, 6 * 2 * 3, 8);
+	asset.boundingSphere = BoundingSphere::fromPoints(CubeVertexData, 6 * 2 * 3, 8);
+}
 
-    glBindVertexArray(0);
+static void LoadWoodenCubeAsset() {
+    gWoodenCube.shaders = gStandardShaders;
+    gWoodenCube.textureImage = LoadTexture("wooden-crate.jpg");
+    gWoodenCube.shininess = 80.0;
+    gWoodenCube.specularColor = glm::vec3(1.0f, 1.0f, 1.0f);
+	LoadCubeMesh(gWoodenCube);
+	RegisterMaterial(gWoodenCube);
 }
 
 static void LoadBrickWallAsset() {
-	gBrickWall.shaders = LoadShaders("vertex-shader.txt", "fragment-shader.txt");
-	gBrickWall.drawType = GL_TRIANGLES;
-	gBrickWall.drawStart = 0;
-	gBrickWall.drawCount = 6 * 2 * 3;
-	gBrickWall.texture = LoadTexture("bricks.jpg");
+	gBrickWall.shaders = gStandardShaders;
+	gBrickWall.textureImage = LoadTexture("bricks.jpg");
 	gBrickWall.shininess = 1000.0;
 	gBrickWall.specularColor = glm::vec3(1.0f, 1.0f, 1.0f);
-	
-	glGenBuffers(1, &gBrickWall.vbo);
-	glGenVertexArrays(1, &gBrickWall.vao);
-	glBindVertexArray(gBrickWall.vao);
-	glBindBuffer(GL_ARRAY_BUFFER, gBrickWall.vbo);
-
-	GLfloat vertexData[] = {
-		-1.0f,-1.0f,-1.0f,   0.0f, 0.0f,   0.0f, -1.0f, 0.0f,
-		1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, -1.0f, 0.0f,
-		-1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   0.0f, -1.0f, 0.0f,
-		1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, -1.0f, 0.0f,
-		1.0f,-1.0f, 1.0f,   1.0f, 1.0f,   0.0f, -1.0f, 0.0f,
-		-1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   0.0f, -1.0f, 0.0f,
-		-1.0f, 1.0f,-1.0f,   0.0f, 0.0f,   0.0f, 1.0f, 0.0f,
-		-1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   0.0f, 1.0f, 0.0f,
-		1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
-		1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
-		-1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   0.0f, 1.0f, 0.0f,
-		1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   0.0f, 1.0f, 0.0f,
-		-1.0f,-1.0f, 1.0f,   1.0f, 0.0f,   0.0f, 0.0f, 1.0f,
-		1.0f,-1.0f, 1.0f,   0.0f, 0.0f,   0.0f, 0.0f, 1.0f,
-		-1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-		1.0f,-1.0f, 1.0f,   0.0f, 0.0f,   0.0f, 0.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-		-1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-		-1.0f,-1.0f,-1.0f,   0.0f, 0.0f,   0.0f, 0.0f, -1.0f,
-		-1.0f, 1.0f,-1.0f,   0.0f, 1.0f,   0.0f, 0.0f, -1.0f,
-		1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 0.0f, -1.0f,
-		1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 0.0f, -1.0f,
-		-1.0f, 1.0f,-1.0f,   0.0f, 1.0f,   0.0f, 0.0f, -1.0f,
-		1.0f, 1.0f,-1.0f,   1.0f, 1.0f,   0.0f, 0.0f, -1.0f,	
-		-1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
-		-1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-		-1.0f,-1.0f,-1.0f,   0.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-		-1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
-		-1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
-		-1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-		1.0f,-1.0f, 1.0f,   1.0f, 1.0f,   1.0f, 0.0f, 0.0f,
-		1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   1.0f, 0.0f, 0.0f,
-		1.0f, 1.0f,-1.0f,   0.0f, 0.0f,   1.0f, 0.0f, 0.0f,
-		1.0f,-1.0f, 1.0f,   1.0f, 1.0f,   1.0f, 0.0f, 0.0f,
-		1.0f, 1.0f,-1.0f,   0.0f, 0.0f,   1.0f, 0.0f, 0.0f,
-		1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   1.0f, 0.0f, 0.0f
-	};
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
-
-	glEnableVertexAttribArray(gBrickWall.shaders->attrib("vert"));
-	glVertexAttribPointer(gBrickWall.shaders->attrib("vert"), 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), NULL);
-
-	glEnableVertexAttribArray(gBrickWall.shaders->attrib("vertTexCoord"));
-	glVertexAttribPointer(gBrickWall.shaders->attrib("vertTexCoord"), 2, GL_FLOAT, GL_TRUE, 8 * sizeof(GLfloat), (const GLvoid*)(3 * sizeof(GLfloat)));
-
-	glEnableVertexAttribArray(gBrickWall.shaders->attrib("vertNormal"));
-	glVertexAttribPointer(gBrickWall.shaders->attrib("vertNormal"), 3, GL_FLOAT, GL_TRUE, 8 * sizeof(GLfloat), (const GLvoid*)(5 * sizeof(GLfloat)));
-
-	glBindVertexArray(0);
+	LoadCubeMesh(gBrickWall);
+	RegisterMaterial(gBrickWall);
 }
 
 static void LoadGrassFloorAsset() {
-	gGrassFloor.shaders = LoadShaders("vertex-shader.txt", "fragment-shader.txt");
-	gGrassFloor.drawType = GL_TRIANGLES;
-	gGrassFloor.drawStart = 0;
-	gGrassFloor.drawCount = 6 * 2 * 3;
-	gGrassFloor.texture = LoadTexture("grass4k.jpg");
+	gGrassFloor.shaders = gStandardShaders;
+	gGrassFloor.textureImage = LoadTexture("grass4k.jpg");
 	gGrassFloor.shininess = 2000.0;
 	gGrassFloor.specularColor = glm::vec3(1.0f, 1.0f, 1.0f);
-	
-	glGenBuffers(1, &gGrassFloor.vbo);
-	glGenVertexArrays(1, &gGrassFloor.vao);
-	glBindVertexArray(gGrassFloor.vao);
-	glBindBuffer(GL_ARRAY_BUFFER, gGrassFloor.vbo);
-
-	GLfloat vertexData[] = {
-		-1.0f,-1.0f,-1.0f,   0.0f, 0.0f,   0.0f, -1.0f, 0.0f,
-		1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, -1.0f, 0.0f,
-		-1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   0.0f, -1.0f, 0.0f,
-		1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, -1.0f, 0.0f,
-		1.0f,-1.0f, 1.0f,   1.0f, 1.0f,   0.0f, -1.0f, 0.0f,
-		-1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   0.0f, -1.0f, 0.0f,
-		-1.0f, 1.0f,-1.0f,   0.0f, 0.0f,   0.0f, 1.0f, 0.0f,
-		-1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   0.0f, 1.0f, 0.0f,
-		1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
-		1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
-		-1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   0.0f, 1.0f, 0.0f,
-		1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   0.0f, 1.0f, 0.0f,
-		-1.0f,-1.0f, 1.0f,   1.0f, 0.0f,   0.0f, 0.0f, 1.0f,
-		1.0f,-1.0f, 1.0f,   0.0f, 0.0f,   0.0f, 0.0f, 1.0f,
-		-1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-		1.0f,-1.0f, 1.0f,   0.0f, 0.0f,   0.0f, 0.0f, 1.0f,
-		1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-		-1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-		-1.0f,-1.0f,-1.0f,   0.0f, 0.0f,   0.0f, 0.0f, -1.0f,
-		-1.0f, 1.0f,-1.0f,   0.0f, 1.0f,   0.0f, 0.0f, -1.0f,
-		1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 0.0f, -1.0f,
-		1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   0.0f, 0.0f, -1.0f,
-		-1.0f, 1.0f,-1.0f,   0.0f, 1.0f,   0.0f, 0.0f, -1.0f,
-		1.0f, 1.0f,-1.0f,   1.0f, 1.0f,   0.0f, 0.0f, -1.0f,
-		-1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
-		-1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-		-1.0f,-1.0f,-1.0f,   0.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-		-1.0f,-1.0f, 1.0f,   0.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
-		-1.0f, 1.0f, 1.0f,   1.0f, 1.0f,   -1.0f, 0.0f, 0.0f,
-		-1.0f, 1.0f,-1.0f,   1.0f, 0.0f,   -1.0f, 0.0f, 0.0f,
-		1.0f,-1.0f, 1.0f,   1.0f, 1.0f,   1.0f, 0.0f, 0.0f,
-		1.0f,-1.0f,-1.0f,   1.0f, 0.0f,   1.0f, 0.0f, 0.0f,
-		1.0f, 1.0f,-1.0f,   0.0f, 0.0f,   1.0f, 0.0f, 0.0f,
-		1.0f,-1.0f, 1.0f,   1.0f, 1.0f,   1.0f, 0.0f, 0.0f,
-		1.0f, 1.0f,-1.0f,   0.0f, 0.0f,   1.0f, 0.0f, 0.0f,
-		1.0f, 1.0f, 1.0f,   0.0f, 1.0f,   1.0f, 0.0f, 0.0f
-	};
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertexData), vertexData, GL_STATIC_DRAW);
-
-	glEnableVertexAttribArray(gGrassFloor.shaders->attrib("vert"));
-	glVertexAttribPointer(gGrassFloor.shaders->attrib("vert"), 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat), NULL);
-
-	glEnableVertexAttribArray(gGrassFloor.shaders->attrib("vertTexCoord"));
-	glVertexAttribPointer(gGrassFloor.shaders->attrib("vertTexCoord"), 2, GL_FLOAT, GL_TRUE, 8 * sizeof(GLfloat), (const GLvoid*)(3 * sizeof(GLfloat)));
-
-	glEnableVertexAttribArray(gGrassFloor.shaders->attrib("vertNormal"));
-	glVertexAttribPointer(gGrassFloor.shaders->attrib("vertNormal"), 3, GL_FLOAT, GL_TRUE, 8 * sizeof(GLfloat), (const GLvoid*)(5 * sizeof(GLfloat)));
+	LoadCubeMesh(gGrassFloor);
+	RegisterMaterial(gGrassFloor);
+}
 
-	glBindVertexArray(0);
+//     ;      
+static void PrintProgramStats() {
+	const ProgramCache::Stats& programs = gPrograms->stats();
+	std::cout << "Programs: " << programs.requests << " requested, " << programs.memoryHits << " shared, "
+			  << programs.diskHits << " loaded from binaries, " << programs.compiled << " compiled";
+	if (programs.binariesRejected)
+		std::cout << " (" << programs.binariesRejected << " binaries rejected)";
+	std::cout << ", " << gStandardShaders->variantCount() << " shader variants" << std::endl;
+}
+
+//   ,   ,   
+static void PrintTextureStats(double seconds) {
+	const AssetLoader::Stats& stats = gAssets->stats();
+	std::cout << "Textures: " << stats.uploaded << " of " << stats.requested << " loaded in " << seconds << " s, "
+			  << stats.fromBakedFile << " from baked files, " << stats.decoded << " decoded, " << stats.failed << " failed" << std::endl;
+
+	const TextureStreamer::Stats& streaming = gAssets->streamingStats();
+	std::cout << "Texture streaming: " << streaming.bytesUploaded / 1024 << " KB in " << streaming.tilesUploaded << " tiles, "
+			  << streaming.stalls << " stalls (" << streaming.stallSeconds * 1000.0 << " ms)" << std::endl;
+	std::cout << "Texture memory: " << stats.residentBytes / 1024 << " KB of " << TEXTURE_MEMORY_BUDGET / 1024 << " KB budget, peak "
+			  << stats.peakBytes / 1024 << " KB, " << stats.evicted << " evicted, " << stats.trimmed << " trimmed, " << stats.reloaded << " reloaded" << std::endl;
+
+	const std::vector<TextureAsset*>& textures = gAssets->textures();
+	for (size_t i = 0; i < textures.size(); ++i) {
+		const TextureAsset* texture = textures[i];
+		std::string name = texture->filePath();
+		if (texture->imageCount() > 1)
+			name += " + " + std::to_string(texture->imageCount() - 1) + " more";
+		//       
+		if (!texture->error().empty())
+			std::cout << "  " << name << ": " << texture->error() << std::endl;
+		else if (texture->compressionPSNR() > 0.0)
+			std::cout << "  " << name << ": compressed, PSNR " << texture->compressionPSNR() << " dB" << std::endl;
+	}
+}
+
+//     
+static void PrintMeshStats() {
+	const MeshCache::Stats& stats = gMeshCache->stats();
+	std::cout << "Meshes: " << stats.meshesUploaded << " uploaded of " << stats.meshesRequested << " requested, "
+			  << "vertices: " << stats.uniqueVertices << " unique of " << stats.sourceVertices << ", "
+			  << "vertex shader runs per draw: " << stats.invocationsAfter << " instead of " << stats.invocationsBefore
+			  << std::endl;
 }
 
-glm::mat4 translate(GLfloat x, GLfloat y, GLfloat z) {
-    return glm::translate(glm::mat4(), glm::vec3(x,y,z));
+//   ,   
+static SceneGraph::Node AddGroup(SceneGraph::Node parent, const glm::vec3& position) {
+	SceneGraph::Node node = gScene.createNode(parent, position);
+	gNodeInstances.resize(gScene.size());
+	return node;
 }
 
-glm::mat4 scale(GLfloat x, GLfloat y, GLfloat z) {
-    return glm::scale(glm::mat4(), glm::vec3(x,y,z));
+//     ;       UpdateSceneTransforms
+static SceneGraph::Node AddInstance(const ModelAsset& asset, SceneGraph::Node parent, const glm::vec3& position, const glm::vec3& size) {
+	SceneGraph::Node node = gScene.createNode(parent, position, glm::quat(), size);
+	gNodeInstances.resize(gScene.size());
+	gNodeInstances[node] = gInstances.add(asset.id, asset.material, asset.bounds, glm::mat4());
+	return node;
 }
 
+//             
+static void UpdateSceneTransforms() {
+	gScene.update();
+	const std::vector<SceneGraph::Node>& changed = gScene.changed();
+	for (size_t i = 0; i < changed.size(); ++i) {
+		if (gNodeInstances[changed[i]].isValid())
+			gInstances.setTransform(gNodeInstances[changed[i]], gScene.worldMatrix(changed[i]));
+	}
+}
+
+//      ,     
 static void CreateScene() {
-    ModelInstance p1Vert;
-    p1Vert.asset = &gWoodenCube;
-    p1Vert.transform = translate(0,0,0) * scale(0.8f, 2.5,1);
-    gInstances.push_back(p1Vert);
-
-	ModelInstance p2Vert;
-	p2Vert.asset = &gWoodenCube;
-	p2Vert.transform = translate(6, 0, 0) * scale(0.8f, 2.5, 1);
-	gInstances.push_back(p2Vert);
-
-	ModelInstance p1Hor;
-	p1Hor.asset = &gWoodenCube;
-	p1Hor.transform = translate(0, 0, 0) * scale(2.5, 0.8f, 0.8f);
-	gInstances.push_back(p1Hor);
-
-	ModelInstance p2Hor;
-	p2Hor.asset = &gWoodenCube;
-	p2Hor.transform = translate(6, 0, 0) * scale(2.5, 0.8f, 0.8f);
-	gInstances.push_back(p2Hor);
-
-    ModelInstance cLeft;
-    cLeft.asset = &gWoodenCube;
-    cLeft.transform = translate(-8,0,0) * scale(1,6, 0.8f);
-    gInstances.push_back(cLeft);
-
-    ModelInstance cTop;
-    cTop.asset = &gWoodenCube;
-    cTop.transform = translate(-6,5,0) * scale(3,1,1);
-    gInstances.push_back(cTop);
-
-	ModelInstance cBot;
-	cTop.asset = &gWoodenCube;
-	cTop.transform = translate(-6, -5, 0) * scale(3, 1, 1);
-	gInstances.push_back(cTop);
-
-	ModelInstance wall;
-	wall.asset = &gBrickWall;
-	wall.transform = translate(-3, 1, -10) * scale(20, 10, 1);
-	gInstances.push_back(wall);
-
-	ModelInstance floor;
-	floor.asset = &gGrassFloor;
-	floor.transform = translate(-3, -7, 10) * scale(20, 1, 25);
-	gInstances.push_back(floor);
-}
-
-template <typename T>
-void SetLightUniform(Program* shaders, const char* propertyName, size_t lightIndex, const T& value) {
-    std::ostringstream ss;
-    ss << "allLights[" << lightIndex << "]." << propertyName;
-    std::string uniformName = ss.str();
-
-    shaders->setUniform(uniformName.c_str(), value);
-}
-
-static void RenderInstance(const ModelInstance& inst) {
-    ModelAsset* asset = inst.asset;
-    Program* shaders = asset->shaders;
-
-    shaders->use();
-    shaders->setUniform("camera", gCamera.matrix());
-    shaders->setUniform("model", inst.transform);
-    shaders->setUniform("materialTex", 0);
-    shaders->setUniform("materialShininess", asset->shininess);
-    shaders->setUniform("materialSpecularColor", asset->specularColor);
-    shaders->setUniform("cameraPosition", gCamera.position());
-    shaders->setUniform("numLights", (int)gLights.size());
-
-    for(size_t i = 0; i < gLights.size(); ++i){
-        SetLightUniform(shaders, "position", i, gLights[i].position);
-        SetLightUniform(shaders, "intensities", i, gLights[i].intensities);
-        SetLightUniform(shaders, "attenuation", i, gLights[i].attenuation);
-        SetLightUniform(shaders, "ambientCoefficient", i, gLights[i].ambientCoefficient);
-        SetLightUniform(shaders, "coneAngle", i, gLights[i].coneAngle);
-        SetLightUniform(shaders, "coneDirection", i, gLights[i].coneDirection);
-    }
+	gLetterP = AddGroup(SceneGraph::NoParent, glm::vec3(3, 0, 0));
+	AddInstance(gWoodenCube, gLetterP, glm::vec3(-3, 0, 0), glm::vec3(0.8f, 2.5, 1));
+	AddInstance(gWoodenCube, gLetterP, glm::vec3(3, 0, 0), glm::vec3(0.8f, 2.5, 1));
+	AddInstance(gWoodenCube, gLetterP, glm::vec3(-3, 0, 0), glm::vec3(2.5, 0.8f, 0.8f));
+	AddInstance(gWoodenCube, gLetterP, glm::vec3(3, 0, 0), glm::vec3(2.5, 0.8f, 0.8f));
+
+	SceneGraph::Node letterC = AddGroup(SceneGraph::NoParent, glm::vec3(-7, 0, 0));
+	AddInstance(gWoodenCube, letterC, glm::vec3(-1, 0, 0), glm::vec3(1, 6, 0.8f));
+	AddInstance(gWoodenCube, letterC, glm::vec3(1, 5, 0), glm::vec3(3, 1, 1));
+	AddInstance(gWoodenCube, letterC, glm::vec3(1, -5, 0), glm::vec3(3, 1, 1));
+
+	AddInstance(gBrickWall, SceneGraph::NoParent, glm::vec3(-3, 1, -10), glm::vec3(20, 10, 1));
+	AddInstance(gGrassFloor, SceneGraph::NoParent, glm::vec3(-3, -7, 10), glm::vec3(20, 1, 25));
+	UpdateSceneTransforms();
+}
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, asset->texture->object());
-	glBindVertexArray(asset->vao);
-    glDrawArrays(asset->drawType, asset->drawStart, asset->drawCount);
-	glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    shaders->stopUsing();
+//       :       
+//       ;   AssetLoader ,  mip- 
+static unsigned WantedTextureSize(const ModelAsset& asset, const glm::mat4& transform) {
+	glm::mat3 basis(transform);
+	float faceSize = 2.0f * std::max(glm::length(basis[0]), std::max(glm::length(basis[1]), glm::length(basis[2])));
+	BoundingSphere sphere = asset.boundingSphere.transformed(transform);
+	float distance = glm::length(sphere.center - gCamera.position()) - sphere.radius;
+	if (distance <= gCamera.nearPlane())
+		return ~0u;
+
+	float pixelsPerUnit = SCREEN_SIZE.y / (2.0f * distance * std::tan(glm::radians(gCamera.fieldOfView()) / 2.0f));
+	return (unsigned)std::ceil(faceSize * pixelsPerUnit);
+}
+
+//  ,        ;
+//  gVisibleInstances     gInstances
+static void CullInstances() {
+	gVisibleInstances.clear();
+	gInstances.cull(Frustum(gCamera.matrix()), gVisibleInstances);
+	gCulledInstanceCount = gInstances.size() - gVisibleInstances.size();
+}
+
+//    :  ,        
+static void PickInstance() {
+	unsigned item;
+	float distance;
+	if (!gInstances.raycast(gCamera.position(), gCamera.forward(), gCamera.farPlane(), item, distance)) {
+		std::cout << "Picked: nothing" << std::endl;
+		return;
+	}
+	const ModelAsset* asset = gModelAssets[gInstances.assets()[item]];
+	std::cout << "Picked: instance " << item << " (" << gMaterialTextureFiles[asset->textureImage] << ") at "
+		<< distance << std::endl;
+}
+
+//        ,   
+//        gInstanceBuffer
+static void BuildInstanceBatches() {
+	const glm::vec3 cameraPosition = gCamera.position();
+	const glm::vec3 cameraForward = gCamera.forward();
+	const float farPlane = gCamera.farPlane();
+
+	const std::vector<glm::mat4>& transforms = gInstances.transforms();
+	const std::vector<unsigned>& assets = gInstances.assets();
+	const std::vector<int>& materials = gInstances.materials();
+
+	CullInstances();
+	gRenderQueue.clear();
+	for (size_t v = 0; v < gVisibleInstances.size(); ++v) {
+		unsigned index = gVisibleInstances[v];
+		const ModelAsset* asset = gModelAssets[assets[index]];
+		glm::vec3 position(transforms[index][3]);
+		float depth = glm::dot(position - cameraPosition, cameraForward) / farPlane;
+
+		uint64_t key = RenderQueue::makeKey(0,
+											gRenderQueue.stateId(RenderQueue::StateField_Program, ProgramFor(asset)->object()),
+											gRenderQueue.stateId(RenderQueue::StateField_Texture, asset->texture->object()),
+											gRenderQueue.stateId(RenderQueue::StateField_Vao, asset->vao),
+											gRenderQueue.stateId(RenderQueue::StateField_Mesh, asset->mesh),
+											depth);
+		gRenderQueue.push(key, index);
+		gAssets->markUsed(asset->texture, WantedTextureSize(*asset, transforms[index]), asset->textureImage);
+	}
+	gRenderQueue.sort();
+
+	gInstanceData.resize(gRenderQueue.size());
+	gBatches.clear();
+	uint64_t batchState = 0;
+	for (size_t i = 0; i < gRenderQueue.size(); ++i) {
+		unsigned index = gRenderQueue[i].payload;
+		ModelAsset* asset = gModelAssets[assets[index]];
+		gInstanceData[i].model = transforms[index];
+		gInstanceData[i].material = materials[index];
+
+		uint64_t state = RenderQueue::stateBits(gRenderQueue[i].key);
+		if (gBatches.empty() || state != batchState) {
+			InstanceBatch batch;
+			batch.asset = asset;
+			batch.program = ProgramFor(asset);
+			batch.firstInstance = (GLsizei)i;
+			batch.instanceCount = 0;
+			gBatches.push_back(batch);
+			batchState = state;
+		}
+		++gBatches.back().instanceCount;
+	}
+
+	// MVP        ,   gInstanceData
+	if (!gInstanceData.empty())
+		InstanceMatrices(gCamera.matrix(),
+						 &gInstanceData[0].model, sizeof(InstanceData),
+						 &gInstanceData[0].modelViewProjection, sizeof(InstanceData),
+						 &gInstanceData[0].normalMatrix, sizeof(InstanceData),
+						 gInstanceData.size());
+
+	//    ,    ,    
+	glBindBuffer(GL_ARRAY_BUFFER, gInstanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, gInstanceData.size() * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+	if (!gInstanceData.empty())
+		glBufferSubData(GL_ARRAY_BUFFER, 0, gInstanceData.size() * sizeof(InstanceData), &gInstanceData[0]);
+}
+
+//    ; ,      
+static void PrintCullingStats() {
+	if (gVisibleInstances.size() == gReportedVisibleCount)
+		return;
+	std::cout << "Culling: " << gVisibleInstances.size() << " visible, " << gCulledInstanceCount << " culled of "
+		<< gInstances.size() << " instances" << std::endl;
+	gReportedVisibleCount = gVisibleInstances.size();
+}
+
+//    gState,      GL
+static void RenderBatch(const InstanceBatch& batch) {
+    ModelAsset* asset = batch.asset;
+
+    gState.useProgram(*batch.program);
+    gState.bindTexture(0, asset->texture->target(), asset->texture->object());
+    gState.bindVertexArray(asset->vao);
+
+	SetInstanceAttribPointers(batch.firstInstance * sizeof(InstanceData));
+	glDrawElementsInstanced(asset->drawType, asset->drawCount, GL_UNSIGNED_INT,
+							(const GLvoid*)(asset->drawStart * sizeof(GLuint)), batch.instanceCount);
+}
+
+//     glMultiDrawElementsIndirect:       + 
+static void RenderMultiDrawIndirect() {
+	gIndirectCommands.resize(gBatches.size());
+	for (size_t i = 0; i < gBatches.size(); ++i) {
+		const InstanceBatch& batch = gBatches[i];
+		DrawElementsIndirectCommand& command = gIndirectCommands[i];
+		command.count = (GLuint)batch.asset->drawCount;
+		command.instanceCount = (GLuint)batch.instanceCount;
+		command.firstIndex = (GLuint)batch.asset->drawStart;
+		command.baseVertex = 0; //      
+		command.baseInstance = (GLuint)batch.firstInstance;
+	}
+	if (gIndirectCommands.empty())
+		return;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gIndirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, gIndirectCommands.size() * sizeof(DrawElementsIndirectCommand), &gIndirectCommands[0], GL_STREAM_DRAW);
+
+	// baseInstance     ,     
+	gState.bindVertexArray(gGeometry->vao());
+	SetInstanceAttribPointers(0);
+
+	size_t runStart = 0;
+	while (runStart < gBatches.size()) {
+		ModelAsset* asset = gBatches[runStart].asset;
+		Program* program = gBatches[runStart].program;
+		size_t runEnd = runStart + 1;
+		while (runEnd < gBatches.size() &&
+			   gBatches[runEnd].program == program &&
+			   gBatches[runEnd].asset->texture == asset->texture &&
+			   gBatches[runEnd].asset->drawType == asset->drawType)
+			++runEnd;
+
+		gState.useProgram(*program);
+		gState.bindTexture(0, asset->texture->target(), asset->texture->object());
+		glMultiDrawElementsIndirect(asset->drawType, GL_UNSIGNED_INT,
+									(const GLvoid*)(runStart * sizeof(DrawElementsIndirectCommand)),
+									(GLsizei)(runEnd - runStart),
+									0);
+		runStart = runEnd;
+	}
+}
+
+static void PackLight(const Light& light, PackedLight& packed) {
+	packed.position = light.position;
+	packed.intensities = light.intensities;
+	packed.attenuation = light.attenuation;
+	packed.coneDirection = glm::normalize(light.coneDirection);
+	packed.coneCosine = std::cos(glm::radians(light.coneAngle));
+	packed.ambientCoefficient = light.ambientCoefficient;
+}
+
+//  gLights    Lights,    ,  ;
+//       . GL     
+static void UpdateLightBlock() {
+	assert(gLights.size() <= MAX_LIGHTS);
+
+	LightBlock block = LightBlock();
+	size_t packedCount = 0;
+	for (size_t i = 0; i < gLights.size(); ++i) {
+		if (gLights[i].position.w == 0.0f)
+			PackLight(gLights[i], block.lights[packedCount++]);
+	}
+	gDirectionalLightCount = (GLint)packedCount;
+	for (size_t i = 0; i < gLights.size(); ++i) {
+		if (gLights[i].position.w != 0.0f)
+			PackLight(gLights[i], block.lights[packedCount++]);
+	}
+	gSpotLightCount = (GLint)(packedCount - gDirectionalLightCount);
+
+	gLightBuffer->update(&block, sizeof(block));
+}
+
+//              FrameConstants
+static void UpdateFrameConstants() {
+	FrameConstants frame;
+	frame.view = gCamera.view();
+	frame.projection = gCamera.projection();
+	frame.viewProjection = frame.projection * frame.view;
+	frame.cameraPosition = gCamera.position();
+	frame.time = (GLfloat)glfwGetTime();
+
+	gFrameBuffer->update(&frame, sizeof(frame));
 }
 
 static void Render() {
+    UpdateFrameConstants();
+    UpdateLightBlock();
+
     glClearColor(0, 0, 0, 1);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	
-	std::list<ModelInstance>::const_iterator it;
-    for(it = gInstances.begin(); it != gInstances.end(); ++it)
-        RenderInstance(*it);
+	BuildInstanceBatches();
+	PrintCullingStats();
+	if (gRenderMode == RENDER_MULTI_DRAW_INDIRECT) {
+		RenderMultiDrawIndirect();
+	} else {
+		for (size_t i = 0; i < gBatches.size(); ++i)
+			RenderBatch(gBatches[i]);
+	}
 
 	//  
     glfwSwapBuffers(gWindow);
@@ -445,6 +804,25 @@ static void Update(float secondsElapsed) {
     else if(glfwGetKey(gWindow, '5'))
         gLights[0].intensities = glm::vec3(2, 2, 2); //white
 
+	if (glfwGetKey(gWindow, 'M') && gMultiDrawIndirectSupported)
+		gRenderMode = RENDER_MULTI_DRAW_INDIRECT;
+	else if (glfwGetKey(gWindow, 'N'))
+		gRenderMode = RENDER_INSTANCED;
+
+	//    
+	bool pickKeyDown = glfwGetKey(gWindow, 'P') == GLFW_PRESS;
+	if (pickKeyDown && !gPickKeyDown)
+		PickInstance();
+	gPickKeyDown = pickKeyDown;
+
+	//  P  ,    
+	if (glfwGetKey(gWindow, 'R')) {
+		const GLfloat degreesPerSecond = 90.0f;
+		gDegreesRotated = std::fmod(gDegreesRotated + secondsElapsed * degreesPerSecond, 360.0f);
+		gScene.setRotation(gLetterP, glm::angleAxis(glm::radians(gDegreesRotated), glm::vec3(0, 1, 0)));
+	}
+	UpdateSceneTransforms();
+
 
     const float mouseSensitivity = 0.1f;
     double mouseX, mouseY;
@@ -467,7 +845,7 @@ int InitGlfw() {
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
 	gWindow = glfwCreateWindow((int)SCREEN_SIZE.x, (int)SCREEN_SIZE.y, "OpenGL Tutorial", NULL, NULL);
 	if (!gWindow) {
@@ -489,12 +867,32 @@ void InitGlew() {
 	glDepthFunc(GL_LESS);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	// glMultiDrawElementsIndirect  baseInstance - OpenGL 4.3
+	gMultiDrawIndirectSupported = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+	if (gMultiDrawIndirectSupported)
+		gRenderMode = RENDER_MULTI_DRAW_INDIRECT;
+}
+
+//   ,    ;    
+void InitBuffers() {
+	gPrograms = new ProgramCache(ResourcePath("program-cache-"));
+	gAssets = new AssetLoader(GLEW_EXT_texture_compression_s3tc != GL_FALSE, gState);
+	gAssets->setMemoryBudget(TEXTURE_MEMORY_BUDGET);
+	gStandardShaders = LoadShaders("vertex-shader.txt", "fragment-shader.txt");
+	glGenBuffers(1, &gInstanceBuffer);
+	glGenBuffers(1, &gIndirectBuffer);
+	gMaterialBuffer = new UniformBuffer(sizeof(MaterialBlock), MATERIALS_BLOCK_BINDING);
+	InitGeometry();
+	gMeshCache = new MeshCache(*gGeometry);
 }
 
 void InitCamera() {
 	gCamera.setPosition(glm::vec3(-4, 0, 17));
 	gCamera.setViewportAspectRatio(SCREEN_SIZE.x / SCREEN_SIZE.y);
 	gCamera.setNearAndFarPlanes(0.5f, 100.0f);
+
+	gFrameBuffer = new UniformBuffer(sizeof(FrameConstants), FRAME_BLOCK_BINDING);
 }
 
 void InitLights() {
@@ -513,6 +911,8 @@ void InitLights() {
 
 	gLights.push_back(spotlight);
 	gLights.push_back(directionalLight);
+
+	gLightBuffer = new UniformBuffer(sizeof(LightBlock), LIGHTS_BLOCK_BINDING);
 }
 
 int ProgramCycle() {
@@ -524,6 +924,14 @@ int ProgramCycle() {
 		Update((float)(thisTime - lastTime));
 		lastTime = thisTime;
 
+		//  ,    gState,     
+		gAssets->processUploads(TEXTURE_UPLOAD_BUDGET);
+		UpdateMaterialTextures();
+		if (!gTexturesReported && gAssets->idle()) {
+			PrintTextureStats(thisTime);
+			gTexturesReported = true;
+		}
+
 		Render();
 
 		GLenum error = glGetError();
@@ -542,11 +950,14 @@ int ProgramCycle() {
 int main(int argc, char *argv[]) {
 	InitGlfw();
 	InitGlew();
+	InitBuffers();
 
 	//  
 	LoadWoodenCubeAsset();
 	LoadBrickWallAsset();
 	LoadGrassFloorAsset();
+	LoadMaterialTextures();
+	PrintMeshStats();
 
 	//     
 	CreateScene();
@@ -555,7 +966,10 @@ int main(int argc, char *argv[]) {
 	InitLights();
 
 	auto status = ProgramCycle();
+	PrintProgramStats();
 
+	//   ,   GL  
+	delete gAssets;
 	glfwTerminate();
 
 	return status;
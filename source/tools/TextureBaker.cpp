@@ -0,0 +1,96 @@
+// Bakes images into .btex files (see helpers/BakedTexture.h) so the demo can
+// map them instead of decoding JPEGs at startup.
+// Build together with helpers/Bitmap.cpp, PixelConversion.cpp, CpuFeatures.cpp,
+// ThreadPool.cpp, BlockCompression.cpp, MappedFile.cpp and BakedTexture.cpp.
+//
+//   TextureBaker [--raw] [--quality fast|normal|high] [--linear] image...
+//
+// Each image is written next to itself as <image>.btex, which is where
+// LoadTexture looks for it.
+
+#include "../helpers/BakedTexture.h"
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace helpers;
+
+struct BakeOptions {
+    bool compress;
+    bool srgb;
+    BlockQuality quality;
+};
+
+static void PrintUsage() {
+    std::fprintf(stderr, "usage: TextureBaker [--raw] [--quality fast|normal|high] [--linear] image...\n"
+                         "  --raw      store uncompressed mip levels instead of BC1/BC3 blocks\n"
+                         "  --quality  block compression effort, default normal\n"
+                         "  --linear   filter mip levels as linear data, not sRGB colour\n");
+}
+
+static void Bake(const std::string& imagePath, const BakeOptions& options) {
+    std::string bakedPath = imagePath + ".btex";
+    std::vector<Bitmap> mipLevels = Bitmap::mipChain(Bitmap::bitmapFromFile(imagePath, true), options.srgb);
+    unsigned width = mipLevels[0].width(), height = mipLevels[0].height();
+
+    bool written;
+    if(options.compress){
+        BlockFormat format = ChooseBlockFormat(mipLevels[0]);
+        std::vector<CompressedImage> compressed;
+        for(size_t level = 0; level < mipLevels.size(); ++level)
+            compressed.push_back(CompressBitmap(mipLevels[level], format, options.quality));
+        written = BakedTexture::write(bakedPath, imagePath, compressed);
+        std::printf("%s: %ux%u, %u levels, %s, PSNR %.2f dB\n", bakedPath.c_str(), width, height, (unsigned)mipLevels.size(),
+                    format == BlockFormat_BC1 ? "BC1" : "BC3", CompressionPSNR(mipLevels[0], compressed[0]));
+    } else {
+        written = BakedTexture::write(bakedPath, imagePath, mipLevels);
+        std::printf("%s: %ux%u, %u levels, raw\n", bakedPath.c_str(), width, height, (unsigned)mipLevels.size());
+    }
+
+    if(!written)
+        throw std::runtime_error("Failed to write " + bakedPath);
+}
+
+int main(int argc, char* argv[]) {
+    BakeOptions options;
+    options.compress = true;
+    options.srgb = true;
+    options.quality = BlockQuality_Normal;
+
+    std::vector<std::string> images;
+    for(int i = 1; i < argc; ++i){
+        if(std::strcmp(argv[i], "--raw") == 0){
+            options.compress = false;
+        } else if(std::strcmp(argv[i], "--linear") == 0){
+            options.srgb = false;
+        } else if(std::strcmp(argv[i], "--quality") == 0 && i + 1 < argc){
+            ++i;
+            if(std::strcmp(argv[i], "fast") == 0) options.quality = BlockQuality_Fast;
+            else if(std::strcmp(argv[i], "normal") == 0) options.quality = BlockQuality_Normal;
+            else if(std::strcmp(argv[i], "high") == 0) options.quality = BlockQuality_High;
+            else { PrintUsage(); return 1; }
+        } else if(argv[i][0] == '-'){
+            PrintUsage();
+            return 1;
+        } else {
+            images.push_back(argv[i]);
+        }
+    }
+    if(images.empty()){
+        PrintUsage();
+        return 1;
+    }
+
+    int result = 0;
+    for(size_t i = 0; i < images.size(); ++i){
+        try {
+            Bake(images[i], options);
+        } catch(const std::exception& e) {
+            std::fprintf(stderr, "%s: %s\n", images[i].c_str(), e.what());
+            result = 1;
+        }
+    }
+    return result;
+}